@@ -0,0 +1,356 @@
+//bench.cpp
+//
+//Benchmarks every Image operation over synthetic images at several sizes
+//and over some of the sample images.  Each case is run a few times on a
+//fresh copy of the input and the median time is reported, along with
+//throughput in megapixels of output per second, as JSON.  Slow cases stop
+//repeating once they have used up a time budget, so a case may report
+//fewer runs than -reps.
+//
+//  hw1_bench [-quick] [-reps n] [-threads n] [-simd level] [-filter name]
+//            [-out results.json] [-compare baseline.json] [-tolerance f]
+//
+//With -compare, each case is looked up in a results file written by an
+//earlier run and flagged if its throughput dropped by more than the
+//tolerance (default 0.10, i.e. 10%).  The exit status is 1 if any case
+//regressed, so a baseline can gate changes.
+
+#include "convolve.h"
+#include "image.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include "planar.h"
+#include "pyramid.h"
+#include "stats.h"
+#include "typedimage.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef HW1_SAMPLE_IMAGES
+#define HW1_SAMPLE_IMAGES "sample_images"
+#endif
+
+using namespace std;
+
+
+/**
+ * Cases
+ **/
+struct BenchOp {
+	string name;
+	function<void(Image&)> run;   // replaces the image with the op's result
+};
+
+struct BenchInput {
+	string name;
+	Image image;
+};
+
+struct BenchResult {
+	string op, input;
+	int width, height;       // of the output
+	int reps;
+	double median_s;
+	double mpix_s;
+};
+
+static vector<BenchOp> MakeOps ()
+{
+	static const char *sampling[IMAGE_N_SAMPLING_METHODS] = {
+		"point", "bilinear", "gaussian", "box", "triangle", "mitchell", "lanczos3", "trilinear"
+	};
+	static const char *diffusion[IMAGE_N_DIFFUSION_KERNELS] = { "floydSteinberg", "atkinson", "stucki", "jarvis", "sierra" };
+
+	vector<BenchOp> ops = {
+		{ "noise",                [](Image &img) { img.AddNoise(0.5); } },
+		{ "brightness",           [](Image &img) { img.Brighten(1.3); } },
+		{ "contrast",             [](Image &img) { img.ChangeContrast(1.4); } },
+		{ "saturation",           [](Image &img) { img.ChangeSaturation(0.5); } },
+		{ "crop",                 [](Image &img) { img = img.Crop(img.Width()/4, img.Height()/4, img.Width()/2, img.Height()/2); } },
+		{ "extractChannel",       [](Image &img) { img.ExtractChannel(IMAGE_CHANNEL_GREEN); } },
+		{ "quantize",             [](Image &img) { img.Quantize(3); } },
+		{ "randomDither",         [](Image &img) { img.RandomDither(2); } },
+		{ "blur",                 [](Image &img) { img.Blur(3); } },
+		{ "blurFast",             [](Image &img) { img.BlurFast(5); } },
+		{ "sharpen",              [](Image &img) { img.Sharpen(2); } },
+		{ "edgeDetect",           [](Image &img) { img.EdgeDetect(); } },
+		{ "laplacian",            [](Image &img) { img.Laplacian(); } },
+		{ "sobel",                [](Image &img) { img.Sobel(); } },
+		{ "sobel/direction",      [](Image &img) { img.Sobel(IMAGE_GRADIENT_DIRECTION); } },
+		{ "prewitt",              [](Image &img) { img.Prewitt(); } },
+		{ "emboss",               [](Image &img) { img.Emboss(); } },
+		{ "convolve/5x5",         [](Image &img) { Convolve(img, ConvolutionKernel(5, 5, std::vector<int>(25, 1).data(), 25)); } },
+		{ "convolve/7x7",         [](Image &img) { Convolve(img, ConvolutionKernel(7, 7, std::vector<int>(49, 1).data(), 49)); } },
+		{ "orderedDither",        [](Image &img) { img.OrderedDither(2); } },
+		{ "orderedDither/blueNoise", [](Image &img) { img.OrderedDither(2, IMAGE_DITHER_BLUE_NOISE); } },
+		{ "FloydSteinbergDither", [](Image &img) { img.FloydSteinbergDither(2); } },
+		{ "FloydSteinbergDither/raster", [](Image &img) { img.FloydSteinbergDither(2, IMAGE_DITHER_RASTER); } },
+		{ "fun",                  [](Image &img) { img.Fun(); } },
+		{ "rotate90",             [](Image &img) { img = img.Rotate90(); } },
+		{ "rotate180",            [](Image &img) { img = img.Rotate180(); } },
+		{ "transpose",            [](Image &img) { img = img.Transpose(); } },
+		{ "flipH",                [](Image &img) { img.FlipHorizontal(); } },
+		{ "flipV",                [](Image &img) { img.FlipVertical(); } },
+		{ "pyramid",              [](Image &img) { ImagePyramid pyramid(img); } },
+		{ "boxFilter",            [](Image &img) { img.BoxFilter(8); } },
+		{ "localContrast",        [](Image &img) { img.LocalContrast(16, 1.5); } },
+		{ "stats",                [](Image &img) { ImageStats stats; ComputeStats(img, &stats); } },
+		{ "autoLevels",           [](Image &img) { img.AutoLevels(0.5); } },
+		{ "equalize",             [](Image &img) { img.Equalize(); } },
+	};
+	for (int k = 0; k < IMAGE_N_DIFFUSION_KERNELS; k++) {
+		ops.push_back({ string("diffusionDither/") + diffusion[k], [k](Image &img) { img.DiffusionDither(2, k); } });
+	}
+	for (int m = 0; m < IMAGE_N_SAMPLING_METHODS; m++) {
+		ops.push_back({ string("scale/") + sampling[m], [m](Image &img) { img.SetSamplingMethod(m); img = img.Scale(1.5, 0.75); } });
+		ops.push_back({ string("rotate/") + sampling[m], [m](Image &img) { img.SetSamplingMethod(m); img = img.Rotate(0.3); } });
+	}
+	// Split into planes and join again, and quantization through the
+	// planes' channel views with both conversions
+	ops.push_back({ "planar/convert", [](Image &img) { PlanarImage(img).Interleave(img); } });
+	ops.push_back({ "planar/quantize", [](Image &img) { PlanarImage planar(img); planar.Quantize(3); planar.Interleave(img); } });
+	// blur, sharpen, contrast in the wide working formats, with the
+	// conversions in and out
+	ops.push_back({ "chain/u8", [](Image &img) { img.Blur(3); img.Sharpen(2); img.ChangeContrast(1.4); } });
+	ops.push_back({ "chain/u16", [](Image &img) {
+		TypedImage<PixelRGBA16> wide(img);
+		wide.Blur(3); wide.Sharpen(2); wide.ChangeContrast(1.4);
+		img = wide.ToImage();
+	} });
+	ops.push_back({ "chain/f32", [](Image &img) {
+		TypedImage<PixelRGBA32F> wide(img);
+		wide.Blur(3); wide.Sharpen(2); wide.ChangeContrast(1.4);
+		img = wide.ToImage();
+	} });
+	// Crop as a view against the copy above, and edge detection run in
+	// place on each of 4 x 4 tiles
+	ops.push_back({ "crop/view", [](Image &img) {
+		Image crop = Image::Wrap(img.View(img.Width()/4, img.Height()/4, img.Width()/2, img.Height()/2));
+		assert(!crop.Empty());
+	} });
+	ops.push_back({ "edgeDetect/tiles", [](Image &img) {
+		for (int j = 0; j < 4; j++)
+			for (int i = 0; i < 4; i++) {
+				int x0 = img.Width() * i / 4, y0 = img.Height() * j / 4;
+				int x1 = img.Width() * (i + 1) / 4, y1 = img.Height() * (j + 1) / 4;
+				if (x1 > x0 && y1 > y0) Image::Wrap(img.View(x0, y0, x1 - x0, y1 - y0)).EdgeDetect();
+			}
+	} });
+	return ops;
+}
+
+// Smooth gradients with some hashed noise on top, so every op has real work
+static Image SyntheticImage (int width, int height)
+{
+	Image img(width, height);
+	for (int y = 0; y < height; y++) {
+		Pixel *row = img.Row(y);
+		for (int x = 0; x < width; x++) {
+			uint32_t h = (uint32_t) (x * 73856093) ^ (uint32_t) (y * 19349663);
+			h ^= h >> 13; h *= 0x5bd1e995; h ^= h >> 15;
+			row[x].r = (Component) ((x * 255 / width + (h & 31)) & 255);
+			row[x].g = (Component) ((y * 255 / height + ((h >> 5) & 31)) & 255);
+			row[x].b = (Component) (((x + y) * 127 / (width + height) + ((h >> 10) & 63)) & 255);
+			row[x].a = 255;
+		}
+	}
+	return img;
+}
+
+static vector<BenchInput> MakeInputs (bool quick)
+{
+	static const int sizes[][2] = { { 256, 256 }, { 1024, 768 }, { 1920, 1080 } };
+	static const char *samples[] = { "sun.jpg", "FerrisWheel.jpg" };
+
+	vector<BenchInput> inputs;
+	int nsizes = quick ? 1 : sizeof(sizes) / sizeof(sizes[0]);
+	for (int i = 0; i < nsizes; i++) {
+		char name[64];
+		snprintf(name, sizeof(name), "synthetic_%dx%d", sizes[i][0], sizes[i][1]);
+		inputs.push_back({ name, SyntheticImage(sizes[i][0], sizes[i][1]) });
+	}
+	int nsamples = quick ? 1 : sizeof(samples) / sizeof(samples[0]);
+	for (int i = 0; i < nsamples; i++) {
+		string path = string(HW1_SAMPLE_IMAGES) + "/" + samples[i];
+		FILE *f = fopen(path.c_str(), "rb");
+		if (f == NULL) {
+			fprintf(stderr, "bench: skipping missing %s\n", path.c_str());
+			continue;
+		}
+		fclose(f);
+		inputs.push_back({ samples[i], Image(&path[0]) });
+	}
+	return inputs;
+}
+
+
+/**
+ * Running
+ **/
+// Seconds a case may spend before it stops repeating
+static const double CASE_TIME_BUDGET = 2.0;
+
+static BenchResult RunCase (const BenchOp &op, const BenchInput &input, int reps)
+{
+	vector<double> times;
+	double total = 0;
+	Image img;
+	while ((int) times.size() < reps && (times.empty() || total < CASE_TIME_BUDGET)) {
+		img = input.image;
+		auto start = chrono::steady_clock::now();
+		op.run(img);
+		times.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+		total += times.back();
+	}
+	reps = (int) times.size();
+	sort(times.begin(), times.end());
+	double median = (reps % 2) ? times[reps/2] : 0.5 * (times[reps/2 - 1] + times[reps/2]);
+
+	BenchResult r;
+	r.op = op.name;
+	r.input = input.name;
+	r.width = img.Width();
+	r.height = img.Height();
+	r.reps = reps;
+	r.median_s = median;
+	r.mpix_s = median > 0 ? img.NumPixels() / 1e6 / median : 0.0;
+	return r;
+}
+
+// One result per line, so a baseline can be read back without a JSON parser
+static void WriteResults (FILE *f, const vector<BenchResult> &results)
+{
+	fprintf(f, "{\n  \"threads\": %d,\n  \"simd\": %d,\n  \"results\": [\n",
+		ThreadCount(), SimdLevel());
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult &r = results[i];
+		fprintf(f, "    {\"op\": \"%s\", \"input\": \"%s\", \"width\": %d, \"height\": %d, \"reps\": %d, \"median_s\": %.6f, \"mpix_s\": %.3f}%s\n",
+			r.op.c_str(), r.input.c_str(), r.width, r.height, r.reps, r.median_s, r.mpix_s,
+			i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+static bool ReadResults (const char *fname, vector<BenchResult> *results)
+{
+	FILE *f = fopen(fname, "r");
+	if (f == NULL) return false;
+	char line[512];
+	while (fgets(line, sizeof(line), f)) {
+		char op[128], input[128];
+		BenchResult r;
+		if (sscanf(line, " {\"op\": \"%127[^\"]\", \"input\": \"%127[^\"]\", \"width\": %d, \"height\": %d, \"reps\": %d, \"median_s\": %lf, \"mpix_s\": %lf",
+		           op, input, &r.width, &r.height, &r.reps, &r.median_s, &r.mpix_s) == 7) {
+			r.op = op;
+			r.input = input;
+			results->push_back(r);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+// Prints each case next to its baseline.  Returns the number of regressions.
+static int Compare (const vector<BenchResult> &results, const vector<BenchResult> &baseline, double tolerance)
+{
+	int regressions = 0;
+	fprintf(stderr, "%-22s %-24s %10s %10s %8s\n", "op", "input", "base", "now", "change");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult &r = results[i];
+		const BenchResult *b = NULL;
+		for (size_t j = 0; j < baseline.size() && b == NULL; j++)
+			if (baseline[j].op == r.op && baseline[j].input == r.input) b = &baseline[j];
+		if (b == NULL || b->mpix_s <= 0) {
+			fprintf(stderr, "%-22s %-24s %10s %10.1f %8s\n", r.op.c_str(), r.input.c_str(), "-", r.mpix_s, "new");
+			continue;
+		}
+		double change = r.mpix_s / b->mpix_s - 1;
+		bool regressed = change < -tolerance;
+		regressions += regressed;
+		fprintf(stderr, "%-22s %-24s %10.1f %10.1f %+7.1f%%%s\n", r.op.c_str(), r.input.c_str(),
+			b->mpix_s, r.mpix_s, 100 * change, regressed ? "  REGRESSION" : "");
+	}
+	return regressions;
+}
+
+static void ShowUsage ()
+{
+	fprintf(stderr,
+"Usage: hw1_bench [options]\n"
+"-quick                 one synthetic size and one sample image\n"
+"-reps <n>              runs per case, median reported (default 5; slow\n"
+"                       cases stop early after 2 s)\n"
+"-threads <n>           worker threads (default: hardware threads)\n"
+"-simd <level>          0 scalar, 1 SSE2, 2 AVX2 (default: best available)\n"
+"-filter <text>         only ops whose name contains text\n"
+"-out <file>            write JSON results to file instead of stdout\n"
+"-compare <file>        compare against an earlier -out file\n"
+"-tolerance <f>         allowed throughput drop for -compare (default 0.10)\n"
+	);
+	exit(-1);
+}
+
+
+/**
+ * main
+ **/
+int main (int argc, char *argv[])
+{
+	bool quick = false;
+	int reps = 5;
+	const char *filter = NULL, *out = NULL, *compare = NULL;
+	double tolerance = 0.10;
+
+	for (int i = 1; i < argc; i++) {
+		bool hasArg = i + 1 < argc;
+		if (!strcmp(argv[i], "-quick")) quick = true;
+		else if (!strcmp(argv[i], "-reps") && hasArg) reps = max(1, atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-threads") && hasArg) SetThreadCount(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-simd") && hasArg) SetSimdLevel(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-filter") && hasArg) filter = argv[++i];
+		else if (!strcmp(argv[i], "-out") && hasArg) out = argv[++i];
+		else if (!strcmp(argv[i], "-compare") && hasArg) compare = argv[++i];
+		else if (!strcmp(argv[i], "-tolerance") && hasArg) tolerance = atof(argv[++i]);
+		else ShowUsage();
+	}
+
+#ifndef __OPTIMIZE__
+	fprintf(stderr, "bench: warning, built without optimization (configure with -DCMAKE_BUILD_TYPE=Release)\n");
+#endif
+
+	vector<BenchResult> baseline;
+	if (compare && !ReadResults(compare, &baseline)) {
+		fprintf(stderr, "bench: cannot read baseline %s\n", compare);
+		return EXIT_FAILURE;
+	}
+
+	vector<BenchOp> ops = MakeOps();
+	vector<BenchInput> inputs = MakeInputs(quick);
+	vector<BenchResult> results;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		for (size_t j = 0; j < ops.size(); j++) {
+			if (filter && !strstr(ops[j].name.c_str(), filter)) continue;
+			BenchResult r = RunCase(ops[j], inputs[i], reps);
+			fprintf(stderr, "%-22s %-24s %9.4f s %9.1f MPix/s\n", r.op.c_str(), r.input.c_str(), r.median_s, r.mpix_s);
+			results.push_back(r);
+		}
+	}
+
+	FILE *f = out ? fopen(out, "w") : stdout;
+	if (f == NULL) {
+		fprintf(stderr, "bench: cannot write %s\n", out);
+		return EXIT_FAILURE;
+	}
+	WriteResults(f, results);
+	if (out) fclose(f);
+
+	if (compare && Compare(results, baseline, tolerance) > 0)
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,441 @@
+#include "convolve.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include "traverse.h"
+#include <algorithm>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CONVOLVE_X86 1
+#include <emmintrin.h>
+#else
+#define CONVOLVE_X86 0
+#endif
+
+/**
+ * Kernels
+ **/
+ConvolutionKernel::ConvolutionKernel (int width_, int height_, const int *weights_, int divisor_, int bias_)
+	: width(width_), height(height_), weights(weights_, weights_ + width_ * height_), divisor(divisor_), bias(bias_)
+{
+}
+
+bool ConvolutionKernel::Valid () const
+{
+	if (width < 1 || height < 1 || width % 2 == 0 || height % 2 == 0) return false;
+	if (width > CONVOLUTION_MAX_SIZE || height > CONVOLUTION_MAX_SIZE) return false;
+	if ((int) weights.size() != width * height) return false;
+	for (int w : weights)
+		if (w < -CONVOLUTION_MAX_WEIGHT || w > CONVOLUTION_MAX_WEIGHT) return false;
+	// Keeps sum / divisor + bias in 32 bits
+	return divisor != 0 && abs(divisor) <= (1 << 24) && abs(bias) <= 65535;
+}
+
+// Reads the next integer, skipping white space and comments.  Returns 1,
+// 0 at the end of the file, or -1 if the next word is not an integer.
+static int ReadKernelInt (FILE *f, int *v)
+{
+	int c;
+	while ((c = fgetc(f)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc(f)) != EOF && c != '\n') {}
+		}
+		else if (!isspace(c)) {
+			ungetc(c, f);
+			if (fscanf(f, "%d", v) != 1) return -1;
+			c = fgetc(f);
+			if (c != EOF && !isspace(c) && c != '#') return -1;
+			ungetc(c, f);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+bool LoadConvolutionKernel (const char *fname, ConvolutionKernel *kernel)
+{
+	FILE *f = fopen(fname, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Error opening kernel: %s\n", fname);
+		return false;
+	}
+
+	ConvolutionKernel k;
+	bool ok = ReadKernelInt(f, &k.width) > 0 && ReadKernelInt(f, &k.height) > 0 &&
+	          k.width > 0 && k.height > 0 && k.width <= CONVOLUTION_MAX_SIZE && k.height <= CONVOLUTION_MAX_SIZE;
+	if (ok) {
+		k.weights.resize(k.width * k.height);
+		for (int &w : k.weights) ok = ok && ReadKernelInt(f, &w) > 0;
+	}
+	if (ok) {
+		long sum = 0;
+		for (int w : k.weights) sum += w;
+		k.divisor = (sum > 0 && sum <= (1 << 24)) ? (int) sum : 1;
+		// An optional divisor, then an optional bias, then nothing
+		int extra, r = ReadKernelInt(f, &k.divisor);
+		if (r > 0) r = ReadKernelInt(f, &k.bias);
+		if (r > 0) r = ReadKernelInt(f, &extra) == 0 ? 0 : -1;
+		ok = r == 0;
+	}
+	fclose(f);
+
+	if (!ok || !k.Valid()) {
+		fprintf(stderr, "Error reading kernel: %s (want odd width and height up to %d, "
+		        "the weights, then optionally a nonzero divisor and a bias)\n", fname, CONVOLUTION_MAX_SIZE);
+		return false;
+	}
+	*kernel = k;
+	return true;
+}
+
+
+/**
+ * Taps
+ **/
+// A nonzero weight, dx columns from the center of kernel row `row`
+struct ConvolutionTap
+{
+	int row, dx, weight;
+};
+
+// The nonzero taps of N KW x KH kernels, each list padded with a zero tap
+// at the center so the SSE2 loop can take them in pairs
+template <int KW, int KH, int N>
+struct ConvolutionTaps
+{
+	ConvolutionTap taps[N][KW*KH + 1];
+	int count[N];
+
+	explicit ConvolutionTaps (const ConvolutionKernel *const *kernels)
+	{
+		for (int n = 0; n < N; n++) {
+			assert(kernels[n]->width == KW && kernels[n]->height == KH);
+			count[n] = 0;
+			for (int j = 0; j < KH; j++)
+				for (int i = 0; i < KW; i++) {
+					int w = kernels[n]->weights[j*KW + i];
+					if (w != 0) taps[n][count[n]++] = { j, i - KW/2, w };
+				}
+			taps[n][count[n]] = { KH/2, 0, 0 };
+		}
+	}
+};
+
+
+/**
+ * Outputs: the pixel for the sums of N kernels at it.  Scalar sets r, g
+ * and b; Simd returns four pixels whose alpha the caller replaces.
+ **/
+// sum / divisor + bias
+struct LinearOutput
+{
+	static const int N = 1;
+	int divisor, bias;
+
+	LinearOutput (int divisor_, int bias_) : divisor(divisor_), bias(bias_) {}
+
+	int Value (int sum) const
+	{
+		// Sums reach 4.1e8, past where float holds every integer.  In double
+		// the quotient is close enough that rounding it is exact.
+		if (divisor != 1) sum = (int) lrint((double) sum / divisor);
+		return ComponentClamp(sum + bias);
+	}
+
+	void Scalar (const int (*sums)[3], Pixel &out) const
+	{
+		out.r = Value(sums[0][0]);
+		out.g = Value(sums[0][1]);
+		out.b = Value(sums[0][2]);
+	}
+
+#if CONVOLVE_X86
+	__m128i Simd (const __m128i (*sums)[4]) const
+	{
+		__m128i v[4];
+		const __m128d d = _mm_set1_pd(divisor);
+		for (int p = 0; p < 4; p++) {
+			v[p] = sums[0][p];
+			// Two lanes at a time in double, rounding to nearest even as lrint does
+			if (divisor != 1) {
+				__m128i lo = _mm_cvtpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(v[p]), d));
+				__m128i hi = _mm_cvtpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v[p], _MM_SHUFFLE(1, 0, 3, 2))), d));
+				v[p] = _mm_unpacklo_epi64(lo, hi);
+			}
+			v[p] = _mm_add_epi32(v[p], _mm_set1_epi32(bias));
+		}
+		return _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+	}
+#endif
+};
+
+// sqrt(gx^2 + gy^2), in float
+struct MagnitudeOutput
+{
+	static const int N = 2;
+
+	static int Value (int gx, int gy)
+	{
+		float x = (float) gx, y = (float) gy;
+		return ComponentClamp((int) lrintf(sqrtf(x*x + y*y)));
+	}
+
+	void Scalar (const int (*sums)[3], Pixel &out) const
+	{
+		out.r = Value(sums[0][0], sums[1][0]);
+		out.g = Value(sums[0][1], sums[1][1]);
+		out.b = Value(sums[0][2], sums[1][2]);
+	}
+
+#if CONVOLVE_X86
+	__m128i Simd (const __m128i (*sums)[4]) const
+	{
+		__m128i v[4];
+		for (int p = 0; p < 4; p++) {
+			__m128 x = _mm_cvtepi32_ps(sums[0][p]), y = _mm_cvtepi32_ps(sums[1][p]);
+			v[p] = _mm_cvtps_epi32(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+		}
+		return _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+	}
+#endif
+};
+
+// atan2(gy, gx) from -pi to pi as 0 to 255; 0 where the image is flat
+struct DirectionOutput
+{
+	static const int N = 2;
+
+	static int Value (int gx, int gy)
+	{
+		if (gx == 0 && gy == 0) return 0;
+		return (int) lrint((atan2((double) gy, (double) gx) + M_PI) * (255 / (2 * M_PI)));
+	}
+
+	void Scalar (const int (*sums)[3], Pixel &out) const
+	{
+		out.r = Value(sums[0][0], sums[1][0]);
+		out.g = Value(sums[0][1], sums[1][1]);
+		out.b = Value(sums[0][2], sums[1][2]);
+	}
+
+#if CONVOLVE_X86
+	// No SSE2 atan2, so only the sums are vectorized
+	__m128i Simd (const __m128i (*sums)[4]) const
+	{
+		int32_t gx[4][4], gy[4][4];
+		Pixel out[4];
+		for (int p = 0; p < 4; p++) {
+			_mm_storeu_si128((__m128i *) gx[p], sums[0][p]);
+			_mm_storeu_si128((__m128i *) gy[p], sums[1][p]);
+			out[p].Set(Value(gx[p][0], gy[p][0]), Value(gx[p][1], gy[p][1]), Value(gx[p][2], gy[p][2]));
+		}
+		return _mm_loadu_si128((const __m128i *) out);
+	}
+#endif
+};
+
+
+/**
+ * Rows
+ **/
+// One pixel, through the column map.  rows[j] is the source row under
+// kernel row j, and cols[x] the source column of column x.
+template <int KW, int KH, int N, class Output>
+static inline void ConvolvePixel (const Pixel *const *rows, const int *cols, const ConvolutionTaps<KW, KH, N> &taps,
+                                  const Output &output, int x, Pixel &out)
+{
+	int sums[N][3] = {};
+	for (int n = 0; n < N; n++) {
+		for (int i = 0; i < taps.count[n]; i++) {
+			const ConvolutionTap &t = taps.taps[n][i];
+			const Pixel &p = rows[t.row][cols[x + t.dx]];
+			sums[n][0] += t.weight * p.r;
+			sums[n][1] += t.weight * p.g;
+			sums[n][2] += t.weight * p.b;
+		}
+	}
+	output.Scalar(sums, out);
+}
+
+#if CONVOLVE_X86
+// Pixels [x0, x1) four at a time, where every tap is inside the row.
+// Returns where it stopped.
+template <int KW, int KH, int N, class Output>
+static int ConvolveRowSSE2 (const Pixel *const *rows, const ConvolutionTaps<KW, KH, N> &taps,
+                            const Output &output, Pixel *dst, int x0, int x1)
+{
+	// Taps in pairs: the 16-bit samples of two taps interleave, so one
+	// madd multiplies both by their weights and adds them
+	const Pixel *src[N][KW*KH + 1];
+	__m128i weights[N][(KW*KH + 1) / 2] = {};
+	for (int n = 0; n < N; n++) {
+		for (int i = 0; i <= taps.count[n]; i++) src[n][i] = rows[taps.taps[n][i].row] + taps.taps[n][i].dx;
+		for (int i = 0; i < taps.count[n]; i += 2) {
+			uint16_t a = (uint16_t) taps.taps[n][i].weight, b = (uint16_t) taps.taps[n][i + 1].weight;
+			weights[n][i / 2] = _mm_set1_epi32((int) ((uint32_t) b << 16 | a));
+		}
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+	int x = x0;
+	for (; x + 4 <= x1; x += 4) {
+		__m128i sums[N][4];
+		for (int n = 0; n < N; n++) {
+			sums[n][0] = sums[n][1] = sums[n][2] = sums[n][3] = zero;
+			for (int i = 0; i < taps.count[n]; i += 2) {
+				__m128i a = _mm_loadu_si128((const __m128i *) (src[n][i] + x));
+				__m128i b = _mm_loadu_si128((const __m128i *) (src[n][i + 1] + x));
+				__m128i alo = _mm_unpacklo_epi8(a, zero), ahi = _mm_unpackhi_epi8(a, zero);
+				__m128i blo = _mm_unpacklo_epi8(b, zero), bhi = _mm_unpackhi_epi8(b, zero);
+				__m128i w = weights[n][i / 2];
+				sums[n][0] = _mm_add_epi32(sums[n][0], _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), w));
+				sums[n][1] = _mm_add_epi32(sums[n][1], _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), w));
+				sums[n][2] = _mm_add_epi32(sums[n][2], _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), w));
+				sums[n][3] = _mm_add_epi32(sums[n][3], _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), w));
+			}
+		}
+		// dst still holds these pixels' own alpha
+		__m128i out = output.Simd(sums);
+		__m128i old = _mm_loadu_si128((const __m128i *) (dst + x));
+		_mm_storeu_si128((__m128i *) (dst + x), _mm_or_si128(_mm_andnot_si128(alpha, out), _mm_and_si128(alpha, old)));
+	}
+	return x;
+}
+#endif
+
+// A row: the edge columns through the column map, the rest straight
+template <int KW, int KH, int N, class Output>
+static void ConvolveRow (const Pixel *const *rows, const int *cols, const ConvolutionTaps<KW, KH, N> &taps,
+                         const Output &output, Pixel *dst, int width, bool simd)
+{
+	int left = std::min(KW/2, width), right = std::max(width - KW/2, left);
+	int x = 0;
+	for (; x < left; x++) ConvolvePixel(rows, cols, taps, output, x, dst[x]);
+#if CONVOLVE_X86
+	if (simd) x = ConvolveRowSSE2(rows, taps, output, dst, x, right);
+#else
+	(void) simd;
+#endif
+	for (; x < width; x++) ConvolvePixel(rows, cols, taps, output, x, dst[x]);
+}
+
+
+/**
+ * The engine
+ **/
+static int BandStart (int band, int bands, int height)
+{
+	return (int) ((int64_t) height * band / bands);
+}
+
+template <int KW, int KH, class Border, class Output>
+static void ConvolveFixed (Image &img, const ConvolutionKernel *const *kernels, const Output &output)
+{
+	const int RX = KW/2, RY = KH/2;
+	int width = img.Width(), height = img.Height();
+	if (img.Empty()) return;
+	ConvolutionTaps<KW, KH, Output::N> taps(kernels);
+	bool simd = CONVOLVE_X86 && SimdLevel() >= SIMD_SSE2;
+	size_t rowBytes = (size_t) width * sizeof(Pixel);
+
+	// The source column of every column the row ends read
+	std::vector<int> colMap(width + 2*RX);
+	for (int x = -RX; x < width + RX; x++) colMap[x + RX] = Border::Map(x, width);
+
+	// Each band's RY rows above and below it, copied before any band writes
+	int bands = std::min(ThreadCount(), height);
+	std::vector<Pixel> halo((size_t) bands * 2*RY * width);
+	ParallelFor(bands, [&](int b0, int b1) {
+		for (int b = b0; b < b1; b++) {
+			int y0 = BandStart(b, bands, height), y1 = BandStart(b + 1, bands, height);
+			Pixel *above = halo.data() + (size_t) b * 2*RY * width, *below = above + (size_t) RY * width;
+			for (int k = 0; k < RY; k++) {
+				memcpy(above + (size_t) k * width, img.Row(Border::Map(y0 - RY + k, height)), rowBytes);
+				memcpy(below + (size_t) k * width, img.Row(Border::Map(y1 + k, height)), rowBytes);
+			}
+		}
+	});
+
+	// Each row is saved to a ring before it is overwritten, for the RY rows
+	// below it
+	ParallelFor(bands, [&](int b0, int b1) {
+		std::vector<Pixel> ring((size_t) (RY + 1) * width);
+		for (int b = b0; b < b1; b++) {
+			int y0 = BandStart(b, bands, height), y1 = BandStart(b + 1, bands, height);
+			const Pixel *above = halo.data() + (size_t) b * 2*RY * width, *below = above + (size_t) RY * width;
+			for (int y = y0; y < y1; y++) {
+				Pixel *dst = img.Row(y);
+				memcpy(ring.data() + (size_t) (y % (RY + 1)) * width, dst, rowBytes);
+				const Pixel *rows[KH];
+				for (int j = 0; j < KH; j++) {
+					int t = y + j - RY;
+					if (t < y0) rows[j] = above + (size_t) (t - (y0 - RY)) * width;
+					else if (t >= y1) rows[j] = below + (size_t) (t - y1) * width;
+					else if (t <= y) rows[j] = ring.data() + (size_t) (t % (RY + 1)) * width;
+					else rows[j] = img.Row(t);
+				}
+				ConvolveRow(rows, colMap.data() + RX, taps, output, dst, width, simd);
+			}
+		}
+	});
+}
+
+
+/**
+ * Dispatch from run-time sizes and borders to the templates
+ **/
+template <int KW, int KH, class Output>
+static void ConvolveBorder (Image &img, const ConvolutionKernel *const *kernels, const Output &output, int border)
+{
+	switch (border) {
+		case IMAGE_BORDER_MIRROR:      ConvolveFixed<KW, KH, MirrorBorder>(img, kernels, output); break;
+		case IMAGE_BORDER_CLAMP:       ConvolveFixed<KW, KH, ClampBorder>(img, kernels, output); break;
+		case IMAGE_BORDER_WRAP:        ConvolveFixed<KW, KH, WrapBorder>(img, kernels, output); break;
+		case IMAGE_BORDER_EDGE_DETECT: ConvolveFixed<KW, KH, AbsMirrorBorder>(img, kernels, output); break;
+		default: assert(false);
+	}
+}
+
+template <int KW, class Output>
+static void ConvolveHeight (Image &img, const ConvolutionKernel *const *kernels, const Output &output, int border)
+{
+	switch (kernels[0]->height) {
+		case 1: ConvolveBorder<KW, 1>(img, kernels, output, border); break;
+		case 3: ConvolveBorder<KW, 3>(img, kernels, output, border); break;
+		case 5: ConvolveBorder<KW, 5>(img, kernels, output, border); break;
+		case 7: ConvolveBorder<KW, 7>(img, kernels, output, border); break;
+		default: assert(false);
+	}
+}
+
+void Convolve (Image &img, const ConvolutionKernel &kernel, int border)
+{
+	assert(kernel.Valid() && border >= 0 && border < IMAGE_N_BORDERS);
+	// AbsMirrorBorder only reaches one pixel past the edges
+	assert(border != IMAGE_BORDER_EDGE_DETECT || (kernel.width <= 3 && kernel.height <= 3));
+	const ConvolutionKernel *kernels[1] = { &kernel };
+	LinearOutput output(kernel.divisor, kernel.bias);
+	switch (kernel.width) {
+		case 1: ConvolveHeight<1>(img, kernels, output, border); break;
+		case 3: ConvolveHeight<3>(img, kernels, output, border); break;
+		case 5: ConvolveHeight<5>(img, kernels, output, border); break;
+		case 7: ConvolveHeight<7>(img, kernels, output, border); break;
+		default: assert(false);
+	}
+}
+
+void ConvolveGradient (Image &img, const ConvolutionKernel &gx, const ConvolutionKernel &gy, int output, int border)
+{
+	assert(gx.Valid() && gy.Valid() && border >= 0 && border < IMAGE_N_BORDERS);
+	assert(gx.width == 3 && gx.height == 3 && gy.width == 3 && gy.height == 3);
+	const ConvolutionKernel *kernels[2] = { &gx, &gy };
+	if (output == IMAGE_GRADIENT_MAGNITUDE)
+		ConvolveBorder<3, 3>(img, kernels, MagnitudeOutput(), border);
+	else
+		ConvolveBorder<3, 3>(img, kernels, DirectionOutput(), border);
+}
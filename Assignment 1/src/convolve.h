@@ -0,0 +1,66 @@
+//convolve.h
+//
+//Convolution with small integer kernels.
+//
+//The engine is a template on the kernel's width and height, so the loops
+//over taps have fixed bounds.  Border handling is hoisted out of the
+//per-pixel work: each output row looks up its source rows once, and only
+//the pixels within a kernel radius of the left and right edges map their
+//columns.  The rest of the row runs four pixels at a time with SSE2, with
+//no branches.
+//
+//Convolution runs in place.  Each band of rows copies the rows just past
+//its ends before any band writes, then keeps the last few original rows of
+//its own in a ring, so no op copies the whole image.
+//
+//Kernels can be read from a text file: the width and height (odd, at most
+//CONVOLUTION_MAX_SIZE), the weights row by row, then optionally a divisor
+//and a bias.  The divisor defaults to the sum of the weights (1 if that is
+//not positive).  '#' starts a comment.  A 3x3 blur:
+//
+//    3 3
+//    1 2 1
+//    2 4 2
+//    1 2 1
+
+#ifndef CONVOLVE_INCLUDED
+#define CONVOLVE_INCLUDED
+
+#include "image.h"
+#include <vector>
+
+// Largest kernel width or height
+#define CONVOLUTION_MAX_SIZE 7
+
+// Weights must fit in 16 bits
+#define CONVOLUTION_MAX_WEIGHT 32767
+
+// Each of r, g and b becomes the weighted sum of the pixels around it,
+// divided by divisor (rounded to nearest, ties to even), plus bias,
+// clamped to 0..255.  Alpha is left alone.
+struct ConvolutionKernel
+{
+    int width, height;
+    std::vector<int> weights;   // height rows of width, top row first
+    int divisor, bias;
+
+    ConvolutionKernel () : width(0), height(0), divisor(1), bias(0) {}
+    ConvolutionKernel (int width, int height, const int *weights, int divisor = 1, int bias = 0);
+
+    // Whether the engine can run it
+    bool Valid () const;
+};
+
+// Reads a kernel file, or returns false with a message on stderr
+bool LoadConvolutionKernel(const char *fname, ConvolutionKernel *kernel);
+
+// Convolves img in place
+void Convolve(Image &img, const ConvolutionKernel &kernel, int border = IMAGE_BORDER_MIRROR);
+
+// Convolves img in place with a horizontal and a vertical derivative
+// kernel, both 3x3, and combines the two per channel as an
+// IMAGE_GRADIENT_* output
+void ConvolveGradient(Image &img, const ConvolutionKernel &gx, const ConvolutionKernel &gy,
+                      int output = IMAGE_GRADIENT_MAGNITUDE, int border = IMAGE_BORDER_MIRROR);
+
+#endif
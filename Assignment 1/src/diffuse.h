@@ -0,0 +1,213 @@
+//diffuse.h
+//
+//Row-major error-diffusion dithering.
+//
+//Pixels are visited row by row.  The quantization error of each component
+//is spread over not-yet-visited neighbors with the weights of a kernel.
+//Pending error is kept at full precision, in units of 1/DIVISOR, in a small
+//ring of int16 rows instead of being rounded and clamped into neighboring
+//pixels.  It is only added to a pixel when that pixel is quantized.
+//
+//IMAGE_DITHER_SERPENTINE runs odd rows right to left, with the kernel
+//mirrored.  This breaks up the diagonal artifacts of a fixed direction.
+//Each row then waits for the whole row above, so this mode is serial.
+//
+//IMAGE_DITHER_RASTER runs every row left to right.  A row only needs the
+//row above to be a few pixels ahead, so rows run on all threads as a
+//wavefront, each trailing the one above.  The arithmetic does not depend
+//on the schedule, so the output is the same for any thread count.
+
+#ifndef DIFFUSE_INCLUDED
+#define DIFFUSE_INCLUDED
+
+#include "image.h"
+#include "parallel.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * Kernels
+ **/
+// WEIGHTS[dy][dx + PAD] is the share of the error (out of DIVISOR) sent to
+// the pixel dx to the right and dy rows down.  Row 0 must be zero up to and
+// including the pixel itself.  The weights may add up to at most DIVISOR,
+// and DIVISOR * 255 must fit in an int16.
+struct FloydSteinbergKernel
+{
+    static const int ROWS = 2;
+    static const int PAD = 1;
+    static const int DIVISOR = 16;
+    static constexpr int WEIGHTS[ROWS][2*PAD + 1] = {
+        { 0, 0, 7 },
+        { 3, 5, 1 },
+    };
+};
+
+// Atkinson's kernel passes on only 3/4 of the error, which keeps highlights
+// and shadows clean at the cost of some detail
+struct AtkinsonKernel
+{
+    static const int ROWS = 3;
+    static const int PAD = 2;
+    static const int DIVISOR = 8;
+    static constexpr int WEIGHTS[ROWS][2*PAD + 1] = {
+        { 0, 0, 0, 1, 1 },
+        { 0, 1, 1, 1, 0 },
+        { 0, 0, 1, 0, 0 },
+    };
+};
+
+struct StuckiKernel
+{
+    static const int ROWS = 3;
+    static const int PAD = 2;
+    static const int DIVISOR = 42;
+    static constexpr int WEIGHTS[ROWS][2*PAD + 1] = {
+        { 0, 0, 0, 8, 4 },
+        { 2, 4, 8, 4, 2 },
+        { 1, 2, 4, 2, 1 },
+    };
+};
+
+// Jarvis, Judice and Ninke
+struct JarvisKernel
+{
+    static const int ROWS = 3;
+    static const int PAD = 2;
+    static const int DIVISOR = 48;
+    static constexpr int WEIGHTS[ROWS][2*PAD + 1] = {
+        { 0, 0, 0, 7, 5 },
+        { 3, 5, 7, 5, 3 },
+        { 1, 3, 5, 3, 1 },
+    };
+};
+
+// Sierra's three-row kernel
+struct SierraKernel
+{
+    static const int ROWS = 3;
+    static const int PAD = 2;
+    static const int DIVISOR = 32;
+    static constexpr int WEIGHTS[ROWS][2*PAD + 1] = {
+        { 0, 0, 0, 5, 3 },
+        { 2, 4, 5, 4, 2 },
+        { 0, 2, 3, 2, 0 },
+    };
+};
+
+
+/**
+ * Engine
+ **/
+// Rounds a / d to the nearest integer, halves away from zero
+inline int DiffuseRound (int a, int d)
+{
+    return (a >= 0) ? (a + d/2) / d : -((-a + d/2) / d);
+}
+
+// Diffuses one row, stepping DIR = +1 or -1 from its first pixel.  rows[dy]
+// holds the pending error of the row dy below.  wait(i) is called before
+// pixel i, counted in scan order, and may block until it is safe to touch.
+template <class K, int DIR, class Wait>
+void DiffuseRow (Pixel *row, int width, int16_t *const *rows, const Component *quant, Wait wait)
+{
+    int x = (DIR > 0) ? 0 : width - 1;
+    for (int i = 0; i < width; i++, x += DIR) {
+        wait(i);
+
+        Component *c = &row[x].r;
+        int16_t *e = rows[0] + x*3;
+        int err[3];
+        for (int k = 0; k < 3; k++) {
+            int v = c[k] + DiffuseRound(e[k], K::DIVISOR);
+            v = (v < 0) ? 0 : (v > 255) ? 255 : v;
+            c[k] = quant[v];
+            err[k] = v - quant[v];
+        }
+        for (int dy = 0; dy < K::ROWS; dy++) {
+            for (int dx = -K::PAD; dx <= K::PAD; dx++) {
+                const int w = K::WEIGHTS[dy][dx + K::PAD];
+                if (w == 0) continue;
+                int16_t *t = rows[dy] + (x + dx*DIR)*3;
+                t[0] += w * err[0];
+                t[1] += w * err[1];
+                t[2] += w * err[2];
+            }
+        }
+    }
+}
+
+// Quantizes each color component of img to nbits with kernel K.  The levels
+// are those of PixelQuant.  Alpha is left unchanged.
+template <class K>
+void ErrorDiffuse (Image &img, int nbits, int scan)
+{
+    static_assert(K::DIVISOR * 255 <= 32767, "pending error must fit in int16");
+    assert(nbits >= 1 && nbits <= 8);
+    int width = img.Width(), height = img.Height();
+
+    Component quant[256];
+    for (int v = 0; v < 256; v++) quant[v] = PixelQuant(Pixel(v, v, v), nbits).r;
+
+    // Error rows, three components per pixel plus PAD pixels on either side
+    // so the kernel never needs bounds checks.  In the wavefront each thread
+    // can have a row in flight, and each row writes up to ROWS - 1 rows
+    // ahead, so the ring holds that many.  A raster scan on one thread just
+    // runs the rows in order.
+    bool wavefront = (scan == IMAGE_DITHER_RASTER) && ThreadCount() > 1;
+    int ring = (wavefront ? ThreadCount() : 1) + K::ROWS;
+    int stride = (width + 2*K::PAD) * 3;
+    std::vector<int16_t> errors((size_t) ring * stride, 0);
+    auto errorRow = [&](int y) { return &errors[(size_t) (y % ring) * stride + K::PAD*3]; };
+
+    // Pixels finished in each row, for the wavefront
+    std::vector<std::atomic<int>> done(wavefront ? height : 0);
+
+    auto diffuseRow = [&](int y) {
+        Pixel *row = img.Row(y);
+        int16_t *rows[K::ROWS];
+        for (int dy = 0; dy < K::ROWS; dy++) rows[dy] = errorRow(y + dy);
+        // The farthest row this one writes to was last used ring rows ago
+        int16_t *last = rows[K::ROWS - 1] - K::PAD*3;
+        for (int i = 0; i < stride; i++) last[i] = 0;
+
+        if (!wavefront) {
+            if ((scan == IMAGE_DITHER_SERPENTINE) && (y & 1))
+                DiffuseRow<K, -1>(row, width, rows, quant, [](int) {});
+            else
+                DiffuseRow<K, 1>(row, width, rows, quant, [](int) {});
+            return;
+        }
+
+        // Writes from the row above must be past every cell this pixel's
+        // kernel touches, so it needs to be 2*PAD + 1 pixels ahead.  Progress
+        // is published every 32 pixels.
+        int ready = (y == 0) ? width : 0;
+        DiffuseRow<K, 1>(row, width, rows, quant, [&](int i) {
+            if (i > 0 && (i & 31) == 0) done[y].store(i, std::memory_order_release);
+            int need = (i + 2*K::PAD + 1 < width) ? i + 2*K::PAD + 1 : width;
+            int spins = 0;
+            while (ready < need) {
+                ready = done[y - 1].load(std::memory_order_acquire);
+                if (ready < need && ++spins > 64) std::this_thread::yield();
+            }
+        });
+        done[y].store(width, std::memory_order_release);
+    };
+
+    if (!wavefront) {
+        for (int y = 0; y < height; y++) diffuseRow(y);
+        return;
+    }
+
+    // Rows are claimed in order and each claimed row is being worked on, so
+    // the row a thread waits for is always making progress
+    for (int y = 0; y < height; y++) done[y].store(0, std::memory_order_relaxed);
+    std::atomic<int> next(0);
+    ParallelFor(ThreadCount(), [&](int, int) {
+        for (int y; (y = next.fetch_add(1)) < height; ) diffuseRow(y);
+    });
+}
+
+#endif
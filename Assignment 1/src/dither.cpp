@@ -0,0 +1,178 @@
+#include "dither.h"
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+static const int Bayer4[4][4] =
+{
+    {15,  7, 13,  5},
+    { 3, 11,  1,  9},
+    {12,  4, 14,  6},
+    { 0,  8,  2, 10}
+};
+
+// Each quadrant of a Bayer matrix twice the size is the half-size matrix
+// times four, plus the quadrant's rank in the same 2x2 order as Bayer4.
+static std::vector<int> BayerMatrix (int n)
+{
+	std::vector<int> m(n*n);
+	if (n == 4) {
+		for (int y = 0; y < 4; y++)
+			for (int x = 0; x < 4; x++) m[y*4 + x] = Bayer4[y][x];
+		return m;
+	}
+	static const int Bayer2[2][2] = { {3, 1}, {0, 2} };
+	int h = n/2;
+	std::vector<int> half = BayerMatrix(h);
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++)
+			m[y*n + x] = 4*half[(y % h)*h + x % h] + Bayer2[y/h][x/h];
+	return m;
+}
+
+
+/**
+ * Void and cluster
+ **/
+static const int BLUE_NOISE_SIZE = 64;
+static const double BLUE_NOISE_SIGMA = 1.5;
+static const int BLUE_NOISE_RADIUS = 6;
+
+// Energy of each pixel of an n x n torus: the Gaussian-weighted count of the
+// points around it
+struct EnergyField
+{
+	int n;
+	std::vector<double> energy;
+	std::vector<double> weight;
+
+	EnergyField (int n_) : n(n_), energy(n_*n_, 0)
+	{
+		const int R = BLUE_NOISE_RADIUS, side = 2*R + 1;
+		weight.resize(side*side);
+		for (int dy = -R; dy <= R; dy++)
+			for (int dx = -R; dx <= R; dx++)
+				weight[(dy + R)*side + dx + R] = exp(-(dx*dx + dy*dy) / (2*BLUE_NOISE_SIGMA*BLUE_NOISE_SIGMA));
+	}
+
+	// Adds (sign = 1) or removes (sign = -1) a point at pixel i
+	void Splat (int i, double sign)
+	{
+		const int R = BLUE_NOISE_RADIUS, side = 2*R + 1;
+		int x = i % n, y = i / n;
+		for (int dy = -R; dy <= R; dy++) {
+			int row = ((y + dy + n) % n) * n;
+			for (int dx = -R; dx <= R; dx++)
+				energy[row + (x + dx + n) % n] += sign * weight[(dy + R)*side + dx + R];
+		}
+	}
+
+	// Returns the pixel with on[i] == state of highest (or lowest) energy;
+	// ties go to the first one
+	int Extreme (const std::vector<char> &on, char state, bool highest) const
+	{
+		int best = -1;
+		for (int i = 0; i < n*n; i++) {
+			if (on[i] != state) continue;
+			if (best < 0 || (highest ? energy[i] > energy[best] : energy[i] < energy[best])) best = i;
+		}
+		return best;
+	}
+};
+
+static std::vector<int> BlueNoiseMatrix (int n)
+{
+	int count = n*n;
+	std::vector<int> rank(count);
+
+	// Initial pattern: a tenth of the pixels, picked by a fixed xorshift so
+	// the matrix is the same on every run
+	std::vector<char> initial(count, 0);
+	EnergyField field(n);
+	uint32_t s = 2463534242u;
+	int ones = 0;
+	while (ones < count/10) {
+		s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+		int i = s % count;
+		if (initial[i]) continue;
+		initial[i] = 1;
+		field.Splat(i, 1);
+		ones++;
+	}
+
+	// Spread it out: move the tightest cluster into the largest void until
+	// that would put the point back where it was
+	for (int iter = 0; iter < count; iter++) {
+		int cluster = field.Extreme(initial, 1, true);
+		initial[cluster] = 0;
+		field.Splat(cluster, -1);
+		int gap = field.Extreme(initial, 0, false);
+		initial[gap] = 1;
+		field.Splat(gap, 1);
+		if (gap == cluster) break;
+	}
+
+	// Phase 1: the initial points, ranked from the last removed cluster down
+	std::vector<char> on = initial;
+	EnergyField ones_field = field;
+	for (int r = ones - 1; r >= 0; r--) {
+		int cluster = ones_field.Extreme(on, 1, true);
+		on[cluster] = 0;
+		ones_field.Splat(cluster, -1);
+		rank[cluster] = r;
+	}
+
+	// Phase 2: fill the largest voids up to half the pixels
+	on = initial;
+	int r = ones;
+	for (; r < count/2; r++) {
+		int gap = field.Extreme(on, 0, false);
+		on[gap] = 1;
+		field.Splat(gap, 1);
+		rank[gap] = r;
+	}
+
+	// Phase 3: the unset pixels are now the minority, so fill their
+	// tightest clusters instead
+	EnergyField zeros(n);
+	for (int i = 0; i < count; i++)
+		if (!on[i]) zeros.Splat(i, 1);
+	for (; r < count; r++) {
+		int cluster = zeros.Extreme(on, 0, true);
+		on[cluster] = 1;
+		zeros.Splat(cluster, -1);
+		rank[cluster] = r;
+	}
+	return rank;
+}
+
+
+/**
+ * Matrices
+ **/
+const int* DitherMatrix (int matrix, int *size)
+{
+	assert(matrix >= 0 && matrix < IMAGE_N_DITHER_MATRICES);
+	switch (matrix) {
+		case IMAGE_DITHER_BAYER4: {
+			static const std::vector<int> m = BayerMatrix(4);
+			*size = 4;
+			return m.data();
+		}
+		case IMAGE_DITHER_BAYER8: {
+			static const std::vector<int> m = BayerMatrix(8);
+			*size = 8;
+			return m.data();
+		}
+		case IMAGE_DITHER_BAYER16: {
+			static const std::vector<int> m = BayerMatrix(16);
+			*size = 16;
+			return m.data();
+		}
+		default: {
+			static const std::vector<int> m = BlueNoiseMatrix(BLUE_NOISE_SIZE);
+			*size = BLUE_NOISE_SIZE;
+			return m.data();
+		}
+	}
+}
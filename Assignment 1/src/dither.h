@@ -0,0 +1,23 @@
+//dither.h
+//
+//Threshold matrices for ordered dithering.
+//
+//A matrix of size n holds every rank in [0, n*n) once; a pixel whose
+//position in the tiled matrix has rank k is rounded up when the fraction of
+//a quantization step it lies above a level is more than (k + 0.5) / (n*n).
+//
+//The Bayer matrices are the recursive dispersed-dot patterns, grown from the
+//4x4 one the assignment came with.  The blue-noise matrix is made with
+//Ulichney's void-and-cluster method on a torus, so it tiles without seams.
+
+#ifndef DITHER_INCLUDED
+#define DITHER_INCLUDED
+
+#include "image.h"
+
+// Returns the rank matrix for the given IMAGE_DITHER_* matrix, row-major,
+// and sets *size to its width (and height).  The matrices are built on first
+// use and live for the rest of the run.
+const int* DitherMatrix (int matrix, int *size);
+
+#endif
@@ -1,13 +1,41 @@
 #include "image.h"
+#include "convolve.h"
+#include "diffuse.h"
+#include "dither.h"
+#include "integral.h"
+#include "noise.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include "planar.h"
+#include "pyramid.h"
+#include "rasterfile.h"
+#include "rawimage.h"
+#include "resample.h"
+#include "stats.h"
+#include "transpose.h"
+#include "traverse.h"
+#include "warp.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 /**
  * Image
  **/
-Image::Image (int width_, int height_){
+Image::Image (){
+    width           = 0;
+    height          = 0;
+    num_pixels      = 0;
+    stride          = 0;
+    sampling_method = IMAGE_SAMPLING_POINT;
+    data.raw        = NULL;
+}
+
+Image::Image (int width_, int height_) : buffer((size_t) width_ * height_ * 4){
 
     assert(width_ > 0);
     assert(height_ > 0);
@@ -15,60 +43,139 @@ Image::Image (int width_, int height_){
     width           = width_;
     height          = height_;
     num_pixels      = width * height;
+    stride          = width;
     sampling_method = IMAGE_SAMPLING_POINT;
-    
-    data.raw = new uint8_t[num_pixels*4];
-	int b = 0; //which byte to write to
-	for (int j = 0; j < height; j++){
-		for (int i = 0; i < width; i++){
-			data.raw[b++] = 0;
-			data.raw[b++] = 0;
-			data.raw[b++] = 0;
-			data.raw[b++] = 0;
-		}
-	}
+    data.raw        = buffer.Bytes();   // zeroed by PixelBuffer
 
     assert(data.raw != NULL);
 }
 
-Image::Image (const Image& src){
-	
-	width           = src.width;
+Image::Image (const Image& src) : Image(src.View()){
+	sampling_method = src.sampling_method;
+}
+
+Image::Image (const ImageView& view){
+	width           = view.width;
+	height          = view.height;
+	num_pixels      = width * height;
+	stride          = width;
+	sampling_method = IMAGE_SAMPLING_POINT;
+	data.raw        = NULL;
+	if (view.Empty()) {
+		width = height = num_pixels = stride = 0;
+		return;
+	}
+	buffer   = PixelBuffer((size_t) num_pixels * 4);
+	data.raw = buffer.Bytes();
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		memcpy(row, view.Row(y), width * sizeof(Pixel));
+	});
+}
+
+Image Image::Wrap (const ImageView& view){
+	Image img;
+	if (view.Empty()) return img;
+	img.width      = view.width;
+	img.height     = view.height;
+	img.num_pixels = view.width * view.height;
+	img.stride     = (int) view.stride;
+	img.data.pixels = view.origin;
+	return img;
+}
+
+Image& Image::operator= (const Image& src){
+    if (this != &src) {
+        Image copy(src);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Image::Image (Image&& src) : buffer(std::move(src.buffer)){
+    width           = src.width;
     height          = src.height;
-    num_pixels      = width * height;
-    sampling_method = IMAGE_SAMPLING_POINT;
-    
-    data.raw = new uint8_t[num_pixels*4];
-    
-    //memcpy(data.raw, src.data.raw, num_pixels);
-    *data.raw = *src.data.raw;
+    num_pixels      = src.num_pixels;
+    stride          = src.stride;
+    sampling_method = src.sampling_method;
+    data.raw        = src.data.raw;     // the buffer's, or a wrapped view's
+
+    src.width = src.height = src.num_pixels = src.stride = 0;
+    src.data.raw = NULL;
+}
+
+Image& Image::operator= (Image&& src){
+    if (this != &src) {
+        buffer          = std::move(src.buffer);
+        width           = src.width;
+        height          = src.height;
+        num_pixels      = src.num_pixels;
+        stride          = src.stride;
+        sampling_method = src.sampling_method;
+        data.raw        = src.data.raw;
+
+        src.width = src.height = src.num_pixels = src.stride = 0;
+        src.data.raw = NULL;
+    }
+    return *this;
 }
 
 Image::Image (char* fname){
 
 	int numComponents; //(e.g., Y, YA, RGB, or RGBA)
-	data.raw = stbi_load(fname, &width, &height, &numComponents, 4);
+	void *mapping = NULL;
+	size_t mapping_size = 0;
+	uint8_t *bytes = NULL;
+	if (IsRawImageFile(fname) &&
+	    (bytes = MapRawImage(fname, &width, &height, &mapping, &mapping_size)) != NULL){
+		buffer = PixelBuffer::FromMapping(bytes, (size_t) width*height*4, mapping, mapping_size);
+	}
+	else if ((bytes = stbi_load(fname, &width, &height, &numComponents, 4)) != NULL){
+		// Copied so the pixels get the buffer's alignment
+		buffer = PixelBuffer((size_t) width*height*4);
+		memcpy(buffer.Bytes(), bytes, buffer.Size());
+		stbi_image_free(bytes);
+	}
+	else {
+		// stb_image does not read PAM
+		std::unique_ptr<RasterReader> r = RasterReader::Open(fname);
+		if (r != NULL){
+			width = r->Width();
+			height = r->Height();
+			buffer = PixelBuffer((size_t) width*height*4);
+			if (!r->ReadRows(0, height, (Pixel *) buffer.Bytes()))
+				buffer = PixelBuffer();
+		}
+	}
 	
-	if (data.raw == NULL){
+	if (buffer.Bytes() == NULL){
 		printf("Error loading image: %s", fname);
 		exit(-1);
 	}
 	
 
+	data.raw = buffer.Bytes();
 	num_pixels = width * height;
+	stride = width;
 	sampling_method = IMAGE_SAMPLING_POINT;
 	
 }
 
-Image::~Image (){
-    delete data.raw;
-    data.raw = NULL;
-}
-
 void Image::Write(char* fname){
 	
+	// The writers take packed rows
+	if (stride != width) {
+		Image(View()).Write(fname);
+		return;
+	}
+
 	int lastc = strlen(fname);
 
+	if (IsRawImageFile(fname)){
+		if (!WriteRawImage(fname, width, height, data.raw))
+			fprintf(stderr, "Error writing image: %s\n", fname);
+		return;
+	}
+
 	switch (fname[lastc-1]){
 	   case 'g': //jpeg (or jpg) or png
 	     if (fname[lastc-2] == 'p' || fname[lastc-2] == 'e') //jpeg or jpg
@@ -76,316 +183,564 @@ void Image::Write(char* fname){
 	     else //png
 	        stbi_write_png(fname, width, height, 4, data.raw, width*4);
 	     break;
-	   case 'a': //tga (targa)
+	   case 'a': //tga (targa), uncompressed so -stream can read it back
+	     stbi_write_tga_with_rle = 0;
 	     stbi_write_tga(fname, width, height, 4, data.raw);
 	     break;
+	   case 'm': //ppm or pam
+	   {
+	     std::unique_ptr<RasterWriter> w = RasterWriter::Open(fname, width, height);
+	     if (w != NULL) w->WriteRows(0, height, data.pixels);
+	     break;
+	   }
 	   case 'p': //bmp
 	   default:
 	     stbi_write_bmp(fname, width, height, 4, data.raw);
 	}
 }
 
+// Noise is generated a chunk of a row at a time, on the stack
+static const int NOISE_CHUNK = 256;
+
 void Image::AddNoise (double factor)
 {
-	int x, y;
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel p = GetPixel(x, y);
-			Pixel random = PixelRandom() * factor;
-			GetPixel(x, y) = p + random;
+	uint32_t stream = NextNoiseStream();
+	int width = Width();
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		Pixel noise[NOISE_CHUNK];
+		uint32_t key = NoiseRowKey(stream, y);
+		for (int x = 0; x < width; x += NOISE_CHUNK) {
+			int n = std::min(NOISE_CHUNK, width - x);
+			PixelRowRandom(noise, n, x, key);
+			PixelRowScale(noise, n, factor);
+			PixelRowAdd(row + x, noise, n);
 		}
-	}
+	});
 }
 
 void Image::Brighten (double factor)
 {
-	int x,y;
-	for (x = 0 ; x < Width() ; x++)
-	{
-		for (y = 0 ; y < Height() ; y++)
-		{
-			Pixel p = GetPixel(x, y);
-			Pixel scaled_p = p*factor;
-			GetPixel(x,y) = scaled_p;
-		}
-	}
+	ForEachRow(*this, [&](Pixel *row, int) {
+		PixelRowScale(row, Width(), factor);
+	});
 }
 
 
 void Image::ChangeContrast (double factor)
 {
 	factor = factor - 1;
-	int x, y;
-	double averageLuminance = 0;
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel p = GetPixel(x, y);
-			Component luminance = p.Luminance();
-			averageLuminance += luminance;
-		}
-	}
-	averageLuminance /= (Width() * Height());
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel p = GetPixel(x, y);
-			double r = p.r + (p.r - averageLuminance)*factor;
-			double g = p.g + (p.g - averageLuminance)*factor;
-			double b = p.b + (p.b - averageLuminance)*factor;
-			p.SetClamp(r, g, b);
-			GetPixel(x, y) = p;
-		}
-	}
+	ImageStats stats;
+	ComputeStats(*this, &stats);
+	double averageLuminance = (double) stats.Sum(INTEGRAL_LUMINANCE) / (Width() * Height());
+	ForEachRow(*this, [&](Pixel *row, int) {
+		PixelRowContrast(row, Width(), averageLuminance, factor);
+	});
 }
 
 
 void Image::ChangeSaturation(double factor)
 {
 	factor = factor - 1;
-    int x, y;
-    for (x = 0; x < Width(); x++) {
-        for (y = 0; y < Height(); y++) {
-            Pixel p = GetPixel(x, y);
-            Component luminance = p.Luminance();
-            double r = p.r + (p.r - luminance)*factor;
-			double g = p.g + (p.g - luminance)*factor;
-			double b = p.b + (p.b - luminance)*factor;
-			p.SetClamp(r, g, b);
-            GetPixel(x, y) = p;
-        }
-    }
+	ForEachRow(*this, [&](Pixel *row, int) {
+		PixelRowSaturate(row, Width(), factor);
+	});
 }
 
 
-Image* Image::Crop(int x, int y, int w, int h)
+Image Image::Crop(int x, int y, int w, int h) const
 {
-	Image *newImg = new Image(w, h);
-	int cx, cy;
-	for (cx = x; cx < w + x; cx++) {
-		for (cy = y; cy < h + y; cy++) {
-			newImg->SetPixel(cx - x, cy - y, GetPixel(cx, cy));
-		}
-	}
-	return newImg;
+	assert(ValidCoord(x, y) && ValidCoord(x + w - 1, y + h - 1));
+	return Image(View(x, y, w, h));
 }
 
 
+// Channel at a time through ChannelView, sharing the loops with the planar layout
 void Image::ExtractChannel(int channel)
 {
-	int x, y;
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel p = GetPixel(x, y);
-			switch (channel) {
-				case 0:
-					p.g = 0;
-					p.b = 0;
-					break;
-				case 1:
-					p.r = 0;
-					p.b = 0;
-					break;
-				case 2:
-					p.r = 0;
-					p.g = 0;
-					break;
-				default:
-					break;
-			}
-			GetPixel(x, y) = p;
-		}
-	}
+	if (channel < IMAGE_CHANNEL_RED || channel > IMAGE_CHANNEL_BLUE) return;
+	ParallelFor(Height(), [&](int y0, int y1) {
+		for (int c = IMAGE_CHANNEL_RED; c <= IMAGE_CHANNEL_BLUE; c++)
+			if (c != channel) FillChannel(ImageChannel(*this, c).Rows(y0, y1), 0);
+	});
 }
 
 
 void Image::Quantize (int nbits)
 {
-	int x, y;
 	double step = 255.0/(pow(2, nbits)-1);
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel p = GetPixel(x, y);
-			int r = (int) (step * (int) floor((double) p.r/step + 0.5));
-			int g = (int) (step * (int) floor((double) p.g/step + 0.5));
-			int b = (int) (step * (int) floor((double) p.b/step + 0.5));
-			p.SetClamp(r, g, b);
-			GetPixel(x, y) = p;
-		}
-	}
+	uint8_t quant[256];
+	for (int v = 0; v < 256; v++) quant[v] = ComponentQuantize(v, step);
+	ParallelFor(Height(), [&](int y0, int y1) {
+		for (int c = IMAGE_CHANNEL_RED; c <= IMAGE_CHANNEL_BLUE; c++)
+			MapChannel(ImageChannel(*this, c).Rows(y0, y1), quant);
+	});
 }
 
 void Image::RandomDither (int nbits)
 {
-	int x, y;
 	double step = 255.0/(pow(2, nbits)-1);
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel p = GetPixel(x, y);
-			double rnd = (rand() % (int) (step) - (step/2))/255.0;
-			int r = (int) (step * (int) floor((double) p.r/step + rnd + 0.5));
-			int g = (int) (step * (int) floor((double) p.g/step + rnd + 0.5));
-			int b = (int) (step * (int) floor((double) p.b/step + rnd + 0.5));
-			p.SetClamp(r, g, b);
-			GetPixel(x, y) = p;
+	uint32_t stream = NextNoiseStream();
+	int width = Width();
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		Pixel noise[NOISE_CHUNK];
+		uint32_t key = NoiseRowKey(stream, y);
+		for (int x = 0; x < width; x += NOISE_CHUNK) {
+			int n = std::min(NOISE_CHUNK, width - x);
+			PixelRowRandom(noise, n, x, key);
+			for (int i = 0; i < n; i++) {
+				Pixel &p = row[x + i], &q = noise[i];
+				uint32_t h = q.r | (q.g << 8) | (q.b << 16) | ((uint32_t) q.a << 24);
+				double rnd = (h % (int) (step) - (step/2))/255.0;
+				int r = (int) (step * (int) floor((double) p.r/step + rnd + 0.5));
+				int g = (int) (step * (int) floor((double) p.g/step + rnd + 0.5));
+				int b = (int) (step * (int) floor((double) p.b/step + rnd + 0.5));
+				p.SetClamp(r, g, b);
+			}
 		}
-	}
+	});
 }
 
 
-static int Bayer4[4][4] =
-{
-    {15,  7, 13,  5},
-    { 3, 11,  1,  9},
-    {12,  4, 14,  6},
-    { 0,  8,  2, 10}
-};
+// Row chunk for ordered dither.  The offsets are laid out for one chunk, so
+// it must be a multiple of every matrix size.
+static const int ORDERED_DITHER_CHUNK = 256;
 
+void Image::OrderedDither(int nbits, int matrix)
+{
+	assert(nbits >= 1 && nbits <= 8);
+	int size;
+	const int *rank = DitherMatrix(matrix, &size);
+	assert(ORDERED_DITHER_CHUNK % size == 0);
+	int levels = (1 << nbits) - 1;
+
+	// The matrix as offsets in [0, 255/levels) to add before rounding down,
+	// one chunk wide.  Alpha gets no offset.  Integer math keeps the top
+	// level at 255 for every nbits.
+	std::vector<Pixel> offsets(size * ORDERED_DITHER_CHUNK);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < ORDERED_DITHER_CHUNK; x++) {
+			int k = rank[y*size + x % size];
+			Component d = (Component) ((2*k + 1) * 255 / (2 * size*size * levels));
+			offsets[y*ORDERED_DITHER_CHUNK + x] = Pixel(d, d, d, 0);
+		}
+	}
+	Component quant[256];
+	for (int v = 0; v < 256; v++) quant[v] = (Component) ((v*levels/255 * 510 + levels) / (2*levels));
+
+	int width = Width();
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		const Pixel *offset = &offsets[(y % size) * ORDERED_DITHER_CHUNK];
+		for (int x = 0; x < width; x += ORDERED_DITHER_CHUNK) {
+			int n = std::min(ORDERED_DITHER_CHUNK, width - x);
+			PixelRowAdd(row + x, offset, n);
+			for (int i = 0; i < n; i++) {
+				Pixel &p = row[x + i];
+				p.r = quant[p.r];
+				p.g = quant[p.g];
+				p.b = quant[p.b];
+			}
+		}
+	});
+}
 
-void Image::OrderedDither(int nbits)
+void Image::FloydSteinbergDither(int nbits, int scan)
 {
-	/* WORK HERE */
+	assert(scan >= 0 && scan < IMAGE_N_DITHER_SCANS);
+	ErrorDiffuse<FloydSteinbergKernel>(*this, nbits, scan);
 }
 
-/* Error-diffusion parameters */
-const double
-    ALPHA = 7.0 / 16.0,
-    BETA  = 3.0 / 16.0,
-    GAMMA = 5.0 / 16.0,
-    DELTA = 1.0 / 16.0;
+void Image::DiffusionDither(int nbits, int kernel, int scan)
+{
+	assert(scan >= 0 && scan < IMAGE_N_DITHER_SCANS);
+	switch (kernel) {
+		case IMAGE_DIFFUSION_FLOYD_STEINBERG: ErrorDiffuse<FloydSteinbergKernel>(*this, nbits, scan); break;
+		case IMAGE_DIFFUSION_ATKINSON:        ErrorDiffuse<AtkinsonKernel>(*this, nbits, scan); break;
+		case IMAGE_DIFFUSION_STUCKI:          ErrorDiffuse<StuckiKernel>(*this, nbits, scan); break;
+		case IMAGE_DIFFUSION_JARVIS:          ErrorDiffuse<JarvisKernel>(*this, nbits, scan); break;
+		case IMAGE_DIFFUSION_SIERRA:          ErrorDiffuse<SierraKernel>(*this, nbits, scan); break;
+		default: assert(0);
+	}
+}
 
-void Image::FloydSteinbergDither(int nbits)
+std::vector<float> GaussianKernel(double sigma, int radius)
 {
-	int x, y;
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel p, quant, er;
-			p = GetPixel(x, y);
-			quant = PixelQuant(p, nbits);
-			int r = p.r - quant.r;
-			int g = p.g - quant.g;
-			int b = p.b - quant.b;
-			if (x+1 < Width()) {
-			    er = GetPixel(x+1, y);
-			    er.SetClamp(er.r + r * ALPHA, er.g + g * ALPHA, er.b + b * ALPHA);
-				GetPixel(x+1, y) = er;
-			}
-			if (y+1 < Height()) {
-				if (x-1 > 0) {
-					er = GetPixel(x-1, y+1);
-					er.SetClamp(er.r + r * BETA, er.g + g * BETA, er.b + b * BETA);
-					GetPixel(x-1, y+1) = er;
-				}
-				er = GetPixel(x, y+1);
-				er.SetClamp(er.r + r * GAMMA, er.g + g * GAMMA, er.b + b * GAMMA);
-				GetPixel(x, y+1) = er;
-				if (x+1 < Width()) {
-					er = GetPixel(x+1, y+1);
-					er.SetClamp(er.r + r * DELTA, er.g + g * DELTA, er.b + b * DELTA);
-					GetPixel(x+1, y+1) = er;
-				}
-			}
-			GetPixel(x, y) = quant;
-		}
+	std::vector<float> kernel(2*radius + 1);
+	double sum = 0;
+	for (int k = -radius; k <= radius; k++) {
+		double w = exp(-(double) (k*k) / (2*sigma*sigma));
+		kernel[k + radius] = (float) w;
+		sum += w;
 	}
+	for (int k = 0; k <= 2*radius; k++) {
+		kernel[k] = (float) (kernel[k] / sum);
+	}
+	return kernel;
 }
 
+/**
+ * Separable Gaussian blur with sigma = n and a 3n tap radius.  The row pass
+ * convolves into a float scratch image, the column pass convolves that back
+ * into the pixels, so nothing is rounded to 8 bits between passes.  Borders
+ * are mirrored.  The result stays within +-1 of a direct 2D convolution with
+ * the same (normalized) kernel.
+ **/
 void Image::Blur(int n)
 {
-	int x, y;
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			Pixel convolvedX = Pixel(0, 0, 0);
-			int filterX, filterY;
-			for (filterX = x - 3*n; filterX <= x + 3*n; filterX++) {
-				int tmpX = abs(filterX);
-				if (tmpX >= Width()) {
-					tmpX -= 2*(tmpX - Width()) + 1;
+	if (n <= 0) return;
+
+	int radius = 3*n;
+	int taps = 2*radius + 1;
+	std::vector<float> kernel = GaussianKernel(n, radius);
+	std::vector<float> tmp((size_t) width*height*4);
+
+	// Row pass: copy each row into a mirrored, padded float row so the inner
+	// loop needs no bounds checks.
+	ParallelFor(height, [&](int y0, int y1) {
+		std::vector<float> pad((size_t) (width + 2*radius)*4);
+		for (int y = y0; y < y1; y++) {
+			const uint8_t *src = (const uint8_t *) Row(y);
+			for (int x = -radius; x < width + radius; x++) {
+				const uint8_t *s = src + MirrorBorder::Map(x, width)*4;
+				float *d = &pad[(size_t) (x + radius)*4];
+				d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3];
+			}
+			float *dst = &tmp[(size_t) y*width*4];
+			for (int x = 0; x < width; x++) {
+				const float *s = &pad[(size_t) x*4];
+				float r = 0, g = 0, b = 0, a = 0;
+				for (int k = 0; k < taps; k++) {
+					float w = kernel[k];
+					r += w * s[k*4 + 0];
+					g += w * s[k*4 + 1];
+					b += w * s[k*4 + 2];
+					a += w * s[k*4 + 3];
 				}
-				convolvedX = convolvedX + GetPixel(tmpX, y) * (
-						1.0/sqrt(2*M_PI*pow((double) n, 2)) *
-						pow(M_E, -pow(filterX - x, 2)/(2*pow(n, 2)))
-						);
+				dst[x*4 + 0] = r; dst[x*4 + 1] = g; dst[x*4 + 2] = b; dst[x*4 + 3] = a;
 			}
-			Pixel convolvedY = Pixel(0, 0, 0);
-			for (filterY = y - 3*n; filterY <= y + 3*n; filterY++) {
-				int tmpY = abs(filterY);
-				if (tmpY >= Height()) {
-					tmpY -= 2*(tmpY - Height()) + 1;
+		}
+	});
+
+	// Column pass: accumulate whole scratch rows so memory is walked linearly.
+	ParallelFor(height, [&](int y0, int y1) {
+		std::vector<float> acc((size_t) width*4);
+		for (int y = y0; y < y1; y++) {
+			for (int i = 0; i < width*4; i++) acc[i] = 0;
+			for (int k = -radius; k <= radius; k++) {
+				const float *src = &tmp[(size_t) MirrorBorder::Map(y + k, height)*width*4];
+				float w = kernel[k + radius];
+				for (int i = 0; i < width*4; i++) {
+					acc[i] += w * src[i];
 				}
-				convolvedY = convolvedY + GetPixel(x, tmpY) * (
-						1.0/sqrt(2*M_PI*pow((double) n, 2)) *
-						pow(M_E, -pow(filterY - y, 2)/(2*pow(n, 2)))
-				);
 			}
-			GetPixel(x, y) = convolvedX * 0.5 + convolvedY * 0.5;
+			uint8_t *dst = (uint8_t *) Row(y);
+			for (int i = 0; i < width*4; i++) {
+				dst[i] = ComponentClamp((int) floor(acc[i] + 0.5f));
+			}
+		}
+	});
+}
+
+// Horizontal sliding-window box filter of radius r over rows [y0, y1) of a
+// float RGBA image.  Each output costs one add and one subtract regardless of r.
+static void BoxPassRows(const float *src, float *dst, int width, int y0, int y1, int r)
+{
+	float inv = 1.0f / (2*r + 1);
+	for (int y = y0; y < y1; y++) {
+		const float *s = src + (size_t) y*width*4;
+		float *d = dst + (size_t) y*width*4;
+		double sum[4] = {0, 0, 0, 0};
+		for (int k = -r; k <= r; k++) {
+			const float *p = s + MirrorBorder::Map(k, width)*4;
+			for (int c = 0; c < 4; c++) sum[c] += p[c];
+		}
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < 4; c++) d[x*4 + c] = (float) sum[c] * inv;
+			const float *add = s + MirrorBorder::Map(x + r + 1, width)*4;
+			const float *sub = s + MirrorBorder::Map(x - r, width)*4;
+			// In double, so the sum is exact and does not depend on where it started
+			for (int c = 0; c < 4; c++) sum[c] += (double) add[c] - (double) sub[c];
 		}
 	}
 }
 
-void Image::Sharpen(int n)
+// Vertical counterpart of BoxPassRows over the float lanes [i0, i1) of each
+// row.  Keeps a running sum per lane so memory is still walked linearly.
+static void BoxPassColumns(const float *src, float *dst, int width, int height, int i0, int i1, int r)
 {
-	Image *blurred = Crop(0, 0, Width(), Height());
-	blurred->Blur(n);
-	int x, y;
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-			GetPixel(x, y) = PixelLerp(GetPixel(x, y), blurred->GetPixel(x, y), -1);
+	size_t len = (size_t) width*4;
+	float inv = 1.0f / (2*r + 1);
+	int n = i1 - i0;
+	std::vector<double> sum(n, 0.0);
+	for (int k = -r; k <= r; k++) {
+		const float *p = src + MirrorBorder::Map(k, height)*len + i0;
+		for (int i = 0; i < n; i++) sum[i] += p[i];
+	}
+	for (int y = 0; y < height; y++) {
+		float *d = dst + y*len + i0;
+		const float *add = src + MirrorBorder::Map(y + r + 1, height)*len + i0;
+		const float *sub = src + MirrorBorder::Map(y - r, height)*len + i0;
+		for (int i = 0; i < n; i++) {
+			d[i] = (float) sum[i] * inv;
+			sum[i] += (double) add[i] - (double) sub[i];
 		}
 	}
 }
 
-static int EdgeM[3][3] = {
-		{-1, -1, -1},
-		{-1,  8, -1},
-		{-1, -1, -1}
-};
+void BoxBlurPasses(float *rgba, int width, int height, double sigma)
+{
+	const int passes = 3;
+	int wl = (int) floor(sqrt(12*sigma*sigma/passes + 1));
+	if (wl % 2 == 0) wl--;
+	int wu = wl + 2;
+	int m = (int) floor((12*sigma*sigma - passes*wl*wl - 4*passes*wl - 3*passes) / (-4.0*wl - 4) + 0.5);
+
+	// Columns are split into bands of whole pixels (4 float lanes each)
+	std::vector<float> tmp((size_t) width*height*4);
+	for (int pass = 0; pass < passes; pass++) {
+		int r = ((pass < m ? wl : wu) - 1) / 2;
+		ParallelFor(height, [&](int y0, int y1) {
+			BoxPassRows(rgba, tmp.data(), width, y0, y1, r);
+		});
+		ParallelFor(width, [&](int x0, int x1) {
+			BoxPassColumns(tmp.data(), rgba, width, height, x0*4, x1*4, r);
+		});
+	}
+}
 
-void Image::EdgeDetect()
+/**
+ * Approximates a Gaussian of standard deviation sigma with three successive
+ * box filters (widths chosen as in Kovesi, "Fast Almost-Gaussian Filtering").
+ * Each box is a running sum, so the cost per pixel does not depend on sigma.
+ **/
+void Image::BlurFast(double sigma)
 {
-    Image* oldPic = Crop(0, 0, Width(), Height());
-	int x, y;
-	for (x = 0; x < Width(); x++) {
-		for (y = 0; y < Height(); y++) {
-		    int r = 0;
-			int g = 0;
-			int b = 0;
-			int filterX, filterY;
-			for (filterX = x - 1; filterX <= x + 1; filterX++) {
-				for (filterY = y - 1; filterY <= y + 1; filterY++) {
-					int tmpX = abs(filterX);
-					int tmpY = abs(filterY);
-					if (tmpX >= Width()) {
-						tmpX -= 2 * (tmpX - Width()) + 1;
-					}
-					if (tmpY >= Height()) {
-						tmpY -= 2 * (tmpY - Height()) + 1;
-					}
-					Pixel p = oldPic->GetPixel(tmpX, tmpY);
-					r += p.r * (EdgeM[filterX - x + 1][filterY - y + 1]);
-					g += p.g * (EdgeM[filterX - x + 1][filterY - y + 1]);
-					b += p.b * (EdgeM[filterX - x + 1][filterY - y + 1]);
-				}
+	if (sigma <= 0) return;
+
+	std::vector<float> a((size_t) width*height*4);
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		const uint8_t *src = (const uint8_t *) row;
+		float *dst = &a[(size_t) y*width*4];
+		for (int i = 0; i < width*4; i++) dst[i] = src[i];
+	});
+
+	BoxBlurPasses(a.data(), width, height, sigma);
+
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		uint8_t *dst = (uint8_t *) row;
+		const float *src = &a[(size_t) y*width*4];
+		for (int i = 0; i < width*4; i++) dst[i] = ComponentClamp((int) floor(src[i] + 0.5f));
+	});
+}
+
+void Image::BoxFilter(int radius)
+{
+	if (radius <= 0) return;
+	IntegralImage sat(*this, INTEGRAL_RGBA);
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		int y0 = std::max(y - radius, 0), y1 = std::min(y + radius + 1, Height());
+		for (int x = 0; x < Width(); x++) {
+			int x0 = std::max(x - radius, 0), x1 = std::min(x + radius + 1, Width());
+			int64_t area = (int64_t) (x1 - x0) * (y1 - y0);
+			double inverse = 1.0 / area;
+			int64_t sum[4];
+			sat.Sums(x0, y0, x1, y1, sum);
+			Component *c = &row[x].r;
+			for (int k = 0; k < 4; k++) {
+				// Rounded sum / area, by a multiply corrected to the exact
+				// quotient instead of a 64-bit divide
+				int64_t s = sum[k] + area/2;
+				int64_t q = (int64_t) (s * inverse);
+				if (q * area > s) q--;
+				else if ((q + 1) * area <= s) q++;
+				c[k] = (Component) q;
 			}
-			GetPixel(x, y).SetClamp(r, g, b);
+		}
+	});
+}
+
+void Image::LocalContrast(int radius, double factor)
+{
+	if (radius < 0) radius = 0;
+	factor = factor - 1;
+	IntegralImage sat(*this, INTEGRAL_CHANNEL(INTEGRAL_LUMINANCE));
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		int y0 = std::max(y - radius, 0), y1 = std::min(y + radius + 1, Height());
+		for (int x = 0; x < Width(); x++) {
+			int x0 = std::max(x - radius, 0), x1 = std::min(x + radius + 1, Width());
+			double gray = sat.Mean(INTEGRAL_LUMINANCE, x0, y0, x1, y1);
+			row[x].r = ComponentContrast(row[x].r, gray, factor);
+			row[x].g = ComponentContrast(row[x].g, gray, factor);
+			row[x].b = ComponentContrast(row[x].b, gray, factor);
+		}
+	});
+}
+
+// Maps r, g and b through their tables
+static void ApplyTables (Image &img, const Component lut[3][256])
+{
+	ForEachRow(img, [&](Pixel *row, int) {
+		for (int x = 0; x < img.Width(); x++) {
+			row[x].r = lut[0][row[x].r];
+			row[x].g = lut[1][row[x].g];
+			row[x].b = lut[2][row[x].b];
+		}
+	});
+}
+
+void Image::AutoLevels(double clipPercent)
+{
+	ImageStats stats;
+	ComputeStats(*this, &stats);
+	double clip = std::min(std::max(clipPercent, 0.0), 50.0) / 100;
+	Component lut[3][256];
+	for (int c = 0; c < 3; c++) {
+		int lo = stats.Percentile(c, clip), hi = stats.Percentile(c, 1 - clip);
+		for (int v = 0; v < 256; v++) {
+			// Rounded (v - lo) * 255 / (hi - lo), in integers
+			int range = hi - lo;
+			lut[c][v] = (range <= 0) ? v : ComponentClamp((2 * (v - lo) * 255 + range) / (2 * range));
 		}
 	}
+	ApplyTables(*this, lut);
 }
 
-Image* Image::Scale(double sx, double sy)
+void Image::Equalize()
 {
-    Image* newImg = new Image((int) (sx*Width()), (int) (sy*Height()));
-    int x, y;
-    for (x = 0; x < newImg->Width(); x++) {
-    	for (y = 0; y < newImg->Height(); y++) {
-    	    double u = (double) x / sx;
-			double v = (double) y / sy;
-			newImg->GetPixel(x, y) = Sample(u, v);
-    	}
-    }
+	ImageStats stats;
+	ComputeStats(*this, &stats);
+	const int64_t *hist = stats.histogram[INTEGRAL_LUMINANCE];
+	// The darkest level present goes to 0 and the brightest to 255
+	int64_t cdf = 0, cdfMin = hist[stats.Min(INTEGRAL_LUMINANCE)], range = stats.Count() - cdfMin;
+	Component lut[3][256];
+	for (int v = 0; v < 256; v++) {
+		cdf += hist[v];
+		int level = (range <= 0) ? v : (int) ((std::max(cdf - cdfMin, (int64_t) 0) * 510 + range) / (2 * range));
+		lut[0][v] = lut[1][v] = lut[2][v] = (Component) level;
+	}
+	ApplyTables(*this, lut);
+}
+
+void Image::Sharpen(int n)
+{
+	Image blurred(*this);
+	// Past this sigma the box cascade beats the 6n+1 tap separable kernel
+	if (n >= SHARPEN_FAST_BLUR_SIGMA)
+		blurred.BlurFast(n);
+	else
+		blurred.Blur(n);
+	ForEachRow(*this, [&](Pixel *row, int y) {
+		PixelRowLerp(row, blurred.Row(y), Width(), -1);
+	});
+}
+
+static const int EdgeM[9] = {
+		-1, -1, -1,
+		-1,  8, -1,
+		-1, -1, -1
+};
+
+void Image::EdgeDetect()
+{
+	Convolve(*this, ConvolutionKernel(3, 3, EdgeM), IMAGE_BORDER_EDGE_DETECT);
+}
+
+static const int LaplacianM[9] = {
+		 0, -1,  0,
+		-1,  4, -1,
+		 0, -1,  0
+};
+
+static const int SobelX[9] = {
+		-1,  0,  1,
+		-2,  0,  2,
+		-1,  0,  1
+};
+
+static const int SobelY[9] = {
+		-1, -2, -1,
+		 0,  0,  0,
+		 1,  2,  1
+};
+
+static const int PrewittX[9] = {
+		-1,  0,  1,
+		-1,  0,  1,
+		-1,  0,  1
+};
+
+static const int PrewittY[9] = {
+		-1, -1, -1,
+		 0,  0,  0,
+		 1,  1,  1
+};
+
+static const int EmbossM[9] = {
+		-2, -1,  0,
+		-1,  1,  1,
+		 0,  1,  2
+};
+
+void Image::Laplacian(int border)
+{
+	Convolve(*this, ConvolutionKernel(3, 3, LaplacianM), border);
+}
+
+void Image::Sobel(int output, int border)
+{
+	ConvolveGradient(*this, ConvolutionKernel(3, 3, SobelX), ConvolutionKernel(3, 3, SobelY), output, border);
+}
+
+void Image::Prewitt(int output, int border)
+{
+	ConvolveGradient(*this, ConvolutionKernel(3, 3, PrewittX), ConvolutionKernel(3, 3, PrewittY), output, border);
+}
+
+void Image::Emboss(int border)
+{
+	Convolve(*this, ConvolutionKernel(3, 3, EmbossM), border);
+}
+
+Image Image::Scale(double sx, double sy)
+{
+	Image newImg((int) (sx*Width()), (int) (sy*Height()));
+
+	// Big reductions start from a pyramid level, 2^level times smaller.
+	// Trilinear sampling picks its own levels.
+	int level = 0;
+	if (sampling_method != IMAGE_SAMPLING_TRILINEAR) level = ImagePyramid::LevelFor(*this, sx, sy);
+	ImagePyramid pyramid(*this, level + 1);
+	const Image &src = pyramid.Level(level);
+	sx = ldexp(sx, level);
+	sy = ldexp(sy, level);
+
+	if (IsResampleFilter(sampling_method)) {
+		Resample(src, newImg, sx, sy, sampling_method);
+		return newImg;
+	}
+	// Trilinear sampling is centered on the output pixels, like the
+	// resampling filters
+	double center = (sampling_method == IMAGE_SAMPLING_TRILINEAR) ? 0.5 : 0;
+	const double m[6] = { 1 / sx, 0, center / sx,
+	                      0, 1 / sy, center / sy };
+	AffineWarp(src, newImg, m, sampling_method);
 	return newImg;
 }
 
-Image* Image::Rotate(double angle)
+Image Image::Rotate(double angle)
 {
+	// Quarter turns just move pixels.  An angle counts as one if the rest of
+	// it would move no pixel by more than a hundredth of a pixel, so that
+	// a typed-in 1.5708 still gets the exact path.
+	double turns = nearbyint(angle / (M_PI/2));
+	if (fabs(angle - turns * (M_PI/2)) * std::max(Width(), Height()) < 0.01) {
+		switch (((long) turns % 4 + 4) % 4) {
+			case 0: return *this;
+			case 1: return Rotate90();
+			case 2: return Rotate180();
+			case 3: return Rotate270();
+		}
+	}
+
 	int p1x, p1y, p2x, p2y, p3x, p3y;
 	p1x = (int) (cos(angle) * Width());
 	p1y = (int) (sin(angle) * Width());
@@ -400,29 +755,75 @@ Image* Image::Rotate(double angle)
 	minY = (int) fmin(0, fmin(p1y, fmin(p2y, p3y)));
 	int sizeX = maxX - minX;
 	int sizeY = maxY - minY;
-    Image* newImg = new Image(sizeX, sizeY);
-    int x, y;
-    for (x = minX; x < maxX; x++) {
-        for (y = minY; y < maxY; y++) {
-            double u = (double) x * cos(-angle) - (double) y * sin(-angle);
-            double v = (double) x * sin(-angle) + (double) y * cos(-angle);
-            newImg->GetPixel(x - minX, y - minY) = Sample(u, v);
-        }
-    }
-    return newImg;
+	Image newImg(sizeX, sizeY);
+	// Output (x, y) is (x + minX, y + minY) rotated back by angle
+	double c = cos(-angle), s = sin(-angle);
+	const double m[6] = { c, -s, minX * c - minY * s,
+	                      s,  c, minX * s + minY * c };
+	AffineWarp(*this, newImg, m, sampling_method);
+	return newImg;
+}
+
+Image Image::Rotate90() const
+{
+	// Transpose the rows bottom up
+	Image newImg(Height(), Width());
+	if (!Empty()) TransposePixels(Row(Height() - 1), -Stride(), newImg.Row(0), newImg.Width(), Width(), Height());
+	return newImg;
+}
+
+Image Image::Rotate180() const
+{
+	Image newImg(Width(), Height());
+	ForEachRow(newImg, [&](Pixel *row, int y) {
+		ReversePixels(Row(Height() - 1 - y), row, Width());
+	});
+	return newImg;
+}
+
+Image Image::Rotate270() const
+{
+	// Transpose into the rows bottom up
+	Image newImg(Height(), Width());
+	if (!Empty()) TransposePixels(Row(0), Stride(), newImg.Row(Width() - 1), -newImg.Width(), Width(), Height());
+	return newImg;
+}
+
+Image Image::Transpose() const
+{
+	Image newImg(Height(), Width());
+	if (!Empty()) TransposePixels(Row(0), Stride(), newImg.Row(0), newImg.Width(), Width(), Height());
+	return newImg;
+}
+
+void Image::FlipHorizontal()
+{
+	int width = Width();
+	ParallelFor(Height(), [&](int y0, int y1) {
+		std::vector<Pixel> copy(width);
+		for (int y = y0; y < y1; y++) {
+			memcpy(copy.data(), Row(y), width * sizeof(Pixel));
+			ReversePixels(copy.data(), Row(y), width);
+		}
+	});
+}
+
+void Image::FlipVertical()
+{
+	int width = Width(), height = Height();
+	ParallelFor(height / 2, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) std::swap_ranges(Row(y), Row(y) + width, Row(height - 1 - y));
+	});
 }
 
 void Image::Fun()
 {
-    Image* oldImg = Crop(0, 0, Width(), Height());
-    int x, y;
-    for (x = 0; x < Width(); x++) {
-    	for (y = 0; y < Height(); y++) {
-    		double u = x + sin((double) x / Width() * 100) * 20;
-			double v = y + sin((double) y / Width() * 100) * 20;
-    	    GetPixel(x, y) = oldImg->Sample(u, v);
-    	}
-    }
+	Image oldImg(*this);
+	ForEachPixelXY(*this, [&](Pixel &p, int x, int y) {
+		double u = x + sin((double) x / Width() * 100) * 20;
+		double v = y + sin((double) y / Width() * 100) * 20;
+		p = oldImg.Sample(u, v);
+	});
 }
 
 /**
@@ -440,60 +841,11 @@ Pixel Image::Sample(double u, double v) {
 		Pixel px = Pixel(0, 0, 0, 0);
 		return px;
 	}
-	Pixel p, pX, pY;
-	int radius;
-	int x, y;
-    switch(sampling_method) {
-    	case IMAGE_SAMPLING_POINT:
-    	    p = GetPixel((int) u, (int) v);
-    		break;
-    	case IMAGE_SAMPLING_BILINEAR:
-    		pX = Pixel(0, 0, 0);
-			pY = Pixel(0, 0, 0);
-    		radius = 5;
-    	    for (x = -radius; x <= radius; x++) {
-				int tmpX = (int) fabs(u + x);
-				if (tmpX >= Width()) {
-					tmpX -= 2*(tmpX - Width()) + 1;
-				}
-				pX = pX + GetPixel(tmpX, (int) v) * ((1.0 - fabs((double) x / (double) radius)) / radius);
-    	    }
-			for (y = -radius; y <= radius; y++) {
-				int tmpY = (int) fabs(v + y);
-				if (tmpY >= Height()) {
-					tmpY -= 2*(tmpY - Height()) + 1;
-				}
-				pY = pY + GetPixel((int) u, tmpY) * ((1.0 - fabs((double) y / (double) radius)) / radius);
-			}
-			p = pX * 0.5 + pY * 0.5;
-    		break;
-    	case IMAGE_SAMPLING_GAUSSIAN:
-			pX = Pixel(0, 0, 0);
-			pY = Pixel(0, 0, 0);
-			radius = 2;
-			for (x = -3*radius; x <= 3*radius; x++) {
-				int tmpX = (int) fabs(u + x);
-				if (tmpX >= Width()) {
-					tmpX -= 2*(tmpX - Width()) + 1;
-				}
-				pX = pX + GetPixel(tmpX, (int) v) * (
-						1.0/sqrt(2*M_PI*pow((double) radius, 2)) *
-						pow(M_E, -pow(x, 2)/(2*pow(radius, 2)))
-				);
-			}
-			for (y = -3*radius; y <= 3*radius; y++) {
-				int tmpY = (int) fabs(v + y);
-				if (tmpY >= Height()) {
-					tmpY -= 2*(tmpY - Height()) + 1;
-				}
-				pY = pY + GetPixel((int) u, tmpY) * (
-						1.0/sqrt(2*M_PI*pow((double) radius, 2)) *
-						pow(M_E, -pow(y, 2)/(2*pow(radius, 2)))
-				);
-			}
-			p = pX * 0.5 + pY * 0.5;
-    		break;
-		default:break;
+	switch (sampling_method) {
+		case IMAGE_SAMPLING_POINT:    return SamplePoint(*this, u, v);
+		case IMAGE_SAMPLING_BILINEAR: return SampleBilinear(*this, u, v);
+		case IMAGE_SAMPLING_GAUSSIAN: return SampleGaussian(*this, u, v);
+		case IMAGE_SAMPLING_TRILINEAR: return ImagePyramid(*this, 1).Sample(u, v, 0);
+		default:                      return ResampleAt(*this, u, v, sampling_method);
 	}
-	return p;
 }
\ No newline at end of file
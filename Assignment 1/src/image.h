@@ -10,7 +10,10 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <vector>
 #include "pixel.h"
+#include "pixelbuffer.h"
+#include "imageview.h"
 
 
 #include "stb_image.h"
@@ -23,9 +26,56 @@ enum {
     IMAGE_SAMPLING_POINT,
     IMAGE_SAMPLING_BILINEAR,
     IMAGE_SAMPLING_GAUSSIAN,
+    IMAGE_SAMPLING_BOX,         // box to lanczos3 use resample.h
+    IMAGE_SAMPLING_TRIANGLE,
+    IMAGE_SAMPLING_MITCHELL,
+    IMAGE_SAMPLING_LANCZOS3,
+    IMAGE_SAMPLING_TRILINEAR,   // bilinear between pyramid.h levels
     IMAGE_N_SAMPLING_METHODS
 };
 
+// Scan orders for error diffusion
+enum {
+    IMAGE_DITHER_SERPENTINE,
+    IMAGE_DITHER_RASTER,
+    IMAGE_N_DITHER_SCANS
+};
+
+// Error-diffusion kernels
+enum {
+    IMAGE_DIFFUSION_FLOYD_STEINBERG,
+    IMAGE_DIFFUSION_ATKINSON,
+    IMAGE_DIFFUSION_STUCKI,
+    IMAGE_DIFFUSION_JARVIS,
+    IMAGE_DIFFUSION_SIERRA,
+    IMAGE_N_DIFFUSION_KERNELS
+};
+
+// Threshold matrices for ordered dither
+enum {
+    IMAGE_DITHER_BAYER4,
+    IMAGE_DITHER_BAYER8,
+    IMAGE_DITHER_BAYER16,
+    IMAGE_DITHER_BLUE_NOISE,
+    IMAGE_N_DITHER_MATRICES
+};
+
+// How convolutions read pixels past the edges (see convolve.h)
+enum {
+    IMAGE_BORDER_MIRROR,        // reflect about the edge pixels
+    IMAGE_BORDER_CLAMP,         // repeat the edge pixels
+    IMAGE_BORDER_WRAP,          // tile the image
+    IMAGE_BORDER_EDGE_DETECT,   // EdgeDetect's convention, traverse.h AbsMirrorBorder
+    IMAGE_N_BORDERS
+};
+
+// What the gradient filters output for each channel
+enum {
+    IMAGE_GRADIENT_MAGNITUDE,   // sqrt(gx^2 + gy^2)
+    IMAGE_GRADIENT_DIRECTION,   // atan2(gy, gx), -pi..pi as 0..255, 0 where flat
+    IMAGE_N_GRADIENT_OUTPUTS
+};
+
 enum {
     IMAGE_CHANNEL_RED,
     IMAGE_CHANNEL_GREEN,
@@ -49,35 +99,60 @@ public:
        uint8_t *raw;
     };
     
-    PixelData data;
+    PixelData data;         // pixel (0, 0), in buffer or in a wrapped view
     //PixelInfo *pixels; //pixel array
     //uint8_t *pixelData;
     int width, height, num_pixels;
+    int stride;             // pixels from one row to the next; width unless wrapped
     int sampling_method;
 	//BMP* bmpImg;
 
+private:
+    PixelBuffer buffer;     // owns the pixels
+
 public:
+    // Creates an empty 0 x 0 image
+    Image ();
+
     // Creates a blank image with the given dimensions
     Image (int width, int height);
 
     // Copy iamage
     Image (const Image& src);
+    Image& operator= (const Image& src);
+
+    // Moves the pixels without copying them; src is left empty
+    Image (Image&& src);
+    Image& operator= (Image&& src);
 
-	// Make image from file
+	// Make image from file.  .rgba files are memory mapped, not copied.
 	Image(char *fname);
 
-    // Destructor
-    ~Image ();
+    // Copies the pixels of a view into a new image
+    explicit Image (const ImageView& view);
+
+    // An image over the pixels of a view, without copying or owning them.
+    // Ops on it change the view's pixels in place; ops that return a new
+    // image return one that owns its pixels.  The pixels must outlive it.
+    static Image Wrap (const ImageView& view);
+
+    // Views of the whole image, or of the w x h rectangle at (x, y)
+    ImageView View () const { return ImageView(data.pixels, width, height, stride); }
+    ImageView View (int x, int y, int w, int h) const { return View().Sub(x, y, w, h); }
 
     // Pixel access
     int ValidCoord (int x, int y)  const { return x>=0 && x<width && y>=0 && y<height; }
-    Pixel& GetPixel (int x, int y) const { assert(ValidCoord(x,y));  return data.pixels[y*width + x]; }
-    void SetPixel (int x, int y, Pixel p) const { assert(ValidCoord(x,y));  data.pixels[y*width + x] = p; }
+    Pixel& GetPixel (int x, int y) const { assert(ValidCoord(x,y));  return data.pixels[(ptrdiff_t) y*stride + x]; }
+    void SetPixel (int x, int y, Pixel p) const { assert(ValidCoord(x,y));  data.pixels[(ptrdiff_t) y*stride + x] = p; }
+    Pixel* Row (int y) const { assert(y>=0 && y<height);  return data.pixels + (ptrdiff_t) y*stride; }
+    int Stride () const { return stride; }
+    bool Wrapped () const { return data.raw != NULL && buffer.Bytes() == NULL; }
 
     // Dimension access
     int Width     () const { return width; }
     int Height    () const { return height; }
     int NumPixels () const { return num_pixels; }
+    bool Empty    () const { return num_pixels == 0; }
 
 	// Make file from image
 	void Write( char *fname );
@@ -97,6 +172,18 @@ public:
      **/
     void ChangeContrast (double factor);
 
+    // Changes the contrast of each pixel around the mean luminance of the
+    // (2r+1) x (2r+1) box around it, instead of the whole image's.
+    void LocalContrast(int radius, double factor);
+
+    // Stretches each of r, g and b so its clipPercent and 100 - clipPercent
+    // percentiles go to 0 and 255, clipping clipPercent at each end.
+    void AutoLevels(double clipPercent);
+
+    // Histogram equalization: maps r, g and b through the cumulative
+    // histogram of the luminance, so the luminance spreads over 0..255.
+    void Equalize();
+
     /**
      * Changes the saturation of an image by interpolating between the
      * image and a gray level version of the image.  Interpolation
@@ -107,9 +194,9 @@ public:
 
     /**
      * Extracts a sub image from the image, at position (x, y), width w,
-     * and height h.
+     * and height h.  View(x, y, w, h) gets the same pixels without copying.
      **/
-    Image* Crop(int x, int y, int w, int h);
+    Image Crop(int x, int y, int w, int h) const;
 
     /**
      * Extracts a channel of an image.  Leaves the specified channel
@@ -125,32 +212,66 @@ public:
     // Converts and image to nbits per channel using random dither.
     void RandomDither(int nbits);
 
-    // Blurs an image with an n x n Gaussian filter.
+    // Blurs an image with a separable Gaussian filter of standard deviation n
+    // (a 6n+1 tap kernel), mirroring at the borders.
     void Blur(int n);
 
+    // Approximates a Gaussian blur of standard deviation sigma with three box
+    // filter passes.  Runs in constant time per pixel for any sigma.
+    void BlurFast(double sigma);
+
+    // Replaces each pixel with the mean of the (2r+1) x (2r+1) box around
+    // it, cut off at the edges.  Constant time per pixel for any radius.
+    void BoxFilter(int radius);
+
 	// Sharpens an image by blurring with an n x n Gaussian filter and then extrapolating
     void Sharpen(int n);
 
     // Detects edges in an image.
     void EdgeDetect();
 
+    // Convolutions with the usual 3x3 kernels, reading past the edges with
+    // an IMAGE_BORDER_* policy.  Laplacian is the 4-neighbor version of
+    // EdgeDetect; Sobel and Prewitt give an IMAGE_GRADIENT_* output of their
+    // x and y derivatives; Emboss adds a diagonal derivative to the image.
+    // Any kernel runs through convolve.h.
+    void Laplacian(int border = IMAGE_BORDER_MIRROR);
+    void Sobel(int output = IMAGE_GRADIENT_MAGNITUDE, int border = IMAGE_BORDER_MIRROR);
+    void Prewitt(int output = IMAGE_GRADIENT_MAGNITUDE, int border = IMAGE_BORDER_MIRROR);
+    void Emboss(int border = IMAGE_BORDER_MIRROR);
+
     /**
      * Converts an image to nbits per channel using ordered dither, with a
-     * 4x4 Bayer's pattern matrix.
+     * Bayer's pattern matrix (4x4 by default) or a blue-noise matrix.
      **/
-    void OrderedDither(int nbits);
+    void OrderedDither(int nbits, int matrix = IMAGE_DITHER_BAYER4);
 
     /**
      * Converts an image to nbits per channel using Floyd-Steinberg dither
-     * with error diffusion.
+     * with error diffusion.  Serpentine scans alternate direction each row;
+     * raster scans run left to right and are spread over the threads.
      **/
-    void FloydSteinbergDither(int nbits);
+    void FloydSteinbergDither(int nbits, int scan = IMAGE_DITHER_SERPENTINE);
+
+    // Converts an image to nbits per channel using error diffusion with the
+    // given IMAGE_DIFFUSION_* kernel, in the given scan order.
+    void DiffusionDither(int nbits, int kernel, int scan = IMAGE_DITHER_SERPENTINE);
 
     // Scales an image in x by sx, and y by sy.
-    Image* Scale(double sx, double sy);
+    Image Scale(double sx, double sy);
+
+    // Rotates an image by the given angle.  Multiples of pi/2 are exact
+    // quarter turns.
+    Image Rotate(double angle);
 
-    // Rotates an image by the given angle.
-    Image* Rotate(double angle);
+    // Lossless reorientation.  Quarter turns are clockwise, like positive
+    // angles for Rotate.  Transpose swaps x and y.
+    Image Rotate90() const;
+    Image Rotate180() const;
+    Image Rotate270() const;
+    Image Transpose() const;
+    void FlipHorizontal();
+    void FlipVertical();
 
     // Warps an image using a creative filter of your choice.
     void Fun();
@@ -162,4 +283,14 @@ public:
     Pixel Sample(double u, double v);
 };
 
+// The normalized 1D Gaussian Blur convolves with, sampled at the integer
+// offsets [-radius, radius].
+std::vector<float> GaussianKernel(double sigma, int radius);
+
+// BlurFast's three box passes, in place on a width x height float RGBA image
+void BoxBlurPasses(float *rgba, int width, int height, double sigma);
+
+// Sigma from which Sharpen blurs with BlurFast instead of Blur
+#define SHARPEN_FAST_BLUR_SIGMA 4
+
 #endif
@@ -0,0 +1,43 @@
+//imageview.h
+//
+//Non-owning views of a rectangle of pixels.
+//
+//A view is an origin, a size and a row stride, so taking a sub-rectangle
+//of a view is O(1) and copies nothing.  Image::View gives a view of an
+//image, Image(view) copies one into a new image, and Image::Wrap makes an
+//Image over a view's pixels so any op can run on a sub-rectangle, or on
+//the tiles of a larger image, in place.
+
+#ifndef IMAGEVIEW_INCLUDED
+#define IMAGEVIEW_INCLUDED
+
+#include <assert.h>
+#include <stddef.h>
+#include "pixel.h"
+
+struct ImageView
+{
+    Pixel *origin;          // pixel (0, 0)
+    int width, height;
+    ptrdiff_t stride;       // pixels from one row to the next
+
+    // An empty view
+    ImageView () : origin(NULL), width(0), height(0), stride(0) {}
+    ImageView (Pixel *origin_, int width_, int height_, ptrdiff_t stride_)
+        : origin(origin_), width(width_), height(height_), stride(stride_) {}
+
+    int Width () const { return width; }
+    int Height () const { return height; }
+    bool Empty () const { return width == 0 || height == 0; }
+    Pixel* Row (int y) const { assert(y >= 0 && y < height);  return origin + y * stride; }
+    Pixel& GetPixel (int x, int y) const { assert(x >= 0 && x < width);  return Row(y)[x]; }
+
+    // The w x h rectangle at (x, y), which must lie inside the view
+    ImageView Sub (int x, int y, int w, int h) const
+    {
+        assert(x >= 0 && y >= 0 && w >= 0 && h >= 0 && x + w <= width && y + h <= height);
+        return ImageView(origin + y * stride + x, w, h, stride);
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "integral.h"
+#include "parallel.h"
+
+// The channel values of a pixel, in INTEGRAL_* order
+static inline void ChannelValues (Pixel p, int v[INTEGRAL_N_CHANNELS])
+{
+	v[INTEGRAL_R] = p.r;
+	v[INTEGRAL_G] = p.g;
+	v[INTEGRAL_B] = p.b;
+	v[INTEGRAL_A] = p.a;
+	v[INTEGRAL_LUMINANCE] = p.Luminance();
+}
+
+
+/**
+ * Tables
+ **/
+IntegralImage::IntegralImage (const Image &img, int mask, bool keepSquares)
+	: width(img.Width()), height(img.Height())
+{
+	int ids[INTEGRAL_N_CHANNELS];
+	channels = 0;
+	for (int c = 0; c < INTEGRAL_N_CHANNELS; c++) {
+		slot[c] = (mask & INTEGRAL_CHANNEL(c)) ? channels : -1;
+		if (slot[c] >= 0) ids[channels++] = c;
+	}
+	stride = (width + 1) * channels;
+	size_t entries = (size_t) (height + 1) * stride;
+	sums.reset(new int64_t[entries]);
+	if (keepSquares) squares.reset(new int64_t[entries]);
+
+	// A few bands per thread, each summed from zero
+	int bands = ThreadCount() * 4;
+	if (bands > height) bands = (height > 0) ? height : 1;
+	auto bandStart = [&](int b) { return (int) ((int64_t) height * b / bands); };
+	band.assign(height + 1, 0);
+	for (int b = 0; b < bands; b++) {
+		for (int y = bandStart(b); y < bandStart(b + 1); y++) band[y + 1] = b;
+	}
+
+	for (int i = 0; i < stride; i++) sums[i] = 0;
+	if (keepSquares) for (int i = 0; i < stride; i++) squares[i] = 0;
+
+	ParallelFor(bands, [&](int b0, int b1) {
+		int v[INTEGRAL_N_CHANNELS];
+		for (int b = b0; b < b1; b++) {
+			for (int y = bandStart(b); y < bandStart(b + 1); y++) {
+				// Running sums along the row, plus the table row above
+				// unless that one is in another band
+				const Pixel *row = img.Row(y);
+				int64_t *out = &sums[(size_t) (y + 1) * stride];
+				int64_t *outSquares = keepSquares ? &squares[(size_t) (y + 1) * stride] : NULL;
+				int64_t run[INTEGRAL_N_CHANNELS] = { 0 }, runSquares[INTEGRAL_N_CHANNELS] = { 0 };
+				for (int k = 0; k < channels; k++) out[k] = 0;
+				for (int x = 0; x < width; x++) {
+					ChannelValues(row[x], v);
+					int64_t *entry = out + (size_t) (x + 1) * channels;
+					for (int k = 0; k < channels; k++) entry[k] = run[k] += v[ids[k]];
+				}
+				if (keepSquares) {
+					for (int k = 0; k < channels; k++) outSquares[k] = 0;
+					for (int x = 0; x < width; x++) {
+						ChannelValues(row[x], v);
+						int64_t *entry = outSquares + (size_t) (x + 1) * channels;
+						for (int k = 0; k < channels; k++) entry[k] = runSquares[k] += (int64_t) v[ids[k]] * v[ids[k]];
+					}
+				}
+				if (y == bandStart(b)) continue;
+				for (int i = 0; i < stride; i++) out[i] += out[i - stride];
+				if (keepSquares) for (int i = 0; i < stride; i++) outSquares[i] += outSquares[i - stride];
+			}
+		}
+	});
+
+	// Each band's offset is everything in the bands above it
+	auto offsetRows = [&](const int64_t *table, std::vector<int64_t> &offsets) {
+		offsets.assign((size_t) bands * stride, 0);
+		for (int b = 1; b < bands; b++) {
+			const int64_t *last = table + (size_t) bandStart(b) * stride;
+			for (int i = 0; i < stride; i++) offsets[(size_t) b * stride + i] = offsets[(size_t) (b - 1) * stride + i] + last[i];
+		}
+	};
+	offsetRows(sums.get(), sumOffsets);
+	if (keepSquares) offsetRows(squares.get(), squareOffsets);
+}
+
+int64_t IntegralImage::Region (const int64_t *table, const int64_t *offsets, int channel, int x0, int y0, int x1, int y1) const
+{
+	assert(Has(channel));
+	assert(0 <= x0 && x0 <= x1 && x1 <= width && 0 <= y0 && y0 <= y1 && y1 <= height);
+	int c = slot[channel];
+	return Corner(table, offsets, c, x1, y1) - Corner(table, offsets, c, x0, y1)
+	     - Corner(table, offsets, c, x1, y0) + Corner(table, offsets, c, x0, y0);
+}
+
+void IntegralImage::Sums (int x0, int y0, int x1, int y1, int64_t *out) const
+{
+	assert(0 <= x0 && x0 <= x1 && x1 <= width && 0 <= y0 && y0 <= y1 && y1 <= height);
+	const int64_t *top = &sums[(size_t) y0 * stride], *bottom = &sums[(size_t) y1 * stride];
+	const int64_t *topOffset = &sumOffsets[(size_t) band[y0] * stride];
+	const int64_t *bottomOffset = &sumOffsets[(size_t) band[y1] * stride];
+	size_t a = (size_t) x0 * channels, b = (size_t) x1 * channels;
+	for (int k = 0; k < channels; k++) {
+		out[k] = (bottom[b + k] + bottomOffset[b + k]) - (bottom[a + k] + bottomOffset[a + k])
+		       - (top[b + k] + topOffset[b + k]) + (top[a + k] + topOffset[a + k]);
+	}
+}
+
+int64_t IntegralImage::Sum (int channel, int x0, int y0, int x1, int y1) const
+{
+	return Region(sums.get(), sumOffsets.data(), channel, x0, y0, x1, y1);
+}
+
+double IntegralImage::Mean (int channel, int x0, int y0, int x1, int y1) const
+{
+	int64_t area = (int64_t) (x1 - x0) * (y1 - y0);
+	assert(area > 0);
+	return (double) Sum(channel, x0, y0, x1, y1) / area;
+}
+
+double IntegralImage::Variance (int channel, int x0, int y0, int x1, int y1) const
+{
+	assert(squares);
+	int64_t area = (int64_t) (x1 - x0) * (y1 - y0);
+	assert(area > 0);
+	double mean = Mean(channel, x0, y0, x1, y1);
+	double meanSquare = (double) Region(squares.get(), squareOffsets.data(), channel, x0, y0, x1, y1) / area;
+	double variance = meanSquare - mean * mean;
+	return (variance > 0) ? variance : 0;
+}
@@ -0,0 +1,82 @@
+//integral.h
+//
+//Summed-area tables (integral images).
+//
+//Entry (x, y) of the table holds the sum of every pixel above and to the
+//left of (x, y), so the sum over any rectangle is four lookups.  Each
+//channel (red, green, blue, alpha, and Pixel::Luminance) has its own 64-bit
+//sums, which cannot overflow for any image that fits in memory, and sums
+//of squares can be kept too for variances.
+//
+//The table is built in one parallel pass: each band of rows is summed on
+//its own, starting from zero, and the sums of the bands above are kept as
+//one offset row per band, added back at lookup time.
+
+#ifndef INTEGRAL_INCLUDED
+#define INTEGRAL_INCLUDED
+
+#include "image.h"
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Channels
+ **/
+enum {
+    INTEGRAL_R,
+    INTEGRAL_G,
+    INTEGRAL_B,
+    INTEGRAL_A,
+    INTEGRAL_LUMINANCE,
+    INTEGRAL_N_CHANNELS
+};
+
+// Masks of channels to build
+#define INTEGRAL_CHANNEL(c)  (1 << (c))
+#define INTEGRAL_RGBA        0x0f
+#define INTEGRAL_ALL         0x1f
+
+
+/**
+ * Tables
+ **/
+class IntegralImage
+{
+public:
+    // Builds the sums of the channels in mask, and their squares if asked.
+    IntegralImage(const Image &img, int mask = INTEGRAL_ALL, bool keepSquares = false);
+
+    int Width () const { return width; }
+    int Height () const { return height; }
+    bool Has (int channel) const { return slot[channel] >= 0; }
+
+    // Statistics of a channel over the pixels [x0, x1) x [y0, y1).  The
+    // region must be inside the image; Mean and Variance need it non-empty,
+    // and Variance needs the squares.
+    int64_t Sum(int channel, int x0, int y0, int x1, int y1) const;
+    double Mean(int channel, int x0, int y0, int x1, int y1) const;
+    double Variance(int channel, int x0, int y0, int x1, int y1) const;
+
+    // The sums of every channel in the mask over the region at once, lowest
+    // channel first
+    void Sums(int x0, int y0, int x1, int y1, int64_t *out) const;
+
+private:
+    int width, height;
+    int stride;                          // entries per table row
+    int slot[INTEGRAL_N_CHANNELS];       // position in an entry, or -1
+    int channels;                        // channels per entry
+    std::unique_ptr<int64_t[]> sums, squares;          // (height + 1) rows
+    std::vector<int64_t> sumOffsets, squareOffsets;   // one row per band
+    std::vector<int> band;               // band of each table row
+
+    int64_t Corner (const int64_t *table, const int64_t *offsets, int c, int x, int y) const
+    {
+        size_t i = (size_t) x * channels + c;
+        return table[(size_t) y * stride + i] + offsets[(size_t) band[y] * stride + i];
+    }
+    int64_t Region(const int64_t *table, const int64_t *offsets, int channel, int x0, int y0, int x1, int y1) const;
+};
+
+#endif
@@ -11,18 +11,22 @@
 //Web page: http://easybmp.sourceforge.net 
 
 
+#include "convolve.h"
 #include "image.h"
+#include "noise.h"
+#include "parallel.h"
+#include "planar.h"
+#include "pixelrow.h"
+#include "pointops.h"
+#include "stats.h"
+#include "strip.h"
+#include "typedimage.h"
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-
-
-#define STB_IMAGE_IMPLEMENTATION //only place once in one .cpp file
-#include "stb_image.h"
-
-#define STB_IMAGE_WRITE_IMPLEMENTATION //only place once in one .cpp files
-#include "stb_image_write.h"
+#include <chrono>
+#include <cmath>
 
 
 using namespace std;
@@ -33,10 +37,26 @@ using namespace std;
  **/
 static void ShowUsage(void);
 static void CheckOption(char *option, int argc, int minargc);
+static int DitherScanOption(int &argc, char **&argv);
+static int GradientOption(int &argc, char **&argv);
+static int BorderOption(int &argc, char **&argv);
+static bool IsPointOp(const char *option);
+static bool IsWideOp(const char *option);
+static int PreferredLayout(const char *option);
+static int RunStreaming(int strip_rows, int argc, char *argv[]);
+static void ReportThroughput(const char *op, int width, int height, chrono::steady_clock::time_point start);
 
 int main( int argc, char* argv[] ){
-	Image *img = NULL;
+	Image img;
 	bool did_output = false;
+	PointOpPipeline pointOps;
+	bool fuse = true;
+	WorkingImage working;
+	LayoutImage layout;
+	int channelLayout = IMAGE_LAYOUT_INTERLEAVED;   // where -layout runs -extractChannel and -quantize
+	Image source;           // owns the pixels while img is a crop of them
+	Image region;           // the image around an open -region
+	int region_x = 0, region_y = 0, region_w = 0, region_h = 0;
 
 	// first argument is program name
 	argv++, argc--;
@@ -53,37 +73,100 @@ int main( int argc, char* argv[] ){
 		ShowUsage();
 	}
 
+	// -stream as the first option runs the rest of the command strip by strip
+	if (!strcmp(*argv, "-stream")) {
+		CheckOption(*argv, argc, 2);
+		int strip_rows = atoi(argv[1]);
+		return RunStreaming(strip_rows, argc - 2, argv + 2);
+	}
+
 	// parse arguments
 	while (argc > 0)
 	{
+		// Queued point ops run in one pass just before the next other option
+		if (!IsPointOp(*argv))
+			pointOps.Apply(&img);
+		// Ops without a wide version round the working image to 8 bits
+		if (!IsWideOp(*argv))
+			working.Narrow(img);
+		// and ops without a planar version need the pixels interleaved
+		if (PreferredLayout(*argv) == IMAGE_LAYOUT_INTERLEAVED)
+			layout.Interleave(img);
+
 		if (**argv == '-')
 		{
 			if (!strcmp(*argv, "-input"))
 			{
 				CheckOption(*argv, argc, 2);
-				if (img != NULL)
-					delete img;
-				img = new Image(argv[1]);
+				working.Load(img, argv[1]);
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-workingFormat"))
+			{
+				int format;
+				CheckOption(*argv, argc, 2);
+				if (!strcmp(argv[1], "u8")) format = WORKING_RGBA8;
+				else if (!strcmp(argv[1], "u16")) format = WORKING_RGBA16;
+				else if (!strcmp(argv[1], "f32")) format = WORKING_FLOAT32;
+				else ShowUsage();
+				working.SetFormat(img, format);
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-layout"))
+			{
+				CheckOption(*argv, argc, 2);
+				if (!strcmp(argv[1], "interleaved")) channelLayout = IMAGE_LAYOUT_INTERLEAVED;
+				else if (!strcmp(argv[1], "planar")) channelLayout = IMAGE_LAYOUT_PLANAR;
+				else ShowUsage();
 				argv += 2, argc -= 2;
 			}
 
 			else if (!strcmp(*argv, "-output"))
 			{
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
-				img->Write(argv[1]);
+				if (img.Empty()) ShowUsage();
+				img.Write(argv[1]);
 				did_output = true;
 				argv += 2, argc -= 2;
 			}
 
+			else if (!strcmp(*argv, "-threads"))
+			{
+				CheckOption(*argv, argc, 2);
+				SetThreadCount(atoi(argv[1]));
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-simd"))
+			{
+				CheckOption(*argv, argc, 2);
+				SetSimdLevel(atoi(argv[1]));
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-seed"))
+			{
+				CheckOption(*argv, argc, 2);
+				SetNoiseSeed((uint32_t) strtoul(argv[1], NULL, 10));
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-noFuse"))
+			{
+				fuse = false;
+				argv++, argc--;
+			}
+
 			else if (!strcmp(*argv, "-noise"))
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->AddNoise(factor);
+				img.AddNoise(factor);
 				argv += 2, argc -= 2;
 			}
 
@@ -91,10 +174,13 @@ int main( int argc, char* argv[] ){
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->Brighten(factor);
+				if (fuse && working.Format() == WORKING_RGBA8)
+					pointOps.Brighten(factor);
+				else
+					working.Apply(img, [&](auto &im) { im.Brighten(factor); });
 				argv += 2, argc -=2;
 			}
 
@@ -102,10 +188,13 @@ int main( int argc, char* argv[] ){
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->ChangeContrast(factor);
+				if (fuse && working.Format() == WORKING_RGBA8)
+					pointOps.ChangeContrast(factor);
+				else
+					working.Apply(img, [&](auto &im) { im.ChangeContrast(factor); });
 				argv += 2, argc -= 2;
 			}
 
@@ -113,10 +202,13 @@ int main( int argc, char* argv[] ){
 			{
 				double factor;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				factor = atof(argv[1]);
-				img->ChangeSaturation(factor);
+				if (fuse && working.Format() == WORKING_RGBA8)
+					pointOps.ChangeSaturation(factor);
+				else
+					working.Apply(img, [&](auto &im) { im.ChangeSaturation(factor); });
 				argv += 2, argc -= 2;
 			}
 
@@ -124,28 +216,85 @@ int main( int argc, char* argv[] ){
 			{
 				int x, y, w, h;
 				CheckOption(*argv, argc, 5);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				x = atoi(argv[1]);
 				y = atoi(argv[2]);
 				w = atoi(argv[3]);
 				h = atoi(argv[4]);
 
-				Image *dst = img->Crop(x, y, w, h);
-				delete img;
-				img = dst;
+				// In a wide format img is out of date, so check the working image
+				if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+				    x > working.Width(img) - w || y > working.Height(img) - h) ShowUsage();
+
+				// An 8-bit crop is a view, copied only if an op needs to own it.
+				// Inside -region, source may hold the region's pixels.
+				if (working.Format() == WORKING_RGBA8 && region.Empty()) {
+					if (!img.Wrapped()) source = std::move(img);
+					img = Image::Wrap((img.Empty() ? source : img).View(x, y, w, h));
+				}
+				else
+					working.Apply(img, [&](auto &im) { im = im.Crop(x, y, w, h); });
 
 				argv += 5, argc -= 5;
 			}
 
+			else if (!strcmp(*argv, "-region"))
+			{
+				int x, y, w, h;
+				CheckOption(*argv, argc, 5);
+				if (img.Empty() || !region.Empty()) ShowUsage();
+
+				x = atoi(argv[1]);
+				y = atoi(argv[2]);
+				w = atoi(argv[3]);
+				h = atoi(argv[4]);
+				if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+				    x > working.Width(img) - w || y > working.Height(img) - h) ShowUsage();
+
+				// The ops up to -endRegion change the rectangle in place
+				region = std::move(img);
+				region_x = x, region_y = y, region_w = w, region_h = h;
+				img = Image::Wrap(region.View(x, y, w, h));
+
+				argv += 5, argc -= 5;
+			}
+
+			else if (!strcmp(*argv, "-endRegion"))
+			{
+				if (region.Empty()) ShowUsage();
+
+				// Ops that return a new image leave it to be pasted back
+				ImageView view = region.View(region_x, region_y, region_w, region_h);
+				if (img.Width() != region_w || img.Height() != region_h) {
+					fprintf(stderr, "image: -endRegion: the region changed size\n");
+					exit(-1);
+				}
+				if (img.Row(0) != view.Row(0)) {
+					for (int y = 0; y < region_h; y++)
+						memcpy(view.Row(y), img.Row(y), region_w * sizeof(Pixel));
+				}
+				img = std::move(region);
+
+				argv += 1, argc -= 1;
+			}
+
 			else if (!strcmp(*argv, "-extractChannel"))
 			{
 				int channel;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				channel = atoi(argv[1]);
-				img->ExtractChannel(channel);
+				if (layout.Layout() == IMAGE_LAYOUT_PLANAR ||
+				    (channelLayout == IMAGE_LAYOUT_PLANAR && working.Format() == WORKING_RGBA8)) {
+					pointOps.Apply(&img);   // ops queued before it come first
+					layout.Planar(img).ExtractChannel(channel);
+				}
+				else if (fuse && working.Format() == WORKING_RGBA8)
+					pointOps.ExtractChannel(channel);
+				else
+					working.Apply(img, [&](auto &im) { im.ExtractChannel(channel); });
 				argv += 2, argc -= 2;
 			}
 
@@ -153,10 +302,18 @@ int main( int argc, char* argv[] ){
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->Quantize(nbits);
+				if (nbits < 1 || nbits > 8) ShowUsage();
+				if (layout.Layout() == IMAGE_LAYOUT_PLANAR || channelLayout == IMAGE_LAYOUT_PLANAR) {
+					pointOps.Apply(&img);   // ops queued before it come first
+					layout.Planar(img).Quantize(nbits);
+				}
+				else if (fuse)
+					pointOps.Quantize(nbits);
+				else
+					img.Quantize(nbits);
 				argv += 2, argc -= 2;
 			}
 
@@ -164,10 +321,11 @@ int main( int argc, char* argv[] ){
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->RandomDither(nbits);
+				if (nbits < 1 || nbits > 8) ShowUsage();
+				img.RandomDither(nbits);
 				argv += 2, argc -= 2;
 			}
 
@@ -175,99 +333,276 @@ int main( int argc, char* argv[] ){
 			{
 				int n;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				n = atoi(argv[1]);
-				img->Blur(n);
+				auto start = chrono::steady_clock::now();
+				working.Apply(img, [&](auto &im) { im.Blur(n); });
+				ReportThroughput("blur", working.Width(img), working.Height(img), start);
+				argv += 2, argc -= 2;
+			}
+
+			else if (!strcmp(*argv, "-blurFast"))
+			{
+				double sigma;
+				CheckOption(*argv, argc, 2);
+				if (img.Empty()) ShowUsage();
+
+				sigma = atof(argv[1]);
+				auto start = chrono::steady_clock::now();
+				working.Apply(img, [&](auto &im) { im.BlurFast(sigma); });
+				ReportThroughput("blurFast", working.Width(img), working.Height(img), start);
+				argv += 2, argc -= 2;
+			}
+			else if (!strcmp(*argv, "-boxFilter"))
+			{
+				int radius;
+				CheckOption(*argv, argc, 2);
+				if (img.Empty()) ShowUsage();
+
+				radius = atoi(argv[1]);
+				img.BoxFilter(radius);
 				argv += 2, argc -= 2;
 			}
+
+			else if (!strcmp(*argv, "-localContrast"))
+			{
+				int radius;
+				double factor;
+				CheckOption(*argv, argc, 3);
+				if (img.Empty()) ShowUsage();
+
+				radius = atoi(argv[1]);
+				factor = atof(argv[2]);
+				img.LocalContrast(radius, factor);
+				argv += 3, argc -= 3;
+			}
+
+			else if (!strcmp(*argv, "-stats"))
+			{
+				if (img.Empty()) ShowUsage();
+
+				ImageStats stats;
+				auto start = chrono::steady_clock::now();
+				ComputeStats(img, &stats);
+				ReportThroughput("stats", img.Width(), img.Height(), start);
+				WriteStatsJSON(stdout, stats);
+				did_output = true;
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-autoLevels"))
+			{
+				double clipPercent = 0.5;
+				if (img.Empty()) ShowUsage();
+				argv++, argc--;
+
+				if (argc > 0 && **argv != '-') {
+					clipPercent = atof(*argv);
+					argv++, argc--;
+				}
+				img.AutoLevels(clipPercent);
+			}
+
+			else if (!strcmp(*argv, "-equalize"))
+			{
+				if (img.Empty()) ShowUsage();
+				img.Equalize();
+				argv++, argc--;
+			}
+
 			else if (!strcmp(*argv, "-sharpen"))
 			{
 				int n;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				n = atoi(argv[1]);
-				img->Sharpen(n);
+				working.Apply(img, [&](auto &im) { im.Sharpen(n); });
 				argv += 2, argc -= 2;
 			}
 
 			else if (!strcmp(*argv, "-edgeDetect"))
 			{
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
+
+				img.EdgeDetect();
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-laplacian"))
+			{
+				if (img.Empty()) ShowUsage();
+				argv++, argc--;
+				img.Laplacian(BorderOption(argc, argv));
+			}
+
+			else if (!strcmp(*argv, "-sobel") || !strcmp(*argv, "-prewitt"))
+			{
+				bool sobel = !strcmp(*argv, "-sobel");
+				if (img.Empty()) ShowUsage();
+				argv++, argc--;
+
+				int output = GradientOption(argc, argv);
+				int border = BorderOption(argc, argv);
+				if (sobel)
+					img.Sobel(output, border);
+				else
+					img.Prewitt(output, border);
+			}
 
-				img->EdgeDetect();
+			else if (!strcmp(*argv, "-emboss"))
+			{
+				if (img.Empty()) ShowUsage();
 				argv++, argc--;
+				img.Emboss(BorderOption(argc, argv));
+			}
+
+			else if (!strcmp(*argv, "-convolve"))
+			{
+				ConvolutionKernel kernel;
+				CheckOption(*argv, argc, 2);
+				if (img.Empty()) ShowUsage();
+				if (!LoadConvolutionKernel(argv[1], &kernel)) exit(-1);
+				argv += 2, argc -= 2;
+
+				Convolve(img, kernel, BorderOption(argc, argv));
 			}
 
 			else if (!strcmp(*argv, "-orderedDither"))
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->OrderedDither(nbits);
+				if (nbits < 1 || nbits > 8) ShowUsage();
 				argv += 2, argc -= 2;
+
+				int matrix = IMAGE_DITHER_BAYER4;
+				if (argc > 0 && **argv != '-') {
+					if (!strcmp(*argv, "bayer4")) matrix = IMAGE_DITHER_BAYER4;
+					else if (!strcmp(*argv, "bayer8")) matrix = IMAGE_DITHER_BAYER8;
+					else if (!strcmp(*argv, "bayer16")) matrix = IMAGE_DITHER_BAYER16;
+					else if (!strcmp(*argv, "blueNoise")) matrix = IMAGE_DITHER_BLUE_NOISE;
+					else ShowUsage();
+					argv++, argc--;
+				}
+				img.OrderedDither(nbits, matrix);
 			}
 
 			else if (!strcmp(*argv, "-FloydSteinbergDither"))
 			{
 				int nbits;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				nbits = atoi(argv[1]);
-				img->FloydSteinbergDither(nbits);
+				if (nbits < 1 || nbits > 8) ShowUsage();
 				argv += 2, argc -= 2;
+
+				img.FloydSteinbergDither(nbits, DitherScanOption(argc, argv));
+			}
+
+			else if (!strcmp(*argv, "-diffusionDither"))
+			{
+				static const char *kernels[IMAGE_N_DIFFUSION_KERNELS] = {
+					"floydSteinberg", "atkinson", "stucki", "jarvis", "sierra"
+				};
+				CheckOption(*argv, argc, 3);
+				if (img.Empty()) ShowUsage();
+
+				int nbits = atoi(argv[1]);
+				if (nbits < 1 || nbits > 8) ShowUsage();
+				int kernel = 0;
+				while (kernel < IMAGE_N_DIFFUSION_KERNELS && strcmp(argv[2], kernels[kernel])) kernel++;
+				if (kernel == IMAGE_N_DIFFUSION_KERNELS) ShowUsage();
+				argv += 3, argc -= 3;
+
+				img.DiffusionDither(nbits, kernel, DitherScanOption(argc, argv));
 			}
 
 			else if (!strcmp(*argv, "-scale"))
 			{
 				CheckOption(*argv, argc, 3);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				double sx = atof(argv[1]);
 				double sy = atof(argv[2]);
 
-				Image *dst = img->Scale(sx, sy);
-				delete img;
-
-				img = dst;
+				img = img.Scale(sx, sy);
 				argv += 3, argc -= 3;
 			}
 
 			else if (!strcmp(*argv, "-rotate"))
 			{
 				double angle;
-				Image *dst;
 				CheckOption(*argv, argc, 2);
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				angle = atof(argv[1]);
-				dst = img->Rotate(angle);
-				delete img;
-				img = dst;
-				dst = NULL;
+				img = img.Rotate(angle);
 				argv += 2, argc -= 2;
 			}
 
+			else if (!strcmp(*argv, "-rotate90"))
+			{
+				if (img.Empty()) ShowUsage();
+				img = img.Rotate90();
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-rotate180"))
+			{
+				if (img.Empty()) ShowUsage();
+				img = img.Rotate180();
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-rotate270"))
+			{
+				if (img.Empty()) ShowUsage();
+				img = img.Rotate270();
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-transpose"))
+			{
+				if (img.Empty()) ShowUsage();
+				img = img.Transpose();
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-flipH"))
+			{
+				if (img.Empty()) ShowUsage();
+				img.FlipHorizontal();
+				argv++, argc--;
+			}
+
+			else if (!strcmp(*argv, "-flipV"))
+			{
+				if (img.Empty()) ShowUsage();
+				img.FlipVertical();
+				argv++, argc--;
+			}
+
 			else if (!strcmp(*argv, "-fun"))
 			{
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
-				img->Fun();
+				img.Fun();
 				argv++, argc--;
 			}
 
 			else if (!strcmp(*argv, "-sampling"))
 			{
-				if (img == NULL) ShowUsage();
+				if (img.Empty()) ShowUsage();
 
 				int method;
 				CheckOption(*argv, argc, 2);
 				method = atoi(argv[1]);
-				img->SetSamplingMethod(method);
+				img.SetSamplingMethod(method);
 				argv += 2, argc -= 2;
 			}
 
@@ -289,7 +624,152 @@ int main( int argc, char* argv[] ){
 		fprintf( stderr, "Warning, you didn't tell me to output anything.  I hope that's OK.\n" );
 	}
 
-	delete img;
+	return EXIT_SUCCESS;
+}
+
+
+/**
+ * RunStreaming
+ *
+ * Parses the options after -stream.  Only operations that keep the image
+ * size and read a bounded number of neighboring rows are available.
+ **/
+static int RunStreaming(int strip_rows, int argc, char *argv[])
+{
+	StripPipeline pipeline;
+	char *input = NULL;
+	bool did_output = false;
+
+	while (argc > 0)
+	{
+		if (!strcmp(*argv, "-input"))
+		{
+			CheckOption(*argv, argc, 2);
+			input = argv[1];
+			pipeline = StripPipeline();
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-output"))
+		{
+			CheckOption(*argv, argc, 2);
+			if (input == NULL) ShowUsage();
+			auto start = chrono::steady_clock::now();
+			if (!pipeline.Run(input, argv[1], strip_rows))
+				exit(EXIT_FAILURE);
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			fprintf(stderr, "stream: %s -> %s in %.3f s\n", input, argv[1], seconds);
+			did_output = true;
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-threads"))
+		{
+			CheckOption(*argv, argc, 2);
+			SetThreadCount(atoi(argv[1]));
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-simd"))
+		{
+			CheckOption(*argv, argc, 2);
+			SetSimdLevel(atoi(argv[1]));
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-brightness"))
+		{
+			CheckOption(*argv, argc, 2);
+			double factor = atof(argv[1]);
+			pipeline.Add(0, [=](Image *img) { img->Brighten(factor); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-saturation"))
+		{
+			CheckOption(*argv, argc, 2);
+			double factor = atof(argv[1]);
+			pipeline.Add(0, [=](Image *img) { img->ChangeSaturation(factor); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-extractChannel"))
+		{
+			CheckOption(*argv, argc, 2);
+			int channel = atoi(argv[1]);
+			pipeline.Add(0, [=](Image *img) { img->ExtractChannel(channel); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-quantize"))
+		{
+			CheckOption(*argv, argc, 2);
+			int nbits = atoi(argv[1]);
+			if (nbits < 1 || nbits > 8) ShowUsage();
+			pipeline.Add(0, [=](Image *img) { img->Quantize(nbits); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-blur"))
+		{
+			CheckOption(*argv, argc, 2);
+			int n = atoi(argv[1]);
+			pipeline.Add(n > 0 ? 3*n : 0, [=](Image *img) { img->Blur(n); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-blurFast"))
+		{
+			CheckOption(*argv, argc, 2);
+			double sigma = atof(argv[1]);
+			// The three boxes together reach at most 3 sigma + 3 rows
+			pipeline.Add(sigma > 0 ? (int) ceil(3*sigma) + 3 : 0, [=](Image *img) { img->BlurFast(sigma); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-boxFilter"))
+		{
+			CheckOption(*argv, argc, 2);
+			int radius = atoi(argv[1]);
+			pipeline.Add(radius > 0 ? radius : 0, [=](Image *img) { img->BoxFilter(radius); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-localContrast"))
+		{
+			CheckOption(*argv, argc, 3);
+			int radius = atoi(argv[1]);
+			double factor = atof(argv[2]);
+			pipeline.Add(radius > 0 ? radius : 0, [=](Image *img) { img->LocalContrast(radius, factor); });
+			argv += 3, argc -= 3;
+		}
+
+		else if (!strcmp(*argv, "-sharpen"))
+		{
+			CheckOption(*argv, argc, 2);
+			int n = atoi(argv[1]);
+			pipeline.Add(n > 0 ? 3*n + 3 : 0, [=](Image *img) { img->Sharpen(n); });
+			argv += 2, argc -= 2;
+		}
+
+		else if (!strcmp(*argv, "-edgeDetect"))
+		{
+			pipeline.Add(1, [](Image *img) { img->EdgeDetect(); });
+			argv++, argc--;
+		}
+
+		else
+		{
+			fprintf(stderr, "image: %s is not available with -stream\n", *argv);
+			ShowUsage();
+		}
+	}
+
+	if (!did_output)
+	{
+		fprintf( stderr, "Warning, you didn't tell me to output anything.  I hope that's OK.\n" );
+	}
+
 	return EXIT_SUCCESS;
 }
 
@@ -299,6 +779,7 @@ int main( int argc, char* argv[] ){
  **/
 static char options[] =
 "-help\n"
+"-stream <rows> (first option only; processes PPM/PAM/BMP/uncompressed TGA/.rgba files in strips of <rows> rows)\n"
 "-input <file>\n"
 "-output <file>\n"
 "-noise <factor>\n"
@@ -306,18 +787,41 @@ static char options[] =
 "-contrast <factor>\n"
 "-saturation <factor>\n"
 "-crop <x> <y> <width> <height>\n"
+"-region <x> <y> <width> <height> ... -endRegion (runs the options between on the rectangle in place)\n"
 "-extractChannel <channel no>\n"
 "-quantize <nbits>\n"
 "-randomDither <nbits>\n"
 "-blur <maskSize>\n"
+"-blurFast <sigma>\n"
+"-boxFilter <radius>\n"
+"-localContrast <radius> <factor> (contrast around the mean of the surrounding box)\n"
+"-stats (prints per-channel statistics and histograms as JSON to stdout)\n"
+"-autoLevels [clipPercent] (stretches each channel, clipping clipPercent at each end; default 0.5)\n"
+"-equalize (histogram equalization of the luminance)\n"
 "-sharpen <maskSize>\n"
 "-edgeDetect\n"
-"-orderedDither <nbits>\n"
-"-FloydSteinbergDither <nbits>\n"
+"-laplacian, -emboss [mirror|clamp|wrap] (how pixels past the edges are read; default mirror)\n"
+"-sobel, -prewitt [magnitude|direction] [mirror|clamp|wrap]\n"
+"-convolve <kernel file> [mirror|clamp|wrap] (odd width and height up to 7, the weights, then optionally\n"
+"    a divisor and a bias; see convolve.h)\n"
+"-orderedDither <nbits> [bayer4|bayer8|bayer16|blueNoise]\n"
+"-FloydSteinbergDither <nbits> [serpentine|raster] (raster runs on all threads)\n"
+"-diffusionDither <nbits> <floydSteinberg|atkinson|stucki|jarvis|sierra> [serpentine|raster]\n"
 "-scale <sx> <sy>\n"
-"-rotate <angle>\n"
+"-rotate <angle> (multiples of pi/2 are exact quarter turns)\n"
+"-rotate90, -rotate180, -rotate270 (clockwise)\n"
+"-flipH, -flipV, -transpose\n"
 "-fun\n"
-"-sampling <method no>\n"
+"-sampling <method no> (0 point, 1 bilinear, 2 gaussian, 3 box, 4 triangle, 5 mitchell, 6 lanczos3, 7 trilinear)\n"
+"-workingFormat <u8|u16|f32> (runs -brightness, -contrast, -saturation, -extractChannel, -crop, -blur,\n"
+"    -blurFast and -sharpen in 8-bit, 16-bit or float pixels, rounding to 8 bits once for any other\n"
+"    option or the output; given before -input, 16-bit PNGs load with all 16 bits)\n"
+"-layout <interleaved|planar> (runs -extractChannel and -quantize on interleaved pixels or on one plane\n"
+"    per channel, converting once around a run of them; 8-bit pixels only; default interleaved)\n"
+"-threads <count> (0 = all hardware threads)\n"
+"-noFuse (apply point ops one pass at a time)\n"
+"-seed <n> (seed for -noise and -randomDither; default 1)\n"
+"-simd <level> (0 = scalar, 1 = SSE2, 2 = AVX2; default best available)\n"
 ;
 
 static void ShowUsage(void)
@@ -329,6 +833,49 @@ static void ShowUsage(void)
 
 
 
+/**
+ * IsPointOp
+ **/
+static bool IsPointOp(const char *option)
+{
+	return !strcmp(option, "-brightness") || !strcmp(option, "-contrast") ||
+	       !strcmp(option, "-saturation") || !strcmp(option, "-extractChannel") ||
+	       !strcmp(option, "-quantize");
+}
+
+
+/**
+ * IsWideOp
+ **/
+// Options that run in a wide working format, or change no pixels
+static bool IsWideOp(const char *option)
+{
+	static const char *wideOps[] = {
+		"-brightness", "-contrast", "-saturation", "-extractChannel", "-crop", "-blur", "-blurFast", "-sharpen",
+		"-workingFormat", "-layout", "-threads", "-simd", "-seed", "-noFuse"
+	};
+	for (const char *op : wideOps)
+		if (!strcmp(option, op)) return true;
+	return false;
+}
+
+
+/**
+ * PreferredLayout
+ **/
+// The layout an option runs in.  Options with a planar version run in
+// whichever layout is current, or the one -layout asks for, and return -1.
+static int PreferredLayout(const char *option)
+{
+	static const char *either[] = {
+		"-extractChannel", "-quantize", "-threads", "-simd", "-seed", "-noFuse"
+	};
+	for (const char *op : either)
+		if (!strcmp(option, op)) return -1;
+	return IMAGE_LAYOUT_INTERLEAVED;
+}
+
+
 /**
  * CheckOption
  **/
@@ -339,4 +886,66 @@ static void CheckOption(char *option, int argc, int minargc)
 		fprintf(stderr, "Too few arguments for %s\n", option);
 		ShowUsage();
 	}
-}
\ No newline at end of file
+}
+
+
+/**
+ * DitherScanOption
+ **/
+// Consumes the optional [serpentine|raster] after an error-diffusion option
+static int DitherScanOption(int &argc, char **&argv)
+{
+	int scan = IMAGE_DITHER_SERPENTINE;
+	if (argc > 0 && **argv != '-') {
+		if (!strcmp(*argv, "serpentine")) scan = IMAGE_DITHER_SERPENTINE;
+		else if (!strcmp(*argv, "raster")) scan = IMAGE_DITHER_RASTER;
+		else ShowUsage();
+		argv++, argc--;
+	}
+	return scan;
+}
+
+
+/**
+ * GradientOption
+ **/
+// Consumes the optional [magnitude|direction] after -sobel or -prewitt
+static int GradientOption(int &argc, char **&argv)
+{
+	int output = IMAGE_GRADIENT_MAGNITUDE;
+	if (argc > 0 && !strcmp(*argv, "magnitude")) output = IMAGE_GRADIENT_MAGNITUDE;
+	else if (argc > 0 && !strcmp(*argv, "direction")) output = IMAGE_GRADIENT_DIRECTION;
+	else return output;
+	argv++, argc--;
+	return output;
+}
+
+
+/**
+ * BorderOption
+ **/
+// Consumes the optional [mirror|clamp|wrap] after a convolution
+static int BorderOption(int &argc, char **&argv)
+{
+	int border = IMAGE_BORDER_MIRROR;
+	if (argc > 0 && **argv != '-') {
+		if (!strcmp(*argv, "mirror")) border = IMAGE_BORDER_MIRROR;
+		else if (!strcmp(*argv, "clamp")) border = IMAGE_BORDER_CLAMP;
+		else if (!strcmp(*argv, "wrap")) border = IMAGE_BORDER_WRAP;
+		else ShowUsage();
+		argv++, argc--;
+	}
+	return border;
+}
+
+
+/**
+ * ReportThroughput
+ **/
+static void ReportThroughput(const char *op, int width, int height, chrono::steady_clock::time_point start)
+{
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	double mpix = (double) width * height / 1e6;
+	fprintf(stderr, "%s: %dx%d in %.3f s (%.1f MPix/s)\n",
+		op, width, height, seconds, seconds > 0 ? mpix / seconds : 0.0);
+}
@@ -0,0 +1,34 @@
+#include "noise.h"
+#include <atomic>
+
+static std::atomic<uint32_t> noise_seed(1);
+static std::atomic<uint32_t> noise_stream(0);
+static std::atomic<uint32_t> noise_draw(0);
+
+void SetNoiseSeed (uint32_t seed)
+{
+	noise_seed = seed;
+	noise_stream = 0;
+	noise_draw = 0;
+}
+
+uint32_t NoiseSeed ()
+{
+	return noise_seed;
+}
+
+uint32_t NextNoiseStream ()
+{
+	return NoiseStreamKey(noise_seed, noise_stream++);
+}
+
+// Single draws use the last stream of the seed, which operations never reach
+uint32_t NextNoiseValue ()
+{
+	return NoiseValue(NoiseStreamKey(noise_seed, UINT32_MAX), (int) noise_draw++);
+}
+
+uint32_t NoiseStreamKey (uint32_t seed, uint32_t n)
+{
+	return NoiseHash(NoiseHash(seed) + NoiseHash(n ^ 0x5bd1e995U));
+}
@@ -0,0 +1,62 @@
+//noise.h
+//
+//Seedable, thread-safe random numbers for the noise and dither operations.
+//
+//The generator is counter based: the random pixel at column x of row y is
+//a hash of (x, y, stream key), so any band of rows can be generated on any
+//thread, in any order, and comes out the same.  Each operation that uses
+//noise takes the next stream of the current seed, so running the same
+//command line with the same -seed reproduces its output exactly, on every
+//platform and for any thread count.
+
+#ifndef NOISE_INCLUDED
+#define NOISE_INCLUDED
+
+#include <stdint.h>
+
+// Chris Wellons' "lowbias32" integer hash, a bijection on 32 bits
+inline uint32_t NoiseHash (uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// Multiplier that spreads column numbers over the hash input
+#define NOISE_COLUMN_MULT 0x9e3779b9U
+
+// Random 32 bits for column x of the row with the given key.  Row keys come
+// from NoiseRowKey.
+inline uint32_t NoiseValue (uint32_t row_key, int x)
+{
+    return NoiseHash(((uint32_t) x * NOISE_COLUMN_MULT) ^ row_key);
+}
+
+// Sets the seed and restarts its streams.  The default seed is 1.
+void SetNoiseSeed(uint32_t seed);
+
+// Returns the current seed.
+uint32_t NoiseSeed();
+
+// Returns the key of the next stream of the current seed.
+uint32_t NextNoiseStream();
+
+// Returns the next 32 bits of a sequence of single draws, shared by all
+// threads (for ComponentRandom and PixelRandom).  Restarts with the seed.
+uint32_t NextNoiseValue();
+
+// Returns the key of stream number n of the given seed (streams are
+// numbered from 0 after each SetNoiseSeed).
+uint32_t NoiseStreamKey(uint32_t seed, uint32_t n);
+
+// Returns the key of row y of a stream.  Different rows of a stream get
+// different keys.
+inline uint32_t NoiseRowKey (uint32_t stream_key, int y)
+{
+    return NoiseHash((uint32_t) y + stream_key);
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "parallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Pool state
+ **/
+static int thread_count = 0;   // 0 until first use, then >= 1
+static std::vector<std::thread> workers;
+static std::mutex pool_mutex;
+static std::condition_variable work_ready, work_done;
+static unsigned generation = 0;
+static bool stopping = false;
+static int active = 0;
+
+// The job currently being run
+static const std::function<void(int, int)> *job = NULL;
+static int job_count, job_grain;
+static std::atomic<int> next_band;
+
+// Set while a thread is executing bands, so nested calls stay serial
+static thread_local bool in_parallel = false;
+
+static void RunBands()
+{
+	in_parallel = true;
+	for (;;) {
+		int begin = next_band.fetch_add(job_grain);
+		if (begin >= job_count) break;
+		int end = (begin + job_grain < job_count) ? begin + job_grain : job_count;
+		(*job)(begin, end);
+	}
+	in_parallel = false;
+}
+
+// seen is the generation current when the worker was started, so a worker
+// started after some jobs have run does not take the last one for new work
+static void WorkerLoop(unsigned seen)
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(pool_mutex);
+			work_ready.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+		}
+		RunBands();
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		if (--active == 0) work_done.notify_one();
+	}
+}
+
+static void StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		stopping = true;
+	}
+	work_ready.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+	workers.clear();
+	stopping = false;
+}
+
+// Joins the workers when the program exits
+static struct PoolShutdown { ~PoolShutdown() { StopWorkers(); } } pool_shutdown;
+
+void SetThreadCount(int n)
+{
+	if (n <= 0) n = (int) std::thread::hardware_concurrency();
+	if (n <= 0) n = 1;
+	if (n == thread_count) return;
+
+	StopWorkers();
+	thread_count = n;
+	for (int i = 1; i < n; i++) workers.push_back(std::thread(WorkerLoop, generation));
+}
+
+int ThreadCount()
+{
+	if (thread_count == 0) SetThreadCount(0);
+	return thread_count;
+}
+
+void ParallelFor(int count, const std::function<void(int, int)>& fn)
+{
+	if (count <= 0) return;
+	int threads = ThreadCount();
+	if (threads == 1 || count == 1 || in_parallel) {
+		fn(0, count);
+		return;
+	}
+
+	// A few bands per thread evens out rows of uneven cost
+	int grain = (count + threads*4 - 1) / (threads*4);
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		job = &fn;
+		job_count = count;
+		job_grain = grain;
+		next_band = 0;
+		active = (int) workers.size();
+		generation++;
+	}
+	work_ready.notify_all();
+	RunBands();
+
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	work_done.wait(lock, [] { return active == 0; });
+	job = NULL;
+}
@@ -0,0 +1,27 @@
+//parallel.h
+//
+//Persistent worker pool that splits image operations into bands of rows.
+//
+//Work is handed out as contiguous [begin, end) ranges.  Every element is
+//computed by the same code no matter which band or thread it lands in, so
+//results are bit-identical for any thread count as long as the callback
+//does not carry state from one element to the next.
+
+#ifndef PARALLEL_INCLUDED
+#define PARALLEL_INCLUDED
+
+#include <functional>
+
+// Sets the number of threads used by ParallelFor (the calling thread counts
+// as one).  n <= 0 selects the number of hardware threads.
+void SetThreadCount(int n);
+
+// Returns the number of threads ParallelFor will use.
+int ThreadCount();
+
+// Calls fn(begin, end) over disjoint bands covering [0, count) and returns
+// once all of them are done.  Bands run on the pool and the calling thread.
+// Nested calls from inside a band run serially on the current thread.
+void ParallelFor(int count, const std::function<void(int, int)>& fn);
+
+#endif
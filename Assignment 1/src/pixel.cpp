@@ -1,4 +1,5 @@
 #include "pixel.h"
+#include "noise.h"
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
@@ -10,7 +11,7 @@
  **/
 Component ComponentRandom(void)
 {
-    return rand() % 256;
+    return NextNoiseValue() >> 24;
 }
 
 
@@ -26,6 +27,18 @@ Component ComponentLerp(Component c, Component d, double t)
 }
 
 
+Component ComponentQuantize(Component c, double step)
+{
+    return ComponentClamp((int) (step * (int) floor((double) c/step + 0.5)));
+}
+
+
+Component ComponentContrast(Component c, double gray, double f)
+{
+    return ComponentClamp((int) (c + (c - gray)*f));
+}
+
+
 
 /**
  * Pixel
@@ -29,6 +29,12 @@ Component ComponentScale(Component c, double f);
 // Returns (1 - t) * c + t * d
 Component ComponentLerp(Component c, Component d, double t);
 
+// Rounds the component to the nearest multiple of step
+Component ComponentQuantize(Component c, double step);
+
+// Pushes the component away from a gray level.  Returns c + (c - gray) * f
+Component ComponentContrast(Component c, double gray, double f);
+
 
 
 /**
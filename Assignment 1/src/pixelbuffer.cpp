@@ -0,0 +1,104 @@
+#include "pixelbuffer.h"
+#include "rawimage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+
+static uint8_t* AllocAligned (size_t size)
+{
+	void *p = NULL;
+#ifdef _WIN32
+	p = _aligned_malloc(size, PIXEL_BUFFER_ALIGNMENT);
+#else
+	if (posix_memalign(&p, PIXEL_BUFFER_ALIGNMENT, size) != 0) p = NULL;
+#endif
+	if (p == NULL) {
+		fprintf(stderr, "Out of memory allocating %zu bytes of pixels\n", size);
+		exit(-1);
+	}
+	return (uint8_t *) p;
+}
+
+static void FreeAligned (uint8_t *p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+PixelBuffer::PixelBuffer (size_t size_) : PixelBuffer()
+{
+	if (size_ == 0) return;
+	bytes = AllocAligned(size_);
+	size = size_;
+	memset(bytes, 0, size);
+}
+
+PixelBuffer::PixelBuffer (const PixelBuffer& src) : PixelBuffer()
+{
+	if (src.size == 0) return;
+	bytes = AllocAligned(src.size);
+	size = src.size;
+	memcpy(bytes, src.bytes, size);
+}
+
+PixelBuffer::PixelBuffer (PixelBuffer&& src) : PixelBuffer()
+{
+	Swap(src);
+}
+
+PixelBuffer& PixelBuffer::operator= (const PixelBuffer& src)
+{
+	if (this != &src) {
+		PixelBuffer copy(src);
+		Swap(copy);
+	}
+	return *this;
+}
+
+PixelBuffer& PixelBuffer::operator= (PixelBuffer&& src)
+{
+	if (this != &src) {
+		Release();
+		Swap(src);
+	}
+	return *this;
+}
+
+PixelBuffer::~PixelBuffer ()
+{
+	Release();
+}
+
+PixelBuffer PixelBuffer::FromMapping (uint8_t *bytes, size_t size, void *mapping, size_t mapping_size)
+{
+	PixelBuffer b;
+	b.bytes = bytes;
+	b.size = size;
+	b.mapping = mapping;
+	b.mapping_size = mapping_size;
+	return b;
+}
+
+void PixelBuffer::Swap (PixelBuffer& other)
+{
+	std::swap(bytes, other.bytes);
+	std::swap(size, other.size);
+	std::swap(mapping, other.mapping);
+	std::swap(mapping_size, other.mapping_size);
+}
+
+void PixelBuffer::Release ()
+{
+	if (mapping != NULL)
+		UnmapRawImage(mapping, mapping_size);
+	else if (bytes != NULL)
+		FreeAligned(bytes);
+	bytes = NULL;
+	size = 0;
+	mapping = NULL;
+	mapping_size = 0;
+}
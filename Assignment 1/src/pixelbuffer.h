@@ -0,0 +1,50 @@
+//pixelbuffer.h
+//
+//Owning storage for an image's pixels.
+//
+//The bytes are either a 64-byte aligned heap block or a memory-mapped .rgba
+//file (see rawimage.h), whose pixels start on a page boundary, so the first
+//pixel always starts a cache line.  Copies duplicate the bytes into a new
+//heap block; moves just hand the storage over.
+
+#ifndef PIXELBUFFER_INCLUDED
+#define PIXELBUFFER_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PIXEL_BUFFER_ALIGNMENT 64
+
+class PixelBuffer
+{
+public:
+    // An empty buffer
+    PixelBuffer () : bytes(NULL), size(0), mapping(NULL), mapping_size(0) {}
+
+    // size zeroed bytes on the heap
+    explicit PixelBuffer (size_t size);
+
+    PixelBuffer (const PixelBuffer& src);
+    PixelBuffer (PixelBuffer&& src);
+    PixelBuffer& operator= (const PixelBuffer& src);
+    PixelBuffer& operator= (PixelBuffer&& src);
+    ~PixelBuffer ();
+
+    // Takes over a mapping made by MapRawImage; bytes points into it.
+    static PixelBuffer FromMapping (uint8_t *bytes, size_t size, void *mapping, size_t mapping_size);
+
+    uint8_t* Bytes () const { return bytes; }
+    size_t   Size  () const { return size; }
+
+    void Swap (PixelBuffer& other);
+
+private:
+    void Release ();
+
+    uint8_t *bytes;
+    size_t size;
+    void *mapping;         // non-NULL when bytes lives in a mapped file
+    size_t mapping_size;
+};
+
+#endif
@@ -0,0 +1,415 @@
+#include "pixelrow.h"
+#include "noise.h"
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define PIXELROW_X86 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXELROW_X86 0
+#endif
+
+
+/**
+ * Scalar kernels (reference behaviour)
+ **/
+static void RowScaleScalar(Pixel *row, int n, double f)
+{
+	for (int i = 0; i < n; i++) row[i] = row[i] * f;
+}
+
+static void RowLerpScalar(Pixel *row, const Pixel *q, int n, double t)
+{
+	for (int i = 0; i < n; i++) row[i] = PixelLerp(row[i], q[i], t);
+}
+
+static void RowAddScalar(Pixel *row, const Pixel *q, int n)
+{
+	for (int i = 0; i < n; i++) row[i] = row[i] + q[i];
+}
+
+static void RowContrastScalar(Pixel *row, int n, double gray, double f)
+{
+	for (int i = 0; i < n; i++) {
+		Pixel &p = row[i];
+		p.r = ComponentContrast(p.r, gray, f);
+		p.g = ComponentContrast(p.g, gray, f);
+		p.b = ComponentContrast(p.b, gray, f);
+	}
+}
+
+static void RowSaturateScalar(Pixel *row, int n, double f)
+{
+	for (int i = 0; i < n; i++) {
+		Pixel &p = row[i];
+		Component luminance = p.Luminance();
+		p.r = ComponentContrast(p.r, luminance, f);
+		p.g = ComponentContrast(p.g, luminance, f);
+		p.b = ComponentContrast(p.b, luminance, f);
+	}
+}
+
+static void RowRandomScalar(Pixel *row, int n, int x0, uint32_t row_key)
+{
+	for (int i = 0; i < n; i++) {
+		uint32_t h = NoiseValue(row_key, x0 + i);
+		row[i].Set(h & 255, (h >> 8) & 255, (h >> 16) & 255, h >> 24);
+	}
+}
+
+
+#if PIXELROW_X86
+
+// Clamps the int32 lanes of four pixels to [0..255] and stores them,
+// matching ComponentClamp for every int (INT_MIN included).
+static inline void StorePixels(Pixel *dst, __m128i a, __m128i b, __m128i c, __m128i d)
+{
+	__m128i v = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+	_mm_storeu_si128((__m128i *) dst, v);
+}
+
+/**
+ * SSE2 kernels: a pixel is two __m128d, (r, g) and (b, a)
+ **/
+static inline void LoadPixelSSE2(const Pixel *p, __m128d &lo, __m128d &hi)
+{
+	int bits;
+	memcpy(&bits, p, 4);
+	__m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero);
+	lo = _mm_cvtepi32_pd(v);
+	hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+static inline __m128i TruncSSE2(__m128d lo, __m128d hi)
+{
+	return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+// floor() for values in int range; anything outside ends up as INT_MIN
+// after truncation, exactly as (int) floor(x) does.
+static inline __m128d FloorSSE2(__m128d x)
+{
+	__m128d t = _mm_cvtepi32_pd(_mm_cvttpd_epi32(x));
+	return _mm_sub_pd(t, _mm_and_pd(_mm_cmpgt_pd(t, x), _mm_set1_pd(1.0)));
+}
+
+static void RowScaleSSE2(Pixel *row, int n, double f)
+{
+	const __m128d vf = _mm_set1_pd(f), half = _mm_set1_pd(0.5);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) {
+			__m128d lo, hi;
+			LoadPixelSSE2(row + i + k, lo, hi);
+			lo = FloorSSE2(_mm_add_pd(_mm_mul_pd(lo, vf), half));
+			hi = FloorSSE2(_mm_add_pd(_mm_mul_pd(hi, vf), half));
+			out[k] = TruncSSE2(lo, hi);
+		}
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowScaleScalar(row + i, n - i, f);
+}
+
+static void RowLerpSSE2(Pixel *row, const Pixel *q, int n, double t)
+{
+	const __m128d vs = _mm_set1_pd(1.0 - t), vt = _mm_set1_pd(t), half = _mm_set1_pd(0.5);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) {
+			__m128d plo, phi, qlo, qhi;
+			LoadPixelSSE2(row + i + k, plo, phi);
+			LoadPixelSSE2(q + i + k, qlo, qhi);
+			plo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vs, plo), _mm_mul_pd(vt, qlo)), half);
+			phi = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vs, phi), _mm_mul_pd(vt, qhi)), half);
+			out[k] = TruncSSE2(FloorSSE2(plo), FloorSSE2(phi));
+		}
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowLerpScalar(row + i, q + i, n - i, t);
+}
+
+static void RowAddSSE2(Pixel *row, const Pixel *q, int n)
+{
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (row + i));
+		__m128i b = _mm_loadu_si128((const __m128i *) (q + i));
+		_mm_storeu_si128((__m128i *) (row + i), _mm_adds_epu8(a, b));
+	}
+	RowAddScalar(row + i, q + i, n - i);
+}
+
+// c + (c - gray) * f on (r, g) and b; a passes through
+static inline __m128i ContrastSSE2(const Pixel *p, __m128d gray, __m128d f)
+{
+	__m128d lo, hi;
+	LoadPixelSSE2(p, lo, hi);
+	__m128d rlo = _mm_add_pd(lo, _mm_mul_pd(_mm_sub_pd(lo, gray), f));
+	__m128d rhi = _mm_add_pd(hi, _mm_mul_pd(_mm_sub_pd(hi, gray), f));
+	return TruncSSE2(rlo, _mm_shuffle_pd(rhi, hi, 2));
+}
+
+static void RowContrastSSE2(Pixel *row, int n, double gray, double f)
+{
+	const __m128d vg = _mm_set1_pd(gray), vf = _mm_set1_pd(f);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) out[k] = ContrastSSE2(row + i + k, vg, vf);
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowContrastScalar(row + i, n - i, gray, f);
+}
+
+static void RowSaturateSSE2(Pixel *row, int n, double f)
+{
+	const __m128d vf = _mm_set1_pd(f);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) {
+			__m128d vg = _mm_set1_pd(row[i + k].Luminance());
+			out[k] = ContrastSSE2(row + i + k, vg, vf);
+		}
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowSaturateScalar(row + i, n - i, f);
+}
+
+// 32-bit multiply, keeping the low halves (pmulld is SSE4.1)
+static inline __m128i MulLo32SSE2(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+	                          _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// NoiseHash on four lanes.  Each lane stores as one pixel, low byte in r.
+static inline __m128i NoiseHashSSE2(__m128i x)
+{
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	x = MulLo32SSE2(x, _mm_set1_epi32((int) 0x7feb352dU));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+	x = MulLo32SSE2(x, _mm_set1_epi32((int) 0x846ca68bU));
+	return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+}
+
+static void RowRandomSSE2(Pixel *row, int n, int x0, uint32_t row_key)
+{
+	const __m128i key = _mm_set1_epi32((int) row_key);
+	const __m128i step = _mm_set1_epi32((int) (4 * NOISE_COLUMN_MULT));
+	uint32_t c = (uint32_t) x0 * NOISE_COLUMN_MULT;
+	__m128i col = _mm_setr_epi32((int) c, (int) (c + NOISE_COLUMN_MULT),
+	                             (int) (c + 2*NOISE_COLUMN_MULT), (int) (c + 3*NOISE_COLUMN_MULT));
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_si128((__m128i *) (row + i), NoiseHashSSE2(_mm_xor_si128(col, key)));
+		col = _mm_add_epi32(col, step);
+	}
+	RowRandomScalar(row + i, n - i, x0 + i, row_key);
+}
+
+/**
+ * AVX2 kernels: a pixel is one __m256d, (r, g, b, a)
+ **/
+static inline TARGET_AVX2 __m256d LoadPixelAVX2(const Pixel *p)
+{
+	int bits;
+	memcpy(&bits, p, 4);
+	return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bits)));
+}
+
+static TARGET_AVX2 void RowScaleAVX2(Pixel *row, int n, double f)
+{
+	const __m256d vf = _mm256_set1_pd(f), half = _mm256_set1_pd(0.5);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) {
+			__m256d c = LoadPixelAVX2(row + i + k);
+			out[k] = _mm256_cvttpd_epi32(_mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(c, vf), half)));
+		}
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowScaleScalar(row + i, n - i, f);
+}
+
+static TARGET_AVX2 void RowLerpAVX2(Pixel *row, const Pixel *q, int n, double t)
+{
+	const __m256d vs = _mm256_set1_pd(1.0 - t), vt = _mm256_set1_pd(t), half = _mm256_set1_pd(0.5);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) {
+			__m256d p = LoadPixelAVX2(row + i + k);
+			__m256d d = LoadPixelAVX2(q + i + k);
+			__m256d v = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vs, p), _mm256_mul_pd(vt, d)), half);
+			out[k] = _mm256_cvttpd_epi32(_mm256_floor_pd(v));
+		}
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowLerpScalar(row + i, q + i, n - i, t);
+}
+
+static TARGET_AVX2 void RowAddAVX2(Pixel *row, const Pixel *q, int n)
+{
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *) (row + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *) (q + i));
+		_mm256_storeu_si256((__m256i *) (row + i), _mm256_adds_epu8(a, b));
+	}
+	RowAddScalar(row + i, q + i, n - i);
+}
+
+static inline TARGET_AVX2 __m128i ContrastAVX2(const Pixel *p, __m256d gray, __m256d f)
+{
+	__m256d c = LoadPixelAVX2(p);
+	__m256d v = _mm256_add_pd(c, _mm256_mul_pd(_mm256_sub_pd(c, gray), f));
+	return _mm256_cvttpd_epi32(_mm256_blend_pd(v, c, 8));
+}
+
+static TARGET_AVX2 void RowContrastAVX2(Pixel *row, int n, double gray, double f)
+{
+	const __m256d vg = _mm256_set1_pd(gray), vf = _mm256_set1_pd(f);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) out[k] = ContrastAVX2(row + i + k, vg, vf);
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowContrastScalar(row + i, n - i, gray, f);
+}
+
+static TARGET_AVX2 void RowSaturateAVX2(Pixel *row, int n, double f)
+{
+	const __m256d vf = _mm256_set1_pd(f);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i out[4];
+		for (int k = 0; k < 4; k++) {
+			__m256d vg = _mm256_set1_pd(row[i + k].Luminance());
+			out[k] = ContrastAVX2(row + i + k, vg, vf);
+		}
+		StorePixels(row + i, out[0], out[1], out[2], out[3]);
+	}
+	RowSaturateScalar(row + i, n - i, f);
+}
+
+static inline TARGET_AVX2 __m256i NoiseHashAVX2(__m256i x)
+{
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int) 0x7feb352dU));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int) 0x846ca68bU));
+	return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+static TARGET_AVX2 void RowRandomAVX2(Pixel *row, int n, int x0, uint32_t row_key)
+{
+	const __m256i key = _mm256_set1_epi32((int) row_key);
+	const __m256i step = _mm256_set1_epi32((int) (8 * NOISE_COLUMN_MULT));
+	const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+	                                         _mm256_set1_epi32((int) NOISE_COLUMN_MULT));
+	__m256i col = _mm256_add_epi32(_mm256_set1_epi32((int) ((uint32_t) x0 * NOISE_COLUMN_MULT)), lanes);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_si256((__m256i *) (row + i), NoiseHashAVX2(_mm256_xor_si256(col, key)));
+		col = _mm256_add_epi32(col, step);
+	}
+	RowRandomScalar(row + i, n - i, x0 + i, row_key);
+}
+
+#endif // PIXELROW_X86
+
+
+/**
+ * Dispatch
+ **/
+struct RowKernels {
+	void (*scale)(Pixel *, int, double);
+	void (*lerp)(Pixel *, const Pixel *, int, double);
+	void (*add)(Pixel *, const Pixel *, int);
+	void (*contrast)(Pixel *, int, double, double);
+	void (*saturate)(Pixel *, int, double);
+	void (*random)(Pixel *, int, int, uint32_t);
+};
+
+static const RowKernels kernels[SIMD_N_LEVELS] = {
+	{ RowScaleScalar, RowLerpScalar, RowAddScalar, RowContrastScalar, RowSaturateScalar, RowRandomScalar },
+#if PIXELROW_X86
+	{ RowScaleSSE2, RowLerpSSE2, RowAddSSE2, RowContrastSSE2, RowSaturateSSE2, RowRandomSSE2 },
+	{ RowScaleAVX2, RowLerpAVX2, RowAddAVX2, RowContrastAVX2, RowSaturateAVX2, RowRandomAVX2 },
+#else
+	{ RowScaleScalar, RowLerpScalar, RowAddScalar, RowContrastScalar, RowSaturateScalar, RowRandomScalar },
+	{ RowScaleScalar, RowLerpScalar, RowAddScalar, RowContrastScalar, RowSaturateScalar, RowRandomScalar },
+#endif
+};
+
+static int DetectSimdLevel()
+{
+#if PIXELROW_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+	return SIMD_SSE2;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+static int BestSimdLevel()
+{
+	static const int best = DetectSimdLevel();
+	return best;
+}
+
+// -1 until SetSimdLevel is called; then fixed for the rest of the run
+static int simd_level = -1;
+
+int SetSimdLevel(int level)
+{
+	int best = BestSimdLevel();
+	if (level < 0) level = 0;
+	simd_level = (level > best) ? best : level;
+	return simd_level;
+}
+
+int SimdLevel()
+{
+	return (simd_level < 0) ? BestSimdLevel() : simd_level;
+}
+
+void PixelRowScale(Pixel *row, int n, double f)
+{
+	kernels[SimdLevel()].scale(row, n, f);
+}
+
+void PixelRowLerp(Pixel *row, const Pixel *q, int n, double t)
+{
+	kernels[SimdLevel()].lerp(row, q, n, t);
+}
+
+void PixelRowAdd(Pixel *row, const Pixel *q, int n)
+{
+	kernels[SimdLevel()].add(row, q, n);
+}
+
+void PixelRowContrast(Pixel *row, int n, double gray, double f)
+{
+	kernels[SimdLevel()].contrast(row, n, gray, f);
+}
+
+void PixelRowSaturate(Pixel *row, int n, double f)
+{
+	kernels[SimdLevel()].saturate(row, n, f);
+}
+
+void PixelRowRandom(Pixel *row, int n, int x0, uint32_t row_key)
+{
+	kernels[SimdLevel()].random(row, n, x0, row_key);
+}
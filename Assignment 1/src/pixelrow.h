@@ -0,0 +1,52 @@
+//pixelrow.h
+//
+//Whole-row Pixel kernels used by the image operations.
+//
+//Each kernel has a scalar version built on the Component functions in
+//pixel.h and, on x86, SSE2 and AVX2 versions chosen at run time.  The
+//vector versions do the same double-precision arithmetic in the same order
+//(including floor/truncation and clamping), so every level produces
+//byte-identical output.
+
+#ifndef PIXELROW_INCLUDED
+#define PIXELROW_INCLUDED
+
+#include "pixel.h"
+
+/**
+ * Instruction set levels, worst to best
+ **/
+enum {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_N_LEVELS
+};
+
+// Selects the kernels for the given level, or the best one the CPU supports
+// if level is higher than that.  Returns the level actually selected.
+int SetSimdLevel(int level);
+
+// Returns the level currently in use (the best available by default).
+int SimdLevel();
+
+// row[i] = row[i] * f
+void PixelRowScale(Pixel *row, int n, double f);
+
+// row[i] = PixelLerp(row[i], q[i], t)
+void PixelRowLerp(Pixel *row, const Pixel *q, int n, double t);
+
+// row[i] = row[i] + q[i]
+void PixelRowAdd(Pixel *row, const Pixel *q, int n);
+
+// Applies ComponentContrast(c, gray, f) to the color components of row[i].
+void PixelRowContrast(Pixel *row, int n, double gray, double f);
+
+// As PixelRowContrast, with each pixel's own luminance as the gray level.
+void PixelRowSaturate(Pixel *row, int n, double f);
+
+// row[i] = the random pixel for column x0 + i of the noise row with the
+// given key: NoiseValue(row_key, x0 + i), low byte in r (see noise.h).
+void PixelRowRandom(Pixel *row, int n, int x0, uint32_t row_key);
+
+#endif
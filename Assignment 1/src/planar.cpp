@@ -0,0 +1,223 @@
+#include "planar.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include "traverse.h"
+#include <math.h>
+#include <string.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define PLANAR_X86 1
+#include <emmintrin.h>
+#else
+#define PLANAR_X86 0
+#endif
+
+/**
+ * Channel views
+ **/
+ChannelView ImageChannel (const Image &img, int channel)
+{
+	assert(channel >= 0 && channel < IMAGE_N_CHANNELS);
+	ChannelView view;
+	view.data = img.Empty() ? NULL : &img.Row(0)->r + channel;
+	view.width = img.Width();
+	view.height = img.Height();
+	view.stride = (ptrdiff_t) img.Stride() * sizeof(Pixel);
+	view.step = sizeof(Pixel);
+	return view;
+}
+
+void FillChannel (const ChannelView &view, uint8_t value)
+{
+	for (int y = 0; y < view.height; y++) {
+		uint8_t *row = view.Row(y);
+		if (view.step == 1)
+			memset(row, value, view.width);
+		else
+			for (int x = 0; x < view.width; x++) row[x * view.step] = value;
+	}
+}
+
+void MapChannel (const ChannelView &view, const uint8_t table[256])
+{
+	for (int y = 0; y < view.height; y++) {
+		uint8_t *row = view.Row(y);
+		for (int x = 0; x < view.width; x++) {
+			uint8_t &v = row[x * view.step];
+			v = table[v];
+		}
+	}
+}
+
+
+/**
+ * Row conversion
+ **/
+static void DeinterleaveRowScalar (const Pixel *src, uint8_t *const planes[4], int i, int n)
+{
+	for (; i < n; i++) {
+		planes[0][i] = src[i].r;
+		planes[1][i] = src[i].g;
+		planes[2][i] = src[i].b;
+		planes[3][i] = src[i].a;
+	}
+}
+
+static void InterleaveRowScalar (const uint8_t *const planes[4], Pixel *dst, int i, int n)
+{
+	for (; i < n; i++) dst[i] = Pixel(planes[0][i], planes[1][i], planes[2][i], planes[3][i]);
+}
+
+void DeinterleaveRow (const Pixel *src, uint8_t *const planes[4], int n)
+{
+	int i = 0;
+#if PLANAR_X86
+	if (SimdLevel() >= SIMD_SSE2) {
+		// Four rounds of byte unpacks take 16 pixels from rgba order to one
+		// register per channel
+		for (; i + 16 <= n; i += 16) {
+			__m128i v0 = _mm_loadu_si128((const __m128i *) (src + i));
+			__m128i v1 = _mm_loadu_si128((const __m128i *) (src + i + 4));
+			__m128i v2 = _mm_loadu_si128((const __m128i *) (src + i + 8));
+			__m128i v3 = _mm_loadu_si128((const __m128i *) (src + i + 12));
+			__m128i t0 = _mm_unpacklo_epi8(v0, v2), t1 = _mm_unpackhi_epi8(v0, v2);
+			__m128i t2 = _mm_unpacklo_epi8(v1, v3), t3 = _mm_unpackhi_epi8(v1, v3);
+			__m128i u0 = _mm_unpacklo_epi8(t0, t2), u1 = _mm_unpackhi_epi8(t0, t2);
+			__m128i u2 = _mm_unpacklo_epi8(t1, t3), u3 = _mm_unpackhi_epi8(t1, t3);
+			__m128i w0 = _mm_unpacklo_epi8(u0, u2), w1 = _mm_unpackhi_epi8(u0, u2);
+			__m128i w2 = _mm_unpacklo_epi8(u1, u3), w3 = _mm_unpackhi_epi8(u1, u3);
+			_mm_storeu_si128((__m128i *) (planes[0] + i), _mm_unpacklo_epi8(w0, w2));
+			_mm_storeu_si128((__m128i *) (planes[1] + i), _mm_unpackhi_epi8(w0, w2));
+			_mm_storeu_si128((__m128i *) (planes[2] + i), _mm_unpacklo_epi8(w1, w3));
+			_mm_storeu_si128((__m128i *) (planes[3] + i), _mm_unpackhi_epi8(w1, w3));
+		}
+	}
+#endif
+	DeinterleaveRowScalar(src, planes, i, n);
+}
+
+void InterleaveRow (const uint8_t *const planes[4], Pixel *dst, int n)
+{
+	int i = 0;
+#if PLANAR_X86
+	if (SimdLevel() >= SIMD_SSE2) {
+		for (; i + 16 <= n; i += 16) {
+			__m128i r = _mm_loadu_si128((const __m128i *) (planes[0] + i));
+			__m128i g = _mm_loadu_si128((const __m128i *) (planes[1] + i));
+			__m128i b = _mm_loadu_si128((const __m128i *) (planes[2] + i));
+			__m128i a = _mm_loadu_si128((const __m128i *) (planes[3] + i));
+			__m128i rg0 = _mm_unpacklo_epi8(r, g), rg1 = _mm_unpackhi_epi8(r, g);
+			__m128i ba0 = _mm_unpacklo_epi8(b, a), ba1 = _mm_unpackhi_epi8(b, a);
+			_mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(rg0, ba0));
+			_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(rg0, ba0));
+			_mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpacklo_epi16(rg1, ba1));
+			_mm_storeu_si128((__m128i *) (dst + i + 12), _mm_unpackhi_epi16(rg1, ba1));
+		}
+	}
+#endif
+	InterleaveRowScalar(planes, dst, i, n);
+}
+
+
+/**
+ * PlanarImage
+ **/
+static ptrdiff_t PlaneStride (int width)
+{
+	return ((ptrdiff_t) width + PLANAR_ROW_ALIGNMENT - 1) & ~(ptrdiff_t) (PLANAR_ROW_ALIGNMENT - 1);
+}
+
+PlanarImage::PlanarImage (int width_, int height_)
+	: width(width_), height(height_), stride(PlaneStride(width_)),
+	  buffer((size_t) IMAGE_N_CHANNELS * height_ * PlaneStride(width_))
+{
+	assert(width_ > 0);
+	assert(height_ > 0);
+}
+
+PlanarImage::PlanarImage (const Image &img) : PlanarImage(img.Width(), img.Height())
+{
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			uint8_t *const planes[4] = { Row(0, y), Row(1, y), Row(2, y), Row(3, y) };
+			DeinterleaveRow(img.Row(y), planes, width);
+		}
+	});
+}
+
+void PlanarImage::Interleave (Image &img) const
+{
+	assert(img.Width() == width && img.Height() == height);
+	ForEachRow(img, [&](Pixel *row, int y) {
+		const uint8_t *const planes[4] = { Row(0, y), Row(1, y), Row(2, y), Row(3, y) };
+		InterleaveRow(planes, row, width);
+	});
+}
+
+Image PlanarImage::ToImage () const
+{
+	Image img(width, height);
+	Interleave(img);
+	return img;
+}
+
+ChannelView PlanarImage::Channel (int channel) const
+{
+	ChannelView view;
+	view.data = Empty() ? NULL : Row(channel, 0);
+	view.width = width;
+	view.height = height;
+	view.stride = stride;
+	view.step = 1;
+	return view;
+}
+
+
+/**
+ * Ops
+ **/
+// Both through the planes' channel views, as Image's versions go through
+// its interleaved ones
+void PlanarImage::ExtractChannel (int channel)
+{
+	if (channel < IMAGE_CHANNEL_RED || channel > IMAGE_CHANNEL_BLUE) return;
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int c = IMAGE_CHANNEL_RED; c <= IMAGE_CHANNEL_BLUE; c++)
+			if (c != channel) FillChannel(Channel(c).Rows(y0, y1), 0);
+	});
+}
+
+void PlanarImage::Quantize (int nbits)
+{
+	double step = 255.0/(pow(2, nbits)-1);
+	uint8_t quant[256];
+	for (int v = 0; v < 256; v++) quant[v] = ComponentQuantize(v, step);
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int c = IMAGE_CHANNEL_RED; c <= IMAGE_CHANNEL_BLUE; c++)
+			MapChannel(Channel(c).Rows(y0, y1), quant);
+	});
+}
+
+
+/**
+ * LayoutImage
+ **/
+PlanarImage& LayoutImage::Planar (const Image &img)
+{
+	if (!planarCurrent) {
+		planar = PlanarImage(img);
+		planarCurrent = true;
+	}
+	return planar;
+}
+
+void LayoutImage::Interleave (Image &img)
+{
+	if (!planarCurrent) return;
+	if (img.Width() == planar.Width() && img.Height() == planar.Height())
+		planar.Interleave(img);
+	else
+		img = planar.ToImage();
+	planar = PlanarImage();
+	planarCurrent = false;
+}
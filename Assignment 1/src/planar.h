@@ -0,0 +1,151 @@
+//planar.h
+//
+//Planar (structure of arrays) storage for 8-bit images.
+//
+//Image interleaves r, g, b and a, so an op that works on one channel at a
+//time still drags all four through the cache.  PlanarImage keeps each
+//channel in its own plane of bytes, with rows padded to 64 bytes so every
+//row starts a cache line.  Conversion both ways runs 16 pixels at a time
+//with SSE2 unpacks.
+//
+//-layout planar runs -extractChannel and -quantize on the planes (see
+//LayoutImage), and a chain of them converts once on the way in and once on
+//the way out.  A ChannelView is one channel of either layout in place,
+//without copying it, so the ops that work a channel at a time have one
+//implementation for both layouts.
+
+#ifndef PLANAR_INCLUDED
+#define PLANAR_INCLUDED
+
+#include "image.h"
+#include "pixelbuffer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+    IMAGE_LAYOUT_INTERLEAVED,
+    IMAGE_LAYOUT_PLANAR,
+    IMAGE_N_LAYOUTS
+};
+
+// Bytes a plane row is padded to
+#define PLANAR_ROW_ALIGNMENT 64
+
+
+/**
+ * Channel views
+ **/
+// One channel of an image, where it lies: samples step bytes apart along a
+// row, rows stride bytes apart.  The view does not own the bytes.
+struct ChannelView
+{
+    uint8_t *data;
+    int width, height;
+    ptrdiff_t stride;
+    int step;
+
+    uint8_t* Row (int y) const { assert(y >= 0 && y < height);  return data + y * stride; }
+    uint8_t& operator() (int x, int y) const { assert(x >= 0 && x < width);  return Row(y)[x * step]; }
+
+    // Rows [y0, y1) of the view, for splitting it between threads
+    ChannelView Rows (int y0, int y1) const
+    {
+        assert(y0 >= 0 && y0 <= y1 && y1 <= height);
+        ChannelView view = *this;
+        if (y0 < y1) view.data = Row(y0);
+        view.height = y1 - y0;
+        return view;
+    }
+};
+
+// A channel of an interleaved image, in place
+ChannelView ImageChannel(const Image &img, int channel);
+
+// Sets every sample of the view to value
+void FillChannel(const ChannelView &view, uint8_t value);
+
+// Replaces every sample v of the view with table[v]
+void MapChannel(const ChannelView &view, const uint8_t table[256]);
+
+
+/**
+ * Row conversion
+ **/
+// Splits n pixels into the four planes, r first
+void DeinterleaveRow(const Pixel *src, uint8_t *const planes[4], int n);
+
+// Joins n samples of the four planes into pixels
+void InterleaveRow(const uint8_t *const planes[4], Pixel *dst, int n);
+
+
+/**
+ * PlanarImage
+ **/
+class PlanarImage
+{
+public:
+    // Creates an empty 0 x 0 image
+    PlanarImage () : width(0), height(0), stride(0) {}
+
+    // Creates black, transparent planes with the given dimensions
+    PlanarImage (int width, int height);
+
+    // Splits an interleaved image into planes
+    explicit PlanarImage (const Image &img);
+
+    // Joins the planes into img, which must have the same dimensions, or
+    // into a new image
+    void Interleave (Image &img) const;
+    Image ToImage () const;
+
+    int Width () const { return width; }
+    int Height () const { return height; }
+    bool Empty () const { return width == 0 || height == 0; }
+    ptrdiff_t Stride () const { return stride; }
+    uint8_t* Row (int channel, int y) const
+    {
+        assert(channel >= 0 && channel < IMAGE_N_CHANNELS && y >= 0 && y < height);
+        return buffer.Bytes() + ((size_t) channel * height + y) * stride;
+    }
+
+    // A plane, in place
+    ChannelView Channel (int channel) const;
+
+    // The ops, as documented on Image, working a plane at a time
+    void ExtractChannel (int channel);
+    void Quantize (int nbits);
+
+private:
+    int width, height;
+    ptrdiff_t stride;
+    PixelBuffer buffer;     // the planes one after another, r first
+};
+
+
+/**
+ * Layouts in a chain of ops
+ **/
+// The current pixels of a chain of ops, in whichever layout the last op
+// ran in.  The interleaved Image is the caller's; Planar splits it only if
+// it holds the current pixels, and Interleave joins them back only if the
+// planes do.
+class LayoutImage
+{
+public:
+    LayoutImage () : planarCurrent(false) {}
+
+    int Layout () const { return planarCurrent ? IMAGE_LAYOUT_PLANAR : IMAGE_LAYOUT_INTERLEAVED; }
+
+    // The planes, split from img if needed.  img is out of date afterwards
+    // until Interleave.
+    PlanarImage& Planar (const Image &img);
+
+    // Brings img up to date from the planes, if they are current
+    void Interleave (Image &img);
+
+private:
+    PlanarImage planar;
+    bool planarCurrent;
+};
+
+#endif
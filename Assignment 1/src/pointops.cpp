@@ -0,0 +1,153 @@
+#include "pointops.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Queueing
+ **/
+Component (*PointOpPipeline::TailLut ())[256]
+{
+	if (ops.empty() || ops.back().type != OP_LUT) {
+		Op op;
+		op.type = OP_LUT;
+		op.factor = 0;
+		for (int c = 0; c < 4; c++)
+			for (int v = 0; v < 256; v++)
+				op.lut[c][v] = v;
+		ops.push_back(op);
+	}
+	return ops.back().lut;
+}
+
+void PointOpPipeline::Brighten (double factor)
+{
+	// Pixel * double scales alpha as well
+	Component (*lut)[256] = TailLut();
+	for (int c = 0; c < 4; c++)
+		for (int v = 0; v < 256; v++)
+			lut[c][v] = ComponentScale(lut[c][v], factor);
+}
+
+void PointOpPipeline::Quantize (int nbits)
+{
+	double step = 255.0/(pow(2, nbits)-1);
+	Component (*lut)[256] = TailLut();
+	for (int c = 0; c < 3; c++)
+		for (int v = 0; v < 256; v++)
+			lut[c][v] = ComponentQuantize(lut[c][v], step);
+}
+
+void PointOpPipeline::ExtractChannel (int channel)
+{
+	if (channel < 0 || channel > 2) return;
+	Component (*lut)[256] = TailLut();
+	for (int c = 0; c < 3; c++)
+		if (c != channel)
+			for (int v = 0; v < 256; v++)
+				lut[c][v] = 0;
+}
+
+void PointOpPipeline::ChangeSaturation (double factor)
+{
+	Op op;
+	op.type = OP_SATURATION;
+	op.factor = factor - 1;
+	ops.push_back(op);
+}
+
+void PointOpPipeline::ChangeContrast (double factor)
+{
+	Op op;
+	op.type = OP_CONTRAST;
+	op.factor = factor - 1;
+	ops.push_back(op);
+}
+
+
+/**
+ * Application
+ **/
+static void ApplyLut (Pixel *row, int width, const Component lut[4][256])
+{
+	for (int x = 0; x < width; x++) {
+		Pixel &p = row[x];
+		p.r = lut[0][p.r];
+		p.g = lut[1][p.g];
+		p.b = lut[2][p.b];
+		p.a = lut[3][p.a];
+	}
+}
+
+void PointOpPipeline::Apply (Image *img)
+{
+	if (ops.empty() || img == NULL) return;
+
+	int width = img->Width(), height = img->Height();
+	std::vector<int64_t> rowSums(height);
+
+	// Each traversal runs stages [first, last).  A contrast op needs the
+	// average luminance of everything before it, so a traversal ends just
+	// before one and sums the luminance of its output on the way.
+	size_t first = 0;
+	bool haveSums = false;
+	while (first < ops.size()) {
+		if (ops[first].type == OP_CONTRAST) {
+			// Turn the contrast into a table now that its average is known
+			Op &op = ops[first];
+			if (!haveSums) {
+				ParallelFor(height, [&](int y0, int y1) {
+					for (int y = y0; y < y1; y++) {
+						Pixel *row = &img->GetPixel(0, y);
+						int64_t sum = 0;
+						for (int x = 0; x < width; x++) sum += row[x].Luminance();
+						rowSums[y] = sum;
+					}
+				});
+			}
+			int64_t total = 0;
+			for (int y = 0; y < height; y++) total += rowSums[y];
+			double average = (double) total / (width * height);
+			for (int c = 0; c < 4; c++)
+				for (int v = 0; v < 256; v++)
+					op.lut[c][v] = (c < 3) ? ComponentContrast(v, average, op.factor) : v;
+			op.type = OP_LUT;
+			// Compose it with a following table so both share one traversal
+			if (first + 1 < ops.size() && ops[first + 1].type == OP_LUT) {
+				Op &next = ops[first + 1];
+				Component composed[4][256];
+				for (int c = 0; c < 4; c++)
+					for (int v = 0; v < 256; v++)
+						composed[c][v] = next.lut[c][op.lut[c][v]];
+				memcpy(next.lut, composed, sizeof(composed));
+				ops.erase(ops.begin() + first);
+			}
+		}
+
+		size_t last = first;
+		while (last < ops.size() && ops[last].type != OP_CONTRAST) last++;
+		bool sumOutput = last < ops.size();
+
+		ParallelFor(height, [&](int y0, int y1) {
+			for (int y = y0; y < y1; y++) {
+				Pixel *row = &img->GetPixel(0, y);
+				for (size_t i = first; i < last; i++) {
+					if (ops[i].type == OP_LUT)
+						ApplyLut(row, width, ops[i].lut);
+					else
+						PixelRowSaturate(row, width, ops[i].factor);
+				}
+				if (sumOutput) {
+					int64_t sum = 0;
+					for (int x = 0; x < width; x++) sum += row[x].Luminance();
+					rowSums[y] = sum;
+				}
+			}
+		});
+		haveSums = sumOutput;
+		first = last;
+	}
+
+	ops.clear();
+}
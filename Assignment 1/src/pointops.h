@@ -0,0 +1,50 @@
+//pointops.h
+//
+//Deferred chain of per-pixel point operations, applied in one traversal.
+//
+//Operations that map each component independently (brightness, quantize,
+//channel masks, and contrast once its average is known) are composed into
+//a single 256-entry table per channel.  Saturation mixes the channels of a
+//pixel, so it runs as a separate stage, but on the same row while that row
+//is still in cache.  Every stage uses the same per-component math as the
+//matching Image method, so the output is identical to applying the
+//operations one by one.
+
+#ifndef POINTOPS_INCLUDED
+#define POINTOPS_INCLUDED
+
+#include "image.h"
+#include <vector>
+
+class PointOpPipeline
+{
+public:
+    // Queue operations.  The arguments match the Image methods.
+    void Brighten (double factor);
+    void ChangeContrast (double factor);
+    void ChangeSaturation (double factor);
+    void ExtractChannel (int channel);
+    void Quantize (int nbits);
+
+    bool Empty () const { return ops.empty(); }
+
+    // Applies every queued operation to img and clears the queue.
+    void Apply (Image *img);
+
+private:
+    enum OpType { OP_LUT, OP_SATURATION, OP_CONTRAST };
+
+    struct Op {
+        OpType type;
+        double factor;             // saturation/contrast factor - 1
+        Component lut[4][256];     // OP_LUT: r, g, b, a tables
+    };
+
+    std::vector<Op> ops;
+
+    // Returns the table at the end of the queue, starting a new identity
+    // table if the last op is not one.
+    Component (*TailLut ())[256];
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include "pyramid.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include <math.h>
+#include <utility>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define PYRAMID_X86 1
+#include <emmintrin.h>
+#else
+#define PYRAMID_X86 0
+#endif
+
+/**
+ * Reduction
+ **/
+// Output pixels [x0, n) of a halved row, from source rows r0 and r1 of
+// width w.  The last column repeats when w is odd.
+static void HalveRowScalar (const Pixel *r0, const Pixel *r1, Pixel *out, int x0, int n, int w)
+{
+	for (int x = x0; x < n; x++) {
+		int a = 2*x, b = (2*x + 1 < w) ? 2*x + 1 : w - 1;
+		const Component *p = &r0[a].r, *q = &r0[b].r, *s = &r1[a].r, *t = &r1[b].r;
+		Component *o = &out[x].r;
+		for (int k = 0; k < 4; k++) o[k] = (Component) ((p[k] + q[k] + s[k] + t[k] + 2) >> 2);
+	}
+}
+
+#if PYRAMID_X86
+// Two output pixels from four source pixels of each row, as 16-bit sums
+static inline __m128i HalveQuadSSE2 (const Pixel *r0, const Pixel *r1)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_loadu_si128((const __m128i *) r0);
+	__m128i b = _mm_loadu_si128((const __m128i *) r1);
+	__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));   // pixels 0, 1
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));   // pixels 2, 3
+	__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+// Four output pixels at a time while they have all their source pixels,
+// then the scalar loop for the rest
+static void HalveRowSSE2 (const Pixel *r0, const Pixel *r1, Pixel *out, int n, int w)
+{
+	int x = 0;
+	for (; 2*x + 8 <= w; x += 4) {
+		__m128i p = HalveQuadSSE2(r0 + 2*x, r1 + 2*x);
+		__m128i q = HalveQuadSSE2(r0 + 2*x + 4, r1 + 2*x + 4);
+		_mm_storeu_si128((__m128i *) (out + x), _mm_packus_epi16(p, q));
+	}
+	HalveRowScalar(r0, r1, out, x, n, w);
+}
+#endif
+
+void HalveImage (const Image &src, Image &dst)
+{
+	int w = src.Width(), h = src.Height();
+	assert(dst.Width() == (w + 1) / 2 && dst.Height() == (h + 1) / 2);
+	bool simd = PYRAMID_X86 && SimdLevel() >= SIMD_SSE2;
+	int n = dst.Width();
+
+	ParallelFor(dst.Height(), [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const Pixel *r0 = src.Row(2*y);
+			const Pixel *r1 = src.Row((2*y + 1 < h) ? 2*y + 1 : h - 1);
+#if PYRAMID_X86
+			if (simd) {
+				HalveRowSSE2(r0, r1, dst.Row(y), n, w);
+				continue;
+			}
+#endif
+			HalveRowScalar(r0, r1, dst.Row(y), 0, n, w);
+		}
+	});
+}
+
+
+/**
+ * Pyramid
+ **/
+ImagePyramid::ImagePyramid (const Image &img, int levels) : base(&img)
+{
+	for (int l = 1; levels < 0 || l < levels; l++) {
+		const Image &above = Level(l - 1);
+		int w = (above.Width() + 1) / 2, h = (above.Height() + 1) / 2;
+		if (w < PYRAMID_MIN_SIZE || h < PYRAMID_MIN_SIZE) break;
+		Image next(w, h);
+		HalveImage(above, next);
+		reduced.push_back(std::move(next));
+	}
+}
+
+int ImagePyramid::LevelFor (const Image &img, double sx, double sy)
+{
+	int level = 0, w = img.Width(), h = img.Height();
+	for (double f = 2; sx * f <= 1 && sy * f <= 1; f *= 2) {
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+		if (w < PYRAMID_MIN_SIZE || h < PYRAMID_MIN_SIZE) break;
+		level++;
+	}
+	return level;
+}
+
+// Interpolates the four pixels around (u, v), repeating the edges
+static void Bilinear (const Image &img, double u, double v, double c[4])
+{
+	double x = u - 0.5, y = v - 0.5;
+	int x0 = (int) floor(x), y0 = (int) floor(y);
+	double fx = x - x0, fy = y - y0;
+	int w = img.Width(), h = img.Height();
+	int xa = (x0 < 0) ? 0 : (x0 < w) ? x0 : w - 1;
+	int xb = (x0 + 1 < 0) ? 0 : (x0 + 1 < w) ? x0 + 1 : w - 1;
+	int ya = (y0 < 0) ? 0 : (y0 < h) ? y0 : h - 1;
+	int yb = (y0 + 1 < 0) ? 0 : (y0 + 1 < h) ? y0 + 1 : h - 1;
+	const Component *p00 = &img.Row(ya)[xa].r, *p10 = &img.Row(ya)[xb].r;
+	const Component *p01 = &img.Row(yb)[xa].r, *p11 = &img.Row(yb)[xb].r;
+	for (int k = 0; k < 4; k++) {
+		double top = p00[k] * (1 - fx) + p10[k] * fx;
+		double bottom = p01[k] * (1 - fx) + p11[k] * fx;
+		c[k] = top * (1 - fy) + bottom * fy;
+	}
+}
+
+Pixel ImagePyramid::Sample (double u, double v, double lod) const
+{
+	if (lod < 0) lod = 0;
+	int l = (int) lod;
+	double t = lod - l;
+	if (l >= Levels() - 1) {
+		l = Levels() - 1;
+		t = 0;
+	}
+
+	double f = ldexp(1.0, -l);
+	double c[4], d[4];
+	Bilinear(Level(l), u * f, v * f, c);
+	if (t > 0) {
+		Bilinear(Level(l + 1), u * f / 2, v * f / 2, d);
+		for (int k = 0; k < 4; k++) c[k] += (d[k] - c[k]) * t;
+	}
+	return Pixel((Component) (c[0] + 0.5), (Component) (c[1] + 0.5), (Component) (c[2] + 0.5), (Component) (c[3] + 0.5));
+}
@@ -0,0 +1,54 @@
+//pyramid.h
+//
+//Image pyramids (mipmaps) for large reductions.
+//
+//Level 0 is the image itself and each further level halves the one above
+//with a 2x2 box filter, so pixel i of level l averages pixels
+//[i * 2^l, (i + 1) * 2^l) of the image.  Odd sizes round up, repeating the
+//last row or column.  The box sums are exact integers, rounded once, and
+//the SSE2 kernel gives the same bytes as the scalar one.
+//
+//Scale starts from the smallest level still at least as big as the result,
+//and IMAGE_SAMPLING_TRILINEAR blends bilinear lookups in the two levels
+//around the size of a warp's output pixels.
+
+#ifndef PYRAMID_INCLUDED
+#define PYRAMID_INCLUDED
+
+#include "image.h"
+#include <vector>
+
+// Levels are not made smaller than this on either side, so the legacy
+// samplers always have room for their taps
+#define PYRAMID_MIN_SIZE 8
+
+// Fills dst, of size ((w + 1) / 2, (h + 1) / 2), with src reduced by 2x2
+// boxes.
+void HalveImage(const Image &src, Image &dst);
+
+class ImagePyramid
+{
+public:
+    // Builds up to levels levels (all of them if levels < 0), stopping
+    // before any level would be smaller than PYRAMID_MIN_SIZE.  img must
+    // outlive the pyramid.
+    ImagePyramid(const Image &img, int levels = -1);
+
+    int Levels() const { return 1 + (int) reduced.size(); }
+    const Image& Level(int l) const { return (l == 0) ? *base : reduced[l - 1]; }
+
+    // The deepest level a scale by (sx, sy) can start from: one whose
+    // reduction is no bigger than the scale's on either axis.  Returns 0
+    // when the scale does not shrink by 2 or more.
+    static int LevelFor(const Image &img, double sx, double sy);
+
+    // Bilinear lookups at (u, v) in the two levels around lod, blended.
+    // (u, v) is in level 0 pixels, with pixel i centered on i + 0.5.
+    Pixel Sample(double u, double v, double lod) const;
+
+private:
+    const Image *base;
+    std::vector<Image> reduced;
+};
+
+#endif
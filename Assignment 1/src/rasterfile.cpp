@@ -0,0 +1,329 @@
+#include "rasterfile.h"
+#include "rawimage.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Extra layout for 32 bit BMP/TGA files whose fourth byte is not alpha
+static const RasterLayout RASTER_BGRX = (RasterLayout) (RASTER_BGR_OVER_MAGENTA + 1);
+
+static int BytesPerPixel (RasterLayout layout)
+{
+	switch (layout) {
+		case RASTER_GRAY:       return 1;
+		case RASTER_GRAY_ALPHA: return 2;
+		case RASTER_RGB:
+		case RASTER_BGR:
+		case RASTER_BGR_OVER_MAGENTA: return 3;
+		default:                return 4;
+	}
+}
+
+static bool SeekTo (FILE *f, int64_t pos)
+{
+#ifdef _WIN32
+	return _fseeki64(f, pos, SEEK_SET) == 0;
+#else
+	return fseeko(f, (off_t) pos, SEEK_SET) == 0;
+#endif
+}
+
+static int Get16 (const uint8_t *p) { return p[0] | (p[1] << 8); }
+static int32_t Get32 (const uint8_t *p) { return (int32_t) (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24)); }
+static void Put16 (uint8_t *p, int v) { p[0] = v & 255; p[1] = (v >> 8) & 255; }
+static void Put32 (uint8_t *p, int32_t v) { Put16(p, v & 0xffff); Put16(p + 2, (v >> 16) & 0xffff); }
+
+
+/**
+ * RasterFile
+ **/
+RasterFile::~RasterFile ()
+{
+	if (file) fclose(file);
+}
+
+bool RasterFile::SeekRow (int y)
+{
+	int stored = bottom_up ? height - 1 - y : y;
+	return SeekTo(file, offset + (int64_t) stored * stride);
+}
+
+
+/**
+ * RasterReader
+ **/
+// Reads a whitespace separated PNM header token, skipping # comments.  The
+// single whitespace character that ends the token is consumed.
+static bool ReadToken (FILE *f, char *buf, int size)
+{
+	int c = getc(f);
+	for (;;) {
+		while (c != EOF && isspace(c)) c = getc(f);
+		if (c != '#') break;
+		while (c != EOF && c != '\n') c = getc(f);
+	}
+	int n = 0;
+	while (c != EOF && !isspace(c) && n < size - 1) {
+		buf[n++] = (char) c;
+		c = getc(f);
+	}
+	buf[n] = 0;
+	return n > 0;
+}
+
+bool RasterReader::ParsePNM ()
+{
+	char tok[64];
+	if (!ReadToken(file, tok, sizeof(tok))) return false;
+
+	int maxval = 0;
+	if (!strcmp(tok, "P5") || !strcmp(tok, "P6")) {
+		layout = (tok[1] == '5') ? RASTER_GRAY : RASTER_RGB;
+		if (!ReadToken(file, tok, sizeof(tok))) return false;
+		width = atoi(tok);
+		if (!ReadToken(file, tok, sizeof(tok))) return false;
+		height = atoi(tok);
+		if (!ReadToken(file, tok, sizeof(tok))) return false;
+		maxval = atoi(tok);
+	}
+	else if (!strcmp(tok, "P7")) {
+		int depth = 0;
+		while (ReadToken(file, tok, sizeof(tok)) && strcmp(tok, "ENDHDR")) {
+			char value[64];
+			if (!ReadToken(file, value, sizeof(value))) return false;
+			if (!strcmp(tok, "WIDTH")) width = atoi(value);
+			else if (!strcmp(tok, "HEIGHT")) height = atoi(value);
+			else if (!strcmp(tok, "DEPTH")) depth = atoi(value);
+			else if (!strcmp(tok, "MAXVAL")) maxval = atoi(value);
+		}
+		switch (depth) {
+			case 1: layout = RASTER_GRAY; break;
+			case 2: layout = RASTER_GRAY_ALPHA; break;
+			case 3: layout = RASTER_RGB; break;
+			case 4: layout = RASTER_RGBA; break;
+			default: return false;
+		}
+	}
+	else {
+		return false;
+	}
+
+	if (maxval != 255) return false;
+	offset = ftell(file);
+	stride = width * BytesPerPixel(layout);
+	return true;
+}
+
+bool RasterReader::ParseBMP ()
+{
+	uint8_t h[70];
+	memset(h, 0, sizeof(h));
+	if (fread(h, 1, 54, file) != 54 || h[0] != 'B' || h[1] != 'M') return false;
+	int dibSize = Get32(h + 14);
+	if (dibSize < 40) return false;
+	fread(h + 54, 1, 16, file);   // bitfield masks, if any
+
+	offset = (uint32_t) Get32(h + 10);
+	width = Get32(h + 18);
+	height = Get32(h + 22);
+	int bpp = Get16(h + 28);
+	int compression = Get32(h + 30);
+	bottom_up = height > 0;
+	if (height < 0) height = -height;
+
+	if (bpp == 24 && compression == 0) {
+		layout = RASTER_BGR;
+	}
+	else if (bpp == 32 && compression == 0) {
+		layout = RASTER_BGRX;
+	}
+	else if (bpp == 32 && compression == 3) {
+		// Only the usual 8:8:8(:8) BGR(A) masks
+		if ((uint32_t) Get32(h + 54) != 0x00ff0000 || Get32(h + 58) != 0x0000ff00 || Get32(h + 62) != 0x000000ff)
+			return false;
+		layout = (dibSize >= 56 && (uint32_t) Get32(h + 66) == 0xff000000) ? RASTER_BGRA : RASTER_BGRX;
+	}
+	else {
+		return false;
+	}
+	stride = (width * bpp / 8 + 3) & ~3;
+	return true;
+}
+
+bool RasterReader::ParseRaw ()
+{
+	uint8_t h[24];
+	if (fread(h, 1, sizeof(h), file) != sizeof(h) || !ParseRawImageHeader(h, sizeof(h), &width, &height))
+		return false;
+	layout = RASTER_RGBA;
+	offset = RAW_IMAGE_HEADER_SIZE;
+	stride = width * 4;
+	return true;
+}
+
+bool RasterReader::ParseTGA ()
+{
+	uint8_t h[18];
+	if (fread(h, 1, 18, file) != 18) return false;
+	int type = h[2], bpp = h[16], descriptor = h[17];
+	if (h[1] != 0 || (descriptor & 0x10)) return false;   // no color maps, no right-to-left
+
+	if (type == 2 && bpp == 24)
+		layout = RASTER_BGR;
+	else if (type == 2 && bpp == 32)
+		layout = (descriptor & 0x0f) ? RASTER_BGRA : RASTER_BGRX;
+	else if (type == 3 && bpp == 8)
+		layout = RASTER_GRAY;
+	else if (type == 3 && bpp == 16)
+		layout = RASTER_GRAY_ALPHA;
+	else
+		return false;
+
+	width = Get16(h + 12);
+	height = Get16(h + 14);
+	bottom_up = !(descriptor & 0x20);
+	offset = 18 + h[0];
+	stride = width * bpp / 8;
+	return true;
+}
+
+std::unique_ptr<RasterReader> RasterReader::Open (const char *fname)
+{
+	std::unique_ptr<RasterReader> r(new RasterReader());
+	r->file = fopen(fname, "rb");
+	if (r->file == NULL) return NULL;
+
+	const char *ext = strrchr(fname, '.');
+	bool ok = false;
+	if (ext && (!strcmp(ext, ".bmp") || !strcmp(ext, ".BMP")))
+		ok = r->ParseBMP();
+	else if (ext && (!strcmp(ext, ".tga") || !strcmp(ext, ".TGA")))
+		ok = r->ParseTGA();
+	else if (IsRawImageFile(fname))
+		ok = r->ParseRaw();
+	else
+		ok = r->ParsePNM();
+
+	if (!ok || r->width <= 0 || r->height <= 0) return NULL;
+	r->buffer.resize(r->stride);
+	return r;
+}
+
+bool RasterReader::ReadRows (int y, int count, Pixel *dst)
+{
+	for (int row = y; row < y + count; row++, dst += width) {
+		if (!SeekRow(row) || fread(buffer.data(), 1, stride, file) != (size_t) stride) return false;
+		const uint8_t *s = buffer.data();
+		for (int x = 0; x < width; x++) {
+			switch (layout) {
+				case RASTER_GRAY:       dst[x] = Pixel(s[0], s[0], s[0]); s += 1; break;
+				case RASTER_GRAY_ALPHA: dst[x] = Pixel(s[0], s[0], s[0], s[1]); s += 2; break;
+				case RASTER_RGB:        dst[x] = Pixel(s[0], s[1], s[2]); s += 3; break;
+				case RASTER_RGBA:       dst[x] = Pixel(s[0], s[1], s[2], s[3]); s += 4; break;
+				case RASTER_BGR:        dst[x] = Pixel(s[2], s[1], s[0]); s += 3; break;
+				case RASTER_BGRA:       dst[x] = Pixel(s[2], s[1], s[0], s[3]); s += 4; break;
+				default:                dst[x] = Pixel(s[2], s[1], s[0]); s += 4; break;   // BGRX
+			}
+		}
+	}
+	return true;
+}
+
+
+/**
+ * RasterWriter
+ **/
+bool RasterWriter::Supports (const char *fname)
+{
+	const char *ext = strrchr(fname, '.');
+	return ext && (!strcmp(ext, ".ppm") || !strcmp(ext, ".pam") ||
+	               !strcmp(ext, ".bmp") || !strcmp(ext, ".tga") || !strcmp(ext, ".rgba"));
+}
+
+std::unique_ptr<RasterWriter> RasterWriter::Open (const char *fname, int width, int height)
+{
+	if (!Supports(fname)) return NULL;
+	const char *ext = strrchr(fname, '.');
+
+	std::unique_ptr<RasterWriter> w(new RasterWriter());
+	w->file = fopen(fname, "wb");
+	if (w->file == NULL) return NULL;
+	w->width = width;
+	w->height = height;
+
+	if (!strcmp(ext, ".ppm")) {
+		fprintf(w->file, "P6\n%d %d\n255\n", width, height);
+		w->layout = RASTER_RGB;
+		w->stride = width * 3;
+	}
+	else if (!strcmp(ext, ".pam")) {
+		fprintf(w->file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+		w->layout = RASTER_RGBA;
+		w->stride = width * 4;
+	}
+	else if (!strcmp(ext, ".bmp")) {
+		// Same bytes stbi_write_bmp produces: 24 bit, bottom-up
+		uint8_t h[54];
+		memset(h, 0, sizeof(h));
+		w->stride = (width * 3 + 3) & ~3;
+		h[0] = 'B'; h[1] = 'M';
+		Put32(h + 2, 54 + w->stride * height);
+		Put32(h + 10, 54);
+		Put32(h + 14, 40);
+		Put32(h + 18, width);
+		Put32(h + 22, height);
+		Put16(h + 26, 1);
+		Put16(h + 28, 24);
+		fwrite(h, 1, sizeof(h), w->file);
+		w->layout = RASTER_BGR_OVER_MAGENTA;
+		w->bottom_up = true;
+	}
+	else if (IsRawImageFile(fname)) {
+		uint8_t h[RAW_IMAGE_HEADER_SIZE];
+		MakeRawImageHeader(h, width, height);
+		fwrite(h, 1, sizeof(h), w->file);
+		w->layout = RASTER_RGBA;
+		w->stride = width * 4;
+	}
+	else {
+		// Uncompressed 32 bit TGA, top-left origin
+		uint8_t h[18];
+		memset(h, 0, sizeof(h));
+		h[2] = 2;
+		Put16(h + 12, width);
+		Put16(h + 14, height);
+		h[16] = 32;
+		h[17] = 0x28;
+		fwrite(h, 1, sizeof(h), w->file);
+		w->layout = RASTER_BGRA;
+		w->stride = width * 4;
+	}
+
+	w->offset = ftell(w->file);
+	w->buffer.assign(w->stride, 0);
+	return w;
+}
+
+bool RasterWriter::WriteRows (int y, int count, const Pixel *src)
+{
+	for (int row = y; row < y + count; row++, src += width) {
+		uint8_t *d = buffer.data();
+		for (int x = 0; x < width; x++) {
+			const Pixel &p = src[x];
+			switch (layout) {
+				case RASTER_RGB:  d[0] = p.r; d[1] = p.g; d[2] = p.b; d += 3; break;
+				case RASTER_RGBA: d[0] = p.r; d[1] = p.g; d[2] = p.b; d[3] = p.a; d += 4; break;
+				case RASTER_BGRA: d[0] = p.b; d[1] = p.g; d[2] = p.r; d[3] = p.a; d += 4; break;
+				default:
+					// RASTER_BGR_OVER_MAGENTA, with stb_image_write's integer math
+					d[0] = 255 + ((p.b - 255) * p.a) / 255;
+					d[1] = (p.g * p.a) / 255;
+					d[2] = 255 + ((p.r - 255) * p.a) / 255;
+					d += 3;
+					break;
+			}
+		}
+		if (!SeekRow(row) || fwrite(buffer.data(), 1, stride, file) != (size_t) stride) return false;
+	}
+	return true;
+}
@@ -0,0 +1,99 @@
+//rasterfile.h
+//
+//Row-at-a-time access to uncompressed image files.
+//
+//PPM/PGM (binary P6/P5, maxval 255), PAM (P7, 8 bits), BMP (24/32 bit,
+//uncompressed), TGA (uncompressed true-color or gray) and the native .rgba
+//format (see rawimage.h) keep every row at a fixed offset in the file, so any
+//range of rows can be read or written without touching the rest of the
+//image.  This lets very large images be processed a strip at a time.
+
+#ifndef RASTERFILE_INCLUDED
+#define RASTERFILE_INCLUDED
+
+#include "pixel.h"
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// How pixels are laid out in a file row
+enum RasterLayout {
+    RASTER_GRAY,
+    RASTER_GRAY_ALPHA,
+    RASTER_RGB,
+    RASTER_RGBA,
+    RASTER_BGR,
+    RASTER_BGRA,
+    RASTER_BGR_OVER_MAGENTA   // written like stb_image_write's BMPs: alpha composited onto (255, 0, 255)
+};
+
+
+/**
+ * RasterFile, shared by the reader and the writer
+ **/
+class RasterFile
+{
+public:
+    virtual ~RasterFile ();
+
+    int Width  () const { return width; }
+    int Height () const { return height; }
+
+protected:
+    RasterFile () : file(NULL), width(0), height(0), offset(0), stride(0),
+                    bottom_up(false), layout(RASTER_RGBA) {}
+
+    // Seeks to the start of image row y
+    bool SeekRow (int y);
+
+    FILE *file;
+    int width, height;
+    int64_t offset;      // file position of the first stored row
+    int stride;          // bytes per stored row, padding included
+    bool bottom_up;      // rows stored last to first
+    RasterLayout layout;
+    std::vector<uint8_t> buffer;   // one stored row
+};
+
+
+/**
+ * RasterReader
+ **/
+class RasterReader : public RasterFile
+{
+public:
+    // Opens a PPM/PGM/PAM/BMP/TGA/.rgba file.  Returns NULL if the file cannot
+    // be read or is not in one of the supported variants.
+    static std::unique_ptr<RasterReader> Open (const char *fname);
+
+    // Reads rows [y, y + count) into dst as RGBA.
+    bool ReadRows (int y, int count, Pixel *dst);
+
+private:
+    bool ParsePNM ();
+    bool ParseBMP ();
+    bool ParseTGA ();
+    bool ParseRaw ();
+};
+
+
+/**
+ * RasterWriter
+ **/
+class RasterWriter : public RasterFile
+{
+public:
+    // Creates a width x height image file, choosing the format from the
+    // extension: .ppm, .pam, .bmp, .tga or .rgba.  Returns NULL for any other
+    // extension or if the file cannot be created.
+    static std::unique_ptr<RasterWriter> Open (const char *fname, int width, int height);
+
+    // Returns true if Open supports the extension of fname.
+    static bool Supports (const char *fname);
+
+    // Writes rows [y, y + count) from src.  Rows may come in any order.
+    bool WriteRows (int y, int count, const Pixel *src);
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "rawimage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char RAW_MAGIC[8] = { 'R', 'G', 'B', 'A', '8', 'I', 'M', 'G' };
+
+static uint32_t Get32 (const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+static void Put32 (uint8_t *p, uint32_t v) { p[0] = v & 255; p[1] = (v >> 8) & 255; p[2] = (v >> 16) & 255; p[3] = v >> 24; }
+
+bool IsRawImageFile (const char *fname)
+{
+	const char *ext = strrchr(fname, '.');
+	return ext && !strcmp(ext, ".rgba");
+}
+
+bool ParseRawImageHeader (const uint8_t *header, size_t size, int *width, int *height)
+{
+	if (size < 24 || memcmp(header, RAW_MAGIC, 8) || Get32(header + 8) != 1 ||
+	    Get32(header + 20) != RAW_IMAGE_HEADER_SIZE)
+		return false;
+	uint32_t w = Get32(header + 12), h = Get32(header + 16);
+	if (w == 0 || h == 0 || w > 0x7fffffff || h > 0x7fffffff) return false;
+	*width = (int) w;
+	*height = (int) h;
+	return true;
+}
+
+void MakeRawImageHeader (uint8_t header[RAW_IMAGE_HEADER_SIZE], int width, int height)
+{
+	memset(header, 0, RAW_IMAGE_HEADER_SIZE);
+	memcpy(header, RAW_MAGIC, 8);
+	Put32(header + 8, 1);
+	Put32(header + 12, width);
+	Put32(header + 16, height);
+	Put32(header + 20, RAW_IMAGE_HEADER_SIZE);
+}
+
+#ifndef _WIN32
+
+uint8_t* MapRawImage (const char *fname, int *width, int *height, void **mapping, size_t *mapping_size)
+{
+	int fd = open(fname, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	uint8_t header[24];
+	if (fstat(fd, &st) != 0 || pread(fd, header, sizeof(header), 0) != (ssize_t) sizeof(header) ||
+	    !ParseRawImageHeader(header, sizeof(header), width, height)) {
+		close(fd);
+		return NULL;
+	}
+	size_t size = RAW_IMAGE_HEADER_SIZE + (size_t) *width * *height * 4;
+	if ((size_t) st.st_size < size) {
+		close(fd);
+		return NULL;
+	}
+
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return NULL;
+
+	*mapping = map;
+	*mapping_size = size;
+	return (uint8_t *) map + RAW_IMAGE_HEADER_SIZE;
+}
+
+void UnmapRawImage (void *mapping, size_t mapping_size)
+{
+	munmap(mapping, mapping_size);
+}
+
+bool WriteRawImage (const char *fname, int width, int height, const uint8_t *pixels)
+{
+	// Written to a temporary file and renamed into place, so an image still
+	// mapped from fname (-input x.rgba -output x.rgba) is never truncated
+	// under its mapping.
+	std::string tmp = std::string(fname) + ".tmp";
+	size_t size = RAW_IMAGE_HEADER_SIZE + (size_t) width * height * 4;
+	int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+	void *map = MAP_FAILED;
+	if (ftruncate(fd, (off_t) size) == 0)
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		unlink(tmp.c_str());
+		return false;
+	}
+
+	MakeRawImageHeader((uint8_t *) map, width, height);
+	memcpy((uint8_t *) map + RAW_IMAGE_HEADER_SIZE, pixels, size - RAW_IMAGE_HEADER_SIZE);
+	munmap(map, size);
+	return rename(tmp.c_str(), fname) == 0;
+}
+
+#else
+
+// No mmap: read into an ordinary buffer instead
+uint8_t* MapRawImage (const char *fname, int *width, int *height, void **mapping, size_t *mapping_size)
+{
+	FILE *f = fopen(fname, "rb");
+	if (f == NULL) return NULL;
+	uint8_t header[24];
+	if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+	    !ParseRawImageHeader(header, sizeof(header), width, height)) {
+		fclose(f);
+		return NULL;
+	}
+	size_t bytes = (size_t) *width * *height * 4;
+	uint8_t *pixels = (uint8_t *) malloc(bytes);
+	bool ok = pixels && fseek(f, RAW_IMAGE_HEADER_SIZE, SEEK_SET) == 0 && fread(pixels, 1, bytes, f) == bytes;
+	fclose(f);
+	if (!ok) {
+		free(pixels);
+		return NULL;
+	}
+	*mapping = pixels;
+	*mapping_size = bytes;
+	return pixels;
+}
+
+void UnmapRawImage (void *mapping, size_t)
+{
+	free(mapping);
+}
+
+bool WriteRawImage (const char *fname, int width, int height, const uint8_t *pixels)
+{
+	FILE *f = fopen(fname, "wb");
+	if (f == NULL) return false;
+	uint8_t header[RAW_IMAGE_HEADER_SIZE];
+	MakeRawImageHeader(header, width, height);
+	size_t bytes = (size_t) width * height * 4;
+	bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) && fwrite(pixels, 1, bytes, f) == bytes;
+	return fclose(f) == 0 && ok;
+}
+
+#endif
@@ -0,0 +1,47 @@
+//rawimage.h
+//
+//Native uncompressed image format (.rgba) for passing images between runs.
+//
+//The file is a one page (4096 byte) header followed by width*height RGBA8
+//pixels, top row first.  The header starts with:
+//
+//  offset  size  field
+//       0     8  magic "RGBA8IMG"
+//       8     4  version (1), little endian
+//      12     4  width
+//      16     4  height
+//      20     4  offset of the pixel data (4096)
+//
+//Because the pixels start on a page boundary, a file can be memory mapped
+//and used directly as an Image's pixel buffer with no decoding or copying.
+
+#ifndef RAWIMAGE_INCLUDED
+#define RAWIMAGE_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RAW_IMAGE_HEADER_SIZE 4096
+
+// Returns true if fname ends in .rgba
+bool IsRawImageFile (const char *fname);
+
+// Parses the header at the start of a raw image file.  Returns false if
+// it is not a valid header.
+bool ParseRawImageHeader (const uint8_t *header, size_t size, int *width, int *height);
+
+// Fills a raw image header
+void MakeRawImageHeader (uint8_t header[RAW_IMAGE_HEADER_SIZE], int width, int height);
+
+// Maps a raw image file copy-on-write: changes to the pixels stay private
+// to this process.  Returns a pointer to the pixels and fills in the size
+// and the mapping to pass to UnmapRawImage, or returns NULL on failure.
+uint8_t* MapRawImage (const char *fname, int *width, int *height, void **mapping, size_t *mapping_size);
+
+// Releases a mapping made by MapRawImage.
+void UnmapRawImage (void *mapping, size_t mapping_size);
+
+// Writes pixels (width*height RGBA8) as a raw image file.
+bool WriteRawImage (const char *fname, int width, int height, const uint8_t *pixels);
+
+#endif
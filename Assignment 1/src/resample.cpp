@@ -0,0 +1,327 @@
+#include "resample.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define RESAMPLE_X86 1
+#include <emmintrin.h>
+#else
+#define RESAMPLE_X86 0
+#endif
+
+/**
+ * Filters
+ **/
+static double Sinc (double x)
+{
+	if (x == 0) return 1;
+	x *= M_PI;
+	return sin(x) / x;
+}
+
+double ResampleFilter (int method, double x)
+{
+	// Half open, so a point on the edge between two pixels takes the one
+	// whose [i, i + 1) it lies in
+	if (method == IMAGE_SAMPLING_BOX) return (x > -0.5 && x <= 0.5) ? 1 : 0;
+	x = fabs(x);
+	switch (method) {
+		case IMAGE_SAMPLING_TRIANGLE:
+			return (x < 1) ? 1 - x : 0;
+		case IMAGE_SAMPLING_MITCHELL: {
+			// Mitchell-Netravali with B = C = 1/3
+			const double B = 1.0/3, C = 1.0/3;
+			if (x < 1) return ((12 - 9*B - 6*C)*x*x*x + (-18 + 12*B + 6*C)*x*x + (6 - 2*B)) / 6;
+			if (x < 2) return ((-B - 6*C)*x*x*x + (6*B + 30*C)*x*x + (-12*B - 48*C)*x + (8*B + 24*C)) / 6;
+			return 0;
+		}
+		case IMAGE_SAMPLING_LANCZOS3:
+			return (x < 3) ? Sinc(x) * Sinc(x/3) : 0;
+		default:
+			assert(0);
+			return 0;
+	}
+}
+
+double ResampleSupport (int method)
+{
+	switch (method) {
+		case IMAGE_SAMPLING_BOX:      return 0.5;
+		case IMAGE_SAMPLING_TRIANGLE: return 1;
+		case IMAGE_SAMPLING_MITCHELL: return 2;
+		case IMAGE_SAMPLING_LANCZOS3: return 3;
+		default:
+			assert(0);
+			return 0;
+	}
+}
+
+
+/**
+ * Weight tables
+ **/
+#define RESAMPLE_BITS 14
+#define RESAMPLE_ONE (1 << RESAMPLE_BITS)
+
+// For each output position, a run of taps over consecutive source pixels
+struct ResampleTaps
+{
+	int count;                  // taps per output position
+	std::vector<int> first;     // first source pixel of each position
+	std::vector<int16_t> weights;
+
+	const int16_t *Weights (int i) const { return &weights[(size_t) i * count]; }
+};
+
+// Weights for mapping out_size output pixels onto in_size source pixels at
+// scale s.  Taps that fall past the edges go to the edge pixel.
+static ResampleTaps BuildTaps (int in_size, int out_size, double s, int method)
+{
+	double stretch = (s < 1) ? 1/s : 1;
+	double support = ResampleSupport(method) * stretch;
+
+	ResampleTaps taps;
+	taps.count = std::min((int) ceil(2*support) + 3, in_size);
+	taps.first.resize(out_size);
+	taps.weights.assign((size_t) out_size * taps.count, 0);
+
+	std::vector<double> w(in_size);
+	for (int x = 0; x < out_size; x++) {
+		double center = (x + 0.5) / s;
+		int lo = (int) floor(center - support - 0.5), hi = (int) ceil(center + support - 0.5);
+		// Every position reads count pixels from first, so keep them inside
+		int first = std::min(std::max(lo, 0), in_size - taps.count);
+		int last = std::min(std::max(hi, 0), first + taps.count - 1);
+
+		// Sum each source pixel's weight, folding the ones past the edges in
+		double total = 0;
+		std::fill(w.begin() + first, w.begin() + first + taps.count, 0.0);
+		for (int i = lo; i <= hi; i++) {
+			double weight = ResampleFilter(method, (i + 0.5 - center) / stretch);
+			w[std::min(std::max(i, first), last)] += weight;
+			total += weight;
+		}
+		if (total == 0) {
+			int nearest = std::min(std::max((int) floor(center), first), last);
+			w[nearest] = total = 1;
+		}
+
+		// Round to fixed point, then give the rounding error to the largest
+		// tap so the weights sum to exactly one
+		int16_t *out = &taps.weights[(size_t) x * taps.count];
+		int32_t sum = 0;
+		int largest = 0;
+		for (int i = first; i < first + taps.count; i++) {
+			out[i - first] = (int16_t) floor(w[i] / total * RESAMPLE_ONE + 0.5);
+			sum += out[i - first];
+			if (out[i - first] > out[largest]) largest = i - first;
+		}
+		out[largest] += RESAMPLE_ONE - sum;
+		taps.first[x] = first;
+	}
+
+	// The tap count above is an upper bound; cut it down to the widest run
+	// of nonzero weights, which saves a tap or more on every pixel
+	std::vector<int> lead(out_size);
+	int count = 1;
+	for (int x = 0; x < out_size; x++) {
+		const int16_t *w = taps.Weights(x);
+		int a = 0, b = taps.count - 1;
+		while (a < b && w[a] == 0) a++;
+		while (b > a && w[b] == 0) b--;
+		lead[x] = a;
+		count = std::max(count, b - a + 1);
+	}
+	ResampleTaps trimmed;
+	trimmed.count = count;
+	trimmed.first.resize(out_size);
+	trimmed.weights.assign((size_t) out_size * count, 0);
+	for (int x = 0; x < out_size; x++) {
+		int first = std::min(taps.first[x] + lead[x], in_size - count);
+		int offset = first - taps.first[x];
+		for (int k = 0; k < count && offset + k < taps.count; k++)
+			trimmed.weights[(size_t) x * count + k] = taps.Weights(x)[offset + k];
+		trimmed.first[x] = first;
+	}
+	return trimmed;
+}
+
+/**
+ * Row passes
+ **/
+// One source row through the horizontal weights, into four int16s per pixel
+static void HorizontalRowScalar (const Pixel *in, int16_t *out, const ResampleTaps &xt, int n)
+{
+	for (int x = 0; x < n; x++) {
+		const Pixel *p = in + xt.first[x];
+		const int16_t *w = xt.Weights(x);
+		int32_t r = RESAMPLE_ONE/2, g = RESAMPLE_ONE/2, b = RESAMPLE_ONE/2, a = RESAMPLE_ONE/2;
+		for (int k = 0; k < xt.count; k++) {
+			r += w[k] * p[k].r;
+			g += w[k] * p[k].g;
+			b += w[k] * p[k].b;
+			a += w[k] * p[k].a;
+		}
+		out[4*x + 0] = (int16_t) (r >> RESAMPLE_BITS);
+		out[4*x + 1] = (int16_t) (g >> RESAMPLE_BITS);
+		out[4*x + 2] = (int16_t) (b >> RESAMPLE_BITS);
+		out[4*x + 3] = (int16_t) (a >> RESAMPLE_BITS);
+	}
+}
+
+// Components [begin, n) of one output row from count intermediate rows
+static void VerticalRowScalar (const int16_t *const *rows, const int16_t *w, int count, Component *out, int begin, int n)
+{
+	for (int i = begin; i < n; i++) {
+		int32_t acc = RESAMPLE_ONE/2;
+		for (int k = 0; k < count; k++) acc += w[k] * rows[k][i];
+		out[i] = ComponentClamp(acc >> RESAMPLE_BITS);
+	}
+}
+
+#if RESAMPLE_X86
+
+// Two taps at a time: the taps' components interleaved as int16 pairs, so
+// one pmaddwd applies both weights to all four channels
+static inline __m128i WeightPair (const int16_t *w)
+{
+	int32_t pair;
+	memcpy(&pair, w, 4);
+	return _mm_set1_epi32(pair);
+}
+
+static void HorizontalRowSSE2 (const Pixel *in, int16_t *out, const ResampleTaps &xt, int n)
+{
+	const __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi32(RESAMPLE_ONE/2);
+	for (int x = 0; x < n; x++) {
+		const Pixel *p = in + xt.first[x];
+		const int16_t *w = xt.Weights(x);
+		__m128i acc = half;
+		int k = 0;
+		for (; k + 2 <= xt.count; k += 2) {
+			__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + k)), zero);
+			v = _mm_unpacklo_epi16(v, _mm_unpackhi_epi64(v, v));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(v, WeightPair(w + k)));
+		}
+		if (k < xt.count) {
+			int32_t bits;
+			memcpy(&bits, p + k, 4);
+			__m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero), zero);
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(v, _mm_set1_epi32((uint16_t) w[k])));
+		}
+		acc = _mm_srai_epi32(acc, RESAMPLE_BITS);
+		_mm_storel_epi64((__m128i *) (out + 4*x), _mm_packs_epi32(acc, acc));
+	}
+}
+
+static void VerticalRowSSE2 (const int16_t *const *rows, const int16_t *w, int count, Component *out, int n)
+{
+	const __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi32(RESAMPLE_ONE/2);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i lo = half, hi = half;
+		int k = 0;
+		for (; k + 2 <= count; k += 2) {
+			__m128i a = _mm_loadu_si128((const __m128i *) (rows[k] + i));
+			__m128i b = _mm_loadu_si128((const __m128i *) (rows[k + 1] + i));
+			__m128i wp = WeightPair(w + k);
+			lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wp));
+			hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wp));
+		}
+		if (k < count) {
+			__m128i a = _mm_loadu_si128((const __m128i *) (rows[k] + i));
+			__m128i wp = _mm_set1_epi32((uint16_t) w[k]);
+			lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), wp));
+			hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), wp));
+		}
+		__m128i v = _mm_packs_epi32(_mm_srai_epi32(lo, RESAMPLE_BITS), _mm_srai_epi32(hi, RESAMPLE_BITS));
+		_mm_storel_epi64((__m128i *) (out + i), _mm_packus_epi16(v, v));
+	}
+	VerticalRowScalar(rows, w, count, out, i, n);
+}
+
+#endif // RESAMPLE_X86
+
+
+/**
+ * Resample
+ **/
+void Resample (const Image &src, Image &dst, double sx, double sy, int method)
+{
+	assert(IsResampleFilter(method));
+	int src_w = src.Width(), src_h = src.Height();
+	int dst_w = dst.Width(), dst_h = dst.Height();
+	if (dst_w == 0 || dst_h == 0 || src_w == 0 || src_h == 0) return;
+	bool simd = RESAMPLE_X86 && SimdLevel() >= SIMD_SSE2;
+
+	ResampleTaps xt = BuildTaps(src_w, dst_w, sx, method);
+	ResampleTaps yt = BuildTaps(src_h, dst_h, sy, method);
+
+	// Horizontal pass, only over the source rows the vertical pass reads.
+	// Values stay unclamped, rounded to integers, four per pixel.
+	int row_lo = yt.first[0], row_hi = yt.first[dst_h - 1] + yt.count - 1;
+	int rows = row_hi - row_lo + 1, n = dst_w * 4;
+	std::vector<int16_t> mid((size_t) rows * n);
+	ParallelFor(rows, [&](int r0, int r1) {
+		for (int r = r0; r < r1; r++) {
+#if RESAMPLE_X86
+			if (simd) {
+				HorizontalRowSSE2(src.Row(row_lo + r), &mid[(size_t) r * n], xt, dst_w);
+				continue;
+			}
+#endif
+			HorizontalRowScalar(src.Row(row_lo + r), &mid[(size_t) r * n], xt, dst_w);
+		}
+	});
+
+	// Vertical pass
+	ParallelFor(dst_h, [&](int y0, int y1) {
+		std::vector<const int16_t *> in(yt.count);
+		for (int y = y0; y < y1; y++) {
+			for (int k = 0; k < yt.count; k++) in[k] = &mid[(size_t) (yt.first[y] + k - row_lo) * n];
+			Component *out = &dst.Row(y)->r;
+#if RESAMPLE_X86
+			if (simd) {
+				VerticalRowSSE2(in.data(), yt.Weights(y), yt.count, out, n);
+				continue;
+			}
+#endif
+			VerticalRowScalar(in.data(), yt.Weights(y), yt.count, out, 0, n);
+		}
+	});
+}
+
+Pixel ResampleAt (const Image &src, double u, double v, int method)
+{
+	double support = ResampleSupport(method);
+	int x0 = (int) floor(u - support - 0.5), x1 = (int) ceil(u + support - 0.5);
+	int y0 = (int) floor(v - support - 0.5), y1 = (int) ceil(v + support - 0.5);
+	double sum[4] = { 0, 0, 0, 0 }, total = 0;
+	for (int y = y0; y <= y1; y++) {
+		double wy = ResampleFilter(method, y + 0.5 - v);
+		if (wy == 0) continue;
+		const Pixel *row = src.Row(std::min(std::max(y, 0), src.Height() - 1));
+		for (int x = x0; x <= x1; x++) {
+			double w = wy * ResampleFilter(method, x + 0.5 - u);
+			if (w == 0) continue;
+			const Pixel &p = row[std::min(std::max(x, 0), src.Width() - 1)];
+			sum[0] += w * p.r;
+			sum[1] += w * p.g;
+			sum[2] += w * p.b;
+			sum[3] += w * p.a;
+			total += w;
+		}
+	}
+	if (total == 0) return src.GetPixel((int) u, (int) v);
+	Pixel p;
+	p.r = ComponentClamp((int) floor(sum[0] / total + 0.5));
+	p.g = ComponentClamp((int) floor(sum[1] / total + 0.5));
+	p.b = ComponentClamp((int) floor(sum[2] / total + 0.5));
+	p.a = ComponentClamp((int) floor(sum[3] / total + 0.5));
+	return p;
+}
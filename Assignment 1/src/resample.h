@@ -0,0 +1,38 @@
+//resample.h
+//
+//Separable resampling with the box, triangle, Mitchell and Lanczos3
+//filters (IMAGE_SAMPLING_BOX and up).
+//
+//Pixel i covers [i, i + 1), so its center is at i + 0.5.  Output pixel x of
+//a scale by s is centered on x + 0.5 in the output, which is (x + 0.5) / s
+//in the source.  When minifying, the filter is stretched by 1/s so that
+//every source pixel contributes.  Source pixels past the edges repeat the
+//edge pixel.
+//
+//Resample runs a horizontal pass into a 16-bit intermediate image, then a
+//vertical pass.  The weights for every output column and row are computed
+//once, in 14-bit fixed point summing to exactly one, so flat areas stay
+//flat.
+
+#ifndef RESAMPLE_INCLUDED
+#define RESAMPLE_INCLUDED
+
+#include "image.h"
+
+// Returns true if method is one of the resampling filters.
+inline bool IsResampleFilter (int method)
+{
+    return method >= IMAGE_SAMPLING_BOX && method <= IMAGE_SAMPLING_LANCZOS3;
+}
+
+// The filter's weight at distance x, and the distance past which it is 0
+double ResampleFilter(int method, double x);
+double ResampleSupport(int method);
+
+// Fills dst (of any size) from src, mapping dst (x, y) to src (x / sx, y / sy).
+void Resample(const Image &src, Image &dst, double sx, double sy, int method);
+
+// Filters src at the point (u, v) at its own scale.
+Pixel ResampleAt(const Image &src, double u, double v, int method);
+
+#endif
@@ -0,0 +1,134 @@
+#include "stats.h"
+#include "parallel.h"
+#include <math.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+// Pixels per chunk of a row whose luminance is computed at once
+#define STATS_CHUNK 256
+
+/**
+ * Histograms
+ **/
+void ComputeStats (const Image &img, ImageStats *stats)
+{
+	int width = img.Width();
+	stats->width = width;
+	stats->height = img.Height();
+	memset(stats->histogram, 0, sizeof(stats->histogram));
+
+	std::mutex merge;
+	ParallelFor(img.Height(), [&](int y0, int y1) {
+		// Two copies of each histogram, for even and odd pixels, so runs of
+		// equal values do not make every increment wait for the last one
+		assert((int64_t) width * (y1 - y0) <= UINT32_MAX);
+		std::vector<uint32_t> counts(2 * INTEGRAL_N_CHANNELS * 256, 0);
+		uint32_t *even = &counts[0], *odd = &counts[INTEGRAL_N_CHANNELS * 256];
+		uint8_t luminance[STATS_CHUNK];
+
+		for (int y = y0; y < y1; y++) {
+			const Pixel *row = img.Row(y);
+			for (int x0 = 0; x0 < width; x0 += STATS_CHUNK) {
+				int n = (width - x0 < STATS_CHUNK) ? width - x0 : STATS_CHUNK;
+				const Pixel *p = row + x0;
+				// Pixel::Luminance, in a loop the compiler vectorizes
+				for (int i = 0; i < n; i++) luminance[i] = (uint8_t) ((p[i].r * 76 + p[i].g * 150 + p[i].b * 29) >> 8);
+				int i = 0;
+				for (; i + 2 <= n; i += 2) {
+					even[INTEGRAL_R*256 + p[i].r]++;
+					even[INTEGRAL_G*256 + p[i].g]++;
+					even[INTEGRAL_B*256 + p[i].b]++;
+					even[INTEGRAL_A*256 + p[i].a]++;
+					even[INTEGRAL_LUMINANCE*256 + luminance[i]]++;
+					odd[INTEGRAL_R*256 + p[i + 1].r]++;
+					odd[INTEGRAL_G*256 + p[i + 1].g]++;
+					odd[INTEGRAL_B*256 + p[i + 1].b]++;
+					odd[INTEGRAL_A*256 + p[i + 1].a]++;
+					odd[INTEGRAL_LUMINANCE*256 + luminance[i + 1]]++;
+				}
+				if (i < n) {
+					even[INTEGRAL_R*256 + p[i].r]++;
+					even[INTEGRAL_G*256 + p[i].g]++;
+					even[INTEGRAL_B*256 + p[i].b]++;
+					even[INTEGRAL_A*256 + p[i].a]++;
+					even[INTEGRAL_LUMINANCE*256 + luminance[i]]++;
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(merge);
+		for (int c = 0; c < INTEGRAL_N_CHANNELS; c++) {
+			for (int v = 0; v < 256; v++) stats->histogram[c][v] += even[c*256 + v] + odd[c*256 + v];
+		}
+	});
+}
+
+
+/**
+ * Derived statistics
+ **/
+int64_t ImageStats::Sum (int channel) const
+{
+	int64_t sum = 0;
+	for (int v = 0; v < 256; v++) sum += histogram[channel][v] * v;
+	return sum;
+}
+
+int ImageStats::Min (int channel) const
+{
+	for (int v = 0; v < 256; v++) if (histogram[channel][v]) return v;
+	return 0;
+}
+
+int ImageStats::Max (int channel) const
+{
+	for (int v = 255; v >= 0; v--) if (histogram[channel][v]) return v;
+	return 0;
+}
+
+double ImageStats::Mean (int channel) const
+{
+	return Count() ? (double) Sum(channel) / Count() : 0;
+}
+
+double ImageStats::Variance (int channel) const
+{
+	if (!Count()) return 0;
+	double mean = Mean(channel), variance = 0;
+	for (int v = 0; v < 256; v++) variance += histogram[channel][v] * (v - mean) * (v - mean);
+	return variance / Count();
+}
+
+int ImageStats::Percentile (int channel, double p) const
+{
+	double target = p * Count();
+	int64_t below = 0;
+	for (int v = 0; v < 256; v++) {
+		below += histogram[channel][v];
+		if (below > 0 && below >= target) return v;
+	}
+	return 255;
+}
+
+
+/**
+ * JSON
+ **/
+void WriteStatsJSON (FILE *f, const ImageStats &stats)
+{
+	static const char *names[INTEGRAL_N_CHANNELS] = { "red", "green", "blue", "alpha", "luminance" };
+	fprintf(f, "{\n  \"width\": %d,\n  \"height\": %d,\n  \"pixels\": %lld", stats.width, stats.height, (long long) stats.Count());
+	for (int c = 0; c < INTEGRAL_N_CHANNELS; c++) {
+		fprintf(f, ",\n  \"%s\": {\n", names[c]);
+		fprintf(f, "    \"min\": %d, \"max\": %d, \"mean\": %.4f, \"stddev\": %.4f,\n",
+		        stats.Min(c), stats.Max(c), stats.Mean(c), sqrt(stats.Variance(c)));
+		fprintf(f, "    \"p1\": %d, \"p5\": %d, \"p50\": %d, \"p95\": %d, \"p99\": %d,\n",
+		        stats.Percentile(c, 0.01), stats.Percentile(c, 0.05), stats.Percentile(c, 0.5),
+		        stats.Percentile(c, 0.95), stats.Percentile(c, 0.99));
+		fprintf(f, "    \"histogram\": [");
+		for (int v = 0; v < 256; v++) fprintf(f, "%s%lld", v ? ", " : "", (long long) stats.histogram[c][v]);
+		fprintf(f, "]\n  }");
+	}
+	fprintf(f, "\n}\n");
+}
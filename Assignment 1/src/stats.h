@@ -0,0 +1,42 @@
+//stats.h
+//
+//Whole-image statistics.
+//
+//ComputeStats makes one pass over the pixels and fills a 256-bin histogram
+//for each channel of integral.h (red, green, blue, alpha and luminance).
+//Each band of rows counts into its own private histograms, merged at the
+//end.  Everything else (counts, sums, extrema, moments and percentiles) is
+//worked out from the histograms, so it costs no further passes.  Counts
+//are integers, so the results do not depend on the thread count.
+
+#ifndef STATS_INCLUDED
+#define STATS_INCLUDED
+
+#include "image.h"
+#include "integral.h"
+#include <stdint.h>
+#include <stdio.h>
+
+struct ImageStats
+{
+    int width, height;
+    int64_t histogram[INTEGRAL_N_CHANNELS][256];
+
+    int64_t Count () const { return (int64_t) width * height; }
+    int64_t Sum(int channel) const;
+    int Min(int channel) const;   // 0 for an empty image
+    int Max(int channel) const;
+    double Mean(int channel) const;
+    double Variance(int channel) const;
+
+    // The smallest value with at least a fraction p of the pixels at or
+    // below it
+    int Percentile(int channel, double p) const;
+};
+
+void ComputeStats(const Image &img, ImageStats *stats);
+
+// Writes stats as a JSON object, one member per channel.
+void WriteStatsJSON(FILE *f, const ImageStats &stats);
+
+#endif
@@ -0,0 +1,10 @@
+//stb_impl.cpp
+//
+//Compiles the stb_image and stb_image_write implementations into the image
+//library, so every program linking it (hw1, hw1_bench) gets them once.
+
+#define STB_IMAGE_IMPLEMENTATION //only place once in one .cpp file
+#include "stb_image.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION //only place once in one .cpp files
+#include "stb_image_write.h"
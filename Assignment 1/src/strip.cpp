@@ -0,0 +1,42 @@
+#include "strip.h"
+#include "rasterfile.h"
+
+void StripPipeline::Add (int halo, const std::function<void(Image *)>& op)
+{
+	Stage stage = { halo, op };
+	stages.push_back(stage);
+}
+
+bool StripPipeline::Run (const char *fin, const char *fout, int strip_rows) const
+{
+	std::unique_ptr<RasterReader> in = RasterReader::Open(fin);
+	if (in == NULL) {
+		fprintf(stderr, "Cannot stream %s: need binary PPM/PGM/PAM, BMP, uncompressed TGA or .rgba\n", fin);
+		return false;
+	}
+	int width = in->Width(), height = in->Height();
+	std::unique_ptr<RasterWriter> out = RasterWriter::Open(fout, width, height);
+	if (out == NULL) {
+		fprintf(stderr, "Cannot stream to %s: need .ppm, .pam, .bmp, .tga or .rgba\n", fout);
+		return false;
+	}
+
+	int halo = 0;
+	for (size_t i = 0; i < stages.size(); i++) halo += stages[i].halo;
+	if (strip_rows < 1) strip_rows = 1;
+
+	bool ok = true;
+	for (int y0 = 0; y0 < height && ok; y0 += strip_rows) {
+		int y1 = (y0 + strip_rows < height) ? y0 + strip_rows : height;
+		int top = (y0 - halo > 0) ? y0 - halo : 0;
+		int bottom = (y1 + halo < height) ? y1 + halo : height;
+
+		Image strip(width, bottom - top);
+		ok = in->ReadRows(top, bottom - top, strip.Row(0));
+		for (size_t i = 0; i < stages.size() && ok; i++) stages[i].op(&strip);
+		ok = ok && out->WriteRows(y0, y1 - y0, strip.Row(y0 - top));
+	}
+	if (!ok) fprintf(stderr, "I/O error while streaming %s to %s\n", fin, fout);
+
+	return ok;
+}
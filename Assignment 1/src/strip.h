@@ -0,0 +1,41 @@
+//strip.h
+//
+//Streams an image file through a chain of operations a strip of rows at a
+//time, so peak memory grows with the strip height times the width rather
+//than with the whole image.
+//
+//Each stage declares its halo: how many rows above and below an output row
+//it reads.  A strip is loaded with the sum of all halos on either side, the
+//stages run on it with the ordinary Image methods, and only the rows whose
+//whole footprint was loaded are written out.  At the top and bottom of the
+//image the strip edge is the image edge, so borders come out the same as
+//when processing the full image.
+
+#ifndef STRIP_INCLUDED
+#define STRIP_INCLUDED
+
+#include "image.h"
+#include <functional>
+#include <vector>
+
+class StripPipeline
+{
+public:
+    // Queues an operation that reads up to halo rows above and below each
+    // row it writes.  op must keep the image size unchanged.
+    void Add (int halo, const std::function<void(Image *)>& op);
+
+    // Streams fin (PPM/PGM/PAM/BMP/uncompressed TGA/.rgba) through the queued operations into
+    // fout (.ppm/.pam/.bmp/.tga/.rgba), strip_rows output rows at a time.
+    // Returns false and prints a message if either file cannot be handled.
+    bool Run (const char *fin, const char *fout, int strip_rows) const;
+
+private:
+    struct Stage {
+        int halo;
+        std::function<void(Image *)> op;
+    };
+    std::vector<Stage> stages;
+};
+
+#endif
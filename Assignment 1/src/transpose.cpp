@@ -0,0 +1,110 @@
+#include "transpose.h"
+#include "parallel.h"
+#include "pixelrow.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TRANSPOSE_X86 1
+#include <emmintrin.h>
+#else
+#define TRANSPOSE_X86 0
+#endif
+
+static_assert(sizeof(Pixel) == 4, "pixels are moved as 32-bit words");
+
+// Blocks with both sides at most this are transposed directly.  Two 32x32
+// blocks of pixels fit in 8K of cache.
+#define TRANSPOSE_BLOCK 32
+
+/**
+ * Tiles
+ **/
+static void TransposeBlockScalar (const Pixel *src, ptrdiff_t src_stride, Pixel *dst, ptrdiff_t dst_stride, int w, int h)
+{
+	for (int x = 0; x < w; x++) {
+		Pixel *out = dst + x * dst_stride;
+		for (int y = 0; y < h; y++) out[y] = src[y * src_stride + x];
+	}
+}
+
+#if TRANSPOSE_X86
+// 4x4 tiles with unpacks, then the ragged right and bottom edges
+static void TransposeBlockSSE2 (const Pixel *src, ptrdiff_t src_stride, Pixel *dst, ptrdiff_t dst_stride, int w, int h)
+{
+	int w4 = w & ~3, h4 = h & ~3;
+	for (int y = 0; y < h4; y += 4) {
+		const Pixel *in = src + y * src_stride;
+		for (int x = 0; x < w4; x += 4) {
+			__m128i r0 = _mm_loadu_si128((const __m128i *) (in + x));
+			__m128i r1 = _mm_loadu_si128((const __m128i *) (in + src_stride + x));
+			__m128i r2 = _mm_loadu_si128((const __m128i *) (in + 2*src_stride + x));
+			__m128i r3 = _mm_loadu_si128((const __m128i *) (in + 3*src_stride + x));
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			__m128i t1 = _mm_unpackhi_epi32(r0, r1);
+			__m128i t2 = _mm_unpacklo_epi32(r2, r3);
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+			Pixel *out = dst + x * dst_stride + y;
+			_mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi64(t0, t2));
+			_mm_storeu_si128((__m128i *) (out + dst_stride), _mm_unpackhi_epi64(t0, t2));
+			_mm_storeu_si128((__m128i *) (out + 2*dst_stride), _mm_unpacklo_epi64(t1, t3));
+			_mm_storeu_si128((__m128i *) (out + 3*dst_stride), _mm_unpackhi_epi64(t1, t3));
+		}
+	}
+	if (w4 < w) TransposeBlockScalar(src + w4, src_stride, dst + w4 * dst_stride, dst_stride, w - w4, h);
+	if (h4 < h) TransposeBlockScalar(src + h4 * src_stride, src_stride, dst + h4, dst_stride, w4, h - h4);
+}
+#endif
+
+// Halves the longer side until the block fits in cache
+static void TransposeRecursive (const Pixel *src, ptrdiff_t src_stride, Pixel *dst, ptrdiff_t dst_stride, int w, int h, bool simd)
+{
+	if (w <= TRANSPOSE_BLOCK && h <= TRANSPOSE_BLOCK) {
+#if TRANSPOSE_X86
+		if (simd) {
+			TransposeBlockSSE2(src, src_stride, dst, dst_stride, w, h);
+			return;
+		}
+#endif
+		TransposeBlockScalar(src, src_stride, dst, dst_stride, w, h);
+		return;
+	}
+	// Split on a multiple of 4 so the halves stay in whole tiles
+	if (w >= h) {
+		int half = (w / 2 + 3) & ~3;
+		TransposeRecursive(src, src_stride, dst, dst_stride, half, h, simd);
+		TransposeRecursive(src + half, src_stride, dst + half * dst_stride, dst_stride, w - half, h, simd);
+	} else {
+		int half = (h / 2 + 3) & ~3;
+		TransposeRecursive(src, src_stride, dst, dst_stride, w, half, simd);
+		TransposeRecursive(src + half * src_stride, src_stride, dst + half, dst_stride, w, h - half, simd);
+	}
+}
+
+void TransposePixels (const Pixel *src, ptrdiff_t src_stride, Pixel *dst, ptrdiff_t dst_stride, int w, int h)
+{
+	bool simd = TRANSPOSE_X86 && SimdLevel() >= SIMD_SSE2;
+	// Threads take bands of source columns, which are bands of dst rows
+	int bands = (w + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+	ParallelFor(bands, [&](int b0, int b1) {
+		int x0 = b0 * TRANSPOSE_BLOCK;
+		int x1 = (b1 * TRANSPOSE_BLOCK < w) ? b1 * TRANSPOSE_BLOCK : w;
+		TransposeRecursive(src + x0, src_stride, dst + x0 * dst_stride, dst_stride, x1 - x0, h, simd);
+	});
+}
+
+
+/**
+ * Reversal
+ **/
+void ReversePixels (const Pixel *src, Pixel *dst, int n)
+{
+	int i = 0;
+#if TRANSPOSE_X86
+	if (SimdLevel() >= SIMD_SSE2) {
+		for (; i + 4 <= n; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + n - 4 - i));
+			_mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+		}
+	}
+#endif
+	for (; i < n; i++) dst[i] = src[n - 1 - i];
+}
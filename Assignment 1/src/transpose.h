@@ -0,0 +1,25 @@
+//transpose.h
+//
+//Lossless reorientation: transposes, quarter turns and flips move whole
+//32-bit pixels and never resample.
+//
+//The transpose splits the larger side of the image in half until the
+//pieces fit in cache, whatever the cache sizes are, then moves 4x4 tiles
+//with SSE2 shuffles.  Strides are in pixels and may be negative, so a
+//quarter turn is a transpose that reads or writes the rows bottom up.
+
+#ifndef TRANSPOSE_INCLUDED
+#define TRANSPOSE_INCLUDED
+
+#include "pixel.h"
+#include <stddef.h>
+
+// Writes the w x h block at src (rows src_stride pixels apart) into dst as
+// h x w: pixel x of src row y goes to pixel y of dst row x.
+void TransposePixels(const Pixel *src, ptrdiff_t src_stride, Pixel *dst, ptrdiff_t dst_stride, int w, int h);
+
+// Writes the n pixels at src into dst in reverse order.  src and dst must
+// not overlap.
+void ReversePixels(const Pixel *src, Pixel *dst, int n);
+
+#endif
@@ -0,0 +1,140 @@
+//traverse.h
+//
+//Row-major traversal helpers for Image operations.
+//
+//Pixels are stored row by row, so these walk rows in memory order and hand
+//the callback direct references.  Bounds checks and border handling are
+//done once per row or once per call instead of once per pixel.  Rows are
+//split into bands with ParallelFor unless TRAVERSE_SERIAL is requested
+//(for callbacks that must see the pixels in order, e.g. ones calling rand()).
+
+#ifndef TRAVERSE_INCLUDED
+#define TRAVERSE_INCLUDED
+
+#include "image.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <vector>
+
+enum TraverseOrder {
+    TRAVERSE_PARALLEL,
+    TRAVERSE_SERIAL
+};
+
+
+/**
+ * Border policies: map any coordinate into [0, n)
+ **/
+
+// Reflects about the edge pixels: -1 -> 1, n -> n-2
+struct MirrorBorder
+{
+    static int Map (int i, int n)
+    {
+        if (n == 1) return 0;
+        int period = 2 * (n - 1);
+        i = abs(i) % period;
+        return (i < n) ? i : period - i;
+    }
+};
+
+// The convention EdgeDetect has always used: -1 -> 1 on the low side but
+// n -> n-1 on the high side.  Only valid within one image size of the edge.
+struct AbsMirrorBorder
+{
+    static int Map (int i, int n)
+    {
+        i = abs(i);
+        return (i >= n) ? 2*n - 1 - i : i;
+    }
+};
+
+// Repeats the edge pixels
+struct ClampBorder
+{
+    static int Map (int i, int n) { return (i < 0) ? 0 : (i >= n) ? n - 1 : i; }
+};
+
+// Tiles the image: -1 -> n-1, n -> 0
+struct WrapBorder
+{
+    static int Map (int i, int n) { i %= n;  return (i < 0) ? i + n : i; }
+};
+
+
+/**
+ * Row and pixel traversal
+ **/
+
+// Calls fn(Pixel *row, int y) for every row of img.
+template <class Fn>
+void ForEachRow (const Image &img, Fn fn, TraverseOrder order = TRAVERSE_PARALLEL)
+{
+    auto band = [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) fn(img.Row(y), y);
+    };
+    if (order == TRAVERSE_SERIAL)
+        band(0, img.Height());
+    else
+        ParallelFor(img.Height(), band);
+}
+
+// Calls fn(Pixel &p) for every pixel of img.
+template <class Fn>
+void ForEachPixel (const Image &img, Fn fn, TraverseOrder order = TRAVERSE_PARALLEL)
+{
+    int width = img.Width();
+    ForEachRow(img, [&](Pixel *row, int) {
+        for (int x = 0; x < width; x++) fn(row[x]);
+    }, order);
+}
+
+// Calls fn(Pixel &p, int x, int y) for every pixel of img.
+template <class Fn>
+void ForEachPixelXY (const Image &img, Fn fn, TraverseOrder order = TRAVERSE_PARALLEL)
+{
+    int width = img.Width();
+    ForEachRow(img, [&](Pixel *row, int y) {
+        for (int x = 0; x < width; x++) fn(row[x], x, y);
+    }, order);
+}
+
+
+/**
+ * Neighborhood traversal
+ **/
+
+// The (2R+1) x (2R+1) window around a pixel.  nb(dx, dy) is the source
+// pixel at offset (dx, dy), with the border policy already applied.
+template <int R>
+struct Neighborhood
+{
+    const Pixel *const *rows;   // 2R+1 source rows, top to bottom
+    const int *cols;            // 2R+1 source columns, left to right
+
+    const Pixel& operator() (int dx, int dy) const { return rows[dy + R][cols[dx + R]]; }
+};
+
+// Calls fn(const Neighborhood<R> &nb, Pixel &out) for every pixel of dst,
+// where nb is centered on the same coordinates in src.  src and dst must
+// be the same size and must not share pixels.  Column borders are mapped
+// once per call and row borders once per row, so the per-pixel work has
+// no branches.
+template <int R, class Border = MirrorBorder, class Fn>
+void ForEachNeighborhood (const Image &src, const Image &dst, Fn fn)
+{
+    assert(src.Width() == dst.Width() && src.Height() == dst.Height());
+    int width = src.Width(), height = src.Height();
+
+    std::vector<int> colMap(width + 2*R);
+    for (int x = -R; x < width + R; x++) colMap[x + R] = Border::Map(x, width);
+
+    ForEachRow(dst, [&](Pixel *out, int y) {
+        const Pixel *rows[2*R + 1];
+        for (int k = -R; k <= R; k++) rows[k + R] = src.Row(Border::Map(y + k, height));
+        Neighborhood<R> nb = { rows, colMap.data() };
+        for (int x = 0; x < width; x++, nb.cols++) fn(nb, out[x]);
+    });
+}
+
+#endif
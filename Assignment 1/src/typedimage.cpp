@@ -0,0 +1,318 @@
+#include "typedimage.h"
+#include "rawimage.h"
+#include "traverse.h"
+#include <string.h>
+#include <vector>
+
+// Pixel::Luminance, without rounding to an integer
+template <class PixelT>
+static inline double Luminance (const PixelT &p)
+{
+	return (p.r * 76.0 + p.g * 150.0 + p.b * 29.0) / 256;
+}
+
+
+/**
+ * Construction and conversion
+ **/
+template <class PixelT>
+TypedImage<PixelT>::TypedImage (int width_, int height_)
+	: width(width_), height(height_), buffer((size_t) width_ * height_ * sizeof(PixelT))
+{
+	assert(width_ > 0);
+	assert(height_ > 0);
+}
+
+template <class PixelT>
+TypedImage<PixelT>::TypedImage (const Image &src) : TypedImage(src.Width(), src.Height())
+{
+	const double scale = ChannelTraits<Channel>::white / 255;
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const Component *s = &src.Row(y)->r;
+			Channel *d = &Row(y)->r;
+			for (int i = 0; i < width * 4; i++) d[i] = ChannelTraits<Channel>::From(s[i] * scale);
+		}
+	});
+}
+
+template <class PixelT>
+Image TypedImage<PixelT>::ToImage () const
+{
+	Image img(width, height);
+	const double scale = 255 / ChannelTraits<Channel>::white;
+	ForEachRow(img, [&](Pixel *row, int y) {
+		const Channel *s = &Row(y)->r;
+		Component *d = &row->r;
+		for (int i = 0; i < width * 4; i++) d[i] = ChannelTraits<uint8_t>::From(s[i] * scale);
+	});
+	return img;
+}
+
+
+/**
+ * Point ops
+ **/
+template <class PixelT>
+void TypedImage<PixelT>::Brighten (double factor)
+{
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			Channel *c = &Row(y)->r;
+			for (int i = 0; i < width * 4; i++) c[i] = ChannelTraits<Channel>::From(c[i] * factor);
+		}
+	});
+}
+
+template <class PixelT>
+void TypedImage<PixelT>::ChangeContrast (double factor)
+{
+	factor = factor - 1;
+	// Summed by row, then the rows in order, so any thread count agrees
+	std::vector<double> rowSums(height);
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const PixelT *row = Row(y);
+			double sum = 0;
+			for (int x = 0; x < width; x++) sum += Luminance(row[x]);
+			rowSums[y] = sum;
+		}
+	});
+	double total = 0;
+	for (int y = 0; y < height; y++) total += rowSums[y];
+	double gray = total / ((double) width * height);
+
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			PixelT *row = Row(y);
+			for (int x = 0; x < width; x++) {
+				PixelT &p = row[x];
+				p.r = ChannelTraits<Channel>::From(p.r + (p.r - gray) * factor);
+				p.g = ChannelTraits<Channel>::From(p.g + (p.g - gray) * factor);
+				p.b = ChannelTraits<Channel>::From(p.b + (p.b - gray) * factor);
+			}
+		}
+	});
+}
+
+template <class PixelT>
+void TypedImage<PixelT>::ChangeSaturation (double factor)
+{
+	factor = factor - 1;
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			PixelT *row = Row(y);
+			for (int x = 0; x < width; x++) {
+				PixelT &p = row[x];
+				double gray = Luminance(p);
+				p.r = ChannelTraits<Channel>::From(p.r + (p.r - gray) * factor);
+				p.g = ChannelTraits<Channel>::From(p.g + (p.g - gray) * factor);
+				p.b = ChannelTraits<Channel>::From(p.b + (p.b - gray) * factor);
+			}
+		}
+	});
+}
+
+template <class PixelT>
+void TypedImage<PixelT>::ExtractChannel (int channel)
+{
+	if (channel < IMAGE_CHANNEL_RED || channel > IMAGE_CHANNEL_BLUE) return;
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			PixelT *row = Row(y);
+			for (int x = 0; x < width; x++) {
+				Channel *c = &row[x].r;
+				for (int k = 0; k < 3; k++) if (k != channel) c[k] = 0;
+			}
+		}
+	});
+}
+
+
+/**
+ * Neighborhood ops
+ **/
+template <class PixelT>
+TypedImage<PixelT> TypedImage<PixelT>::Crop (int x, int y, int w, int h) const
+{
+	assert(x >= 0 && y >= 0 && x + w <= width && y + h <= height);
+	TypedImage newImg(w, h);
+	ParallelFor(h, [&](int y0, int y1) {
+		for (int cy = y0; cy < y1; cy++) memcpy(newImg.Row(cy), Row(y + cy) + x, w * sizeof(PixelT));
+	});
+	return newImg;
+}
+
+// Image::Blur's separable passes, through a float scratch image, rounding
+// once at the end
+template <class PixelT>
+void TypedImage<PixelT>::Blur (int n)
+{
+	if (n <= 0) return;
+
+	int radius = 3*n;
+	int taps = 2*radius + 1;
+	std::vector<float> kernel = GaussianKernel(n, radius);
+	std::vector<float> tmp((size_t) width * height * 4);
+
+	ParallelFor(height, [&](int y0, int y1) {
+		std::vector<float> pad((size_t) (width + 2*radius) * 4);
+		for (int y = y0; y < y1; y++) {
+			const Channel *src = &Row(y)->r;
+			for (int x = -radius; x < width + radius; x++) {
+				const Channel *s = src + MirrorBorder::Map(x, width)*4;
+				float *d = &pad[(x + radius)*4];
+				d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = s[3];
+			}
+			float *dst = &tmp[(size_t) y*width*4];
+			for (int x = 0; x < width; x++) {
+				const float *s = &pad[x*4];
+				float r = 0, g = 0, b = 0, a = 0;
+				for (int k = 0; k < taps; k++) {
+					float w = kernel[k];
+					r += w * s[k*4 + 0];
+					g += w * s[k*4 + 1];
+					b += w * s[k*4 + 2];
+					a += w * s[k*4 + 3];
+				}
+				dst[x*4 + 0] = r; dst[x*4 + 1] = g; dst[x*4 + 2] = b; dst[x*4 + 3] = a;
+			}
+		}
+	});
+
+	ParallelFor(height, [&](int y0, int y1) {
+		std::vector<float> acc((size_t) width * 4);
+		for (int y = y0; y < y1; y++) {
+			for (int i = 0; i < width*4; i++) acc[i] = 0;
+			for (int k = -radius; k <= radius; k++) {
+				const float *src = &tmp[(size_t) MirrorBorder::Map(y + k, height)*width*4];
+				float w = kernel[k + radius];
+				for (int i = 0; i < width*4; i++) acc[i] += w * src[i];
+			}
+			Channel *dst = &Row(y)->r;
+			for (int i = 0; i < width*4; i++) dst[i] = ChannelTraits<Channel>::From(acc[i]);
+		}
+	});
+}
+
+// Image::BlurFast's box passes, on the channels as floats
+template <class PixelT>
+void TypedImage<PixelT>::BlurFast (double sigma)
+{
+	if (sigma <= 0) return;
+
+	std::vector<float> a((size_t) width * height * 4);
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const Channel *src = &Row(y)->r;
+			float *dst = &a[(size_t) y*width*4];
+			for (int i = 0; i < width*4; i++) dst[i] = src[i];
+		}
+	});
+
+	BoxBlurPasses(a.data(), width, height, sigma);
+
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const float *src = &a[(size_t) y*width*4];
+			Channel *dst = &Row(y)->r;
+			for (int i = 0; i < width*4; i++) dst[i] = ChannelTraits<Channel>::From(src[i]);
+		}
+	});
+}
+
+// Extrapolates away from the Gaussian blur, 2p - blur(p), switching to
+// the box passes at the same sigma as Image::Sharpen
+template <class PixelT>
+void TypedImage<PixelT>::Sharpen (int n)
+{
+	TypedImage blurred(*this);
+	if (n >= SHARPEN_FAST_BLUR_SIGMA)
+		blurred.BlurFast(n);
+	else
+		blurred.Blur(n);
+	ParallelFor(height, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			Channel *c = &Row(y)->r;
+			const Channel *b = &blurred.Row(y)->r;
+			for (int i = 0; i < width * 4; i++) c[i] = ChannelTraits<Channel>::From(2.0 * c[i] - b[i]);
+		}
+	});
+}
+
+template class TypedImage<PixelRGBA16>;
+template class TypedImage<PixelRGBA32F>;
+
+
+/**
+ * WorkingImage
+ **/
+void WorkingImage::SetFormat (Image &img, int format_)
+{
+	assert(format_ >= 0 && format_ < WORKING_N_FORMATS);
+	if (wide && format_ != format) {
+		if (format_ == WORKING_RGBA8) {
+			Narrow(img);
+		}
+		else if (format_ == WORKING_RGBA16) {
+			rgba16 = TypedImage<PixelRGBA16>(rgba32f);
+			rgba32f = TypedImage<PixelRGBA32F>();
+		}
+		else {
+			rgba32f = TypedImage<PixelRGBA32F>(rgba16);
+			rgba16 = TypedImage<PixelRGBA16>();
+		}
+	}
+	format = format_;
+}
+
+void WorkingImage::Load (Image &img, char *fname)
+{
+	wide = false;
+	rgba16 = TypedImage<PixelRGBA16>();
+	rgba32f = TypedImage<PixelRGBA32F>();
+
+	// stb_image widens 8-bit files exactly (v * 257), so everything it reads
+	// goes through its 16-bit path.  .rgba and PAM files load as 8 bits.
+	int w, h, numComponents;
+	stbi_us *px;
+	if (format != WORKING_RGBA8 && !IsRawImageFile(fname) &&
+	    (px = stbi_load_16(fname, &w, &h, &numComponents, 4)) != NULL) {
+		rgba16 = TypedImage<PixelRGBA16>(w, h);
+		memcpy(rgba16.Row(0), px, (size_t) w * h * sizeof(PixelRGBA16));
+		stbi_image_free(px);
+		if (format == WORKING_FLOAT32) {
+			rgba32f = TypedImage<PixelRGBA32F>(rgba16);
+			rgba16 = TypedImage<PixelRGBA16>();
+		}
+		img = (format == WORKING_RGBA16) ? rgba16.ToImage() : rgba32f.ToImage();
+		wide = true;
+		return;
+	}
+	img = Image(fname);
+}
+
+void WorkingImage::Narrow (Image &img)
+{
+	if (!wide) return;
+	int method = img.sampling_method;
+	if (format == WORKING_RGBA16) {
+		img = rgba16.ToImage();
+		rgba16 = TypedImage<PixelRGBA16>();
+	}
+	else {
+		img = rgba32f.ToImage();
+		rgba32f = TypedImage<PixelRGBA32F>();
+	}
+	img.sampling_method = method;
+	wide = false;
+}
+
+void WorkingImage::Widen (const Image &img)
+{
+	if (format == WORKING_RGBA16)
+		rgba16 = TypedImage<PixelRGBA16>(img);
+	else
+		rgba32f = TypedImage<PixelRGBA32F>(img);
+	wide = true;
+}
@@ -0,0 +1,186 @@
+//typedimage.h
+//
+//Images with a choice of pixel type, for wider working formats.
+//
+//Image holds 8-bit RGBA, and every op on it rounds and clamps back to 8
+//bits, so a chain of ops loses precision at each step.  TypedImage<PixelT>
+//holds RGBA16 or float RGBA pixels and has Image's methods for the ops
+//whose math does not depend on 8 bits (point ops, crop, blur and
+//sharpen).  A chain of those can decode once, run in the wider format, and
+//round to 8 bits once when written.
+//
+//These are the wide formats only.  8-bit pixels stay in Image, whose ops
+//have the SIMD row kernels; the ones here are plain loops over the
+//channels.
+//
+//Each component type has a range from black to white: 0..255, 0..65535,
+//and 0..1 for float.  Integer formats round and clamp to it after every
+//op.  Float pixels are never clamped, so values one op pushes out of range
+//can come back in the next.
+
+#ifndef TYPEDIMAGE_INCLUDED
+#define TYPEDIMAGE_INCLUDED
+
+#include "image.h"
+#include "parallel.h"
+#include "pixelbuffer.h"
+#include <stdint.h>
+
+/**
+ * Pixels
+ **/
+template <class T>
+struct RGBA
+{
+    typedef T Channel;
+    T r, g, b, a;
+};
+
+typedef RGBA<uint16_t> PixelRGBA16;
+typedef RGBA<float>    PixelRGBA32F;
+
+// The value of white, and rounding of a computed value back to the type
+template <class T> struct ChannelTraits;
+
+template <> struct ChannelTraits<uint8_t>
+{
+    static constexpr double white = 255;
+    static uint8_t From (double v) { return (v <= 0) ? 0 : (v >= 255) ? 255 : (uint8_t) (v + 0.5); }
+};
+
+template <> struct ChannelTraits<uint16_t>
+{
+    static constexpr double white = 65535;
+    static uint16_t From (double v) { return (v <= 0) ? 0 : (v >= 65535) ? 65535 : (uint16_t) (v + 0.5); }
+};
+
+template <> struct ChannelTraits<float>
+{
+    static constexpr double white = 1;
+    static float From (double v) { return (float) v; }
+};
+
+
+/**
+ * TypedImage
+ **/
+template <class PixelT>
+class TypedImage
+{
+public:
+    typedef typename PixelT::Channel Channel;
+
+    // Creates an empty 0 x 0 image
+    TypedImage () : width(0), height(0) {}
+
+    // Creates a black, transparent image with the given dimensions
+    TypedImage (int width, int height);
+
+    // Converts 8-bit pixels, or pixels of another type, scaling white to
+    // white
+    explicit TypedImage (const Image &src);
+    template <class OtherT> explicit TypedImage (const TypedImage<OtherT> &src);
+
+    // Rounds to 8-bit pixels
+    Image ToImage () const;
+
+    int Width () const { return width; }
+    int Height () const { return height; }
+    bool Empty () const { return width == 0 || height == 0; }
+    PixelT* Row (int y) const { assert(y >= 0 && y < height);  return (PixelT *) buffer.Bytes() + (size_t) y * width; }
+    PixelT& GetPixel (int x, int y) const { assert(x >= 0 && x < width);  return Row(y)[x]; }
+
+    // The ops, as documented on Image
+    void Brighten (double factor);
+    void ChangeContrast (double factor);
+    void ChangeSaturation (double factor);
+    void ExtractChannel (int channel);
+    TypedImage Crop (int x, int y, int w, int h) const;
+    void Blur (int n);
+    void BlurFast (double sigma);
+    void Sharpen (int n);
+
+private:
+    int width, height;
+    PixelBuffer buffer;
+};
+
+template <class PixelT>
+template <class OtherT>
+TypedImage<PixelT>::TypedImage (const TypedImage<OtherT> &src) : TypedImage(src.Width(), src.Height())
+{
+    typedef typename OtherT::Channel From;
+    const double scale = ChannelTraits<Channel>::white / ChannelTraits<From>::white;
+    ParallelFor(height, [&](int y0, int y1) {
+        for (int y = y0; y < y1; y++) {
+            const From *s = &src.Row(y)->r;
+            Channel *d = &Row(y)->r;
+            for (int i = 0; i < width * 4; i++) d[i] = ChannelTraits<Channel>::From(s[i] * scale);
+        }
+    });
+}
+
+
+/**
+ * Working formats
+ **/
+enum {
+    WORKING_RGBA8,
+    WORKING_RGBA16,
+    WORKING_FLOAT32,
+    WORKING_N_FORMATS
+};
+
+// The current image of a chain of ops, in a working format.  The 8-bit
+// Image is the caller's; in a wide format the pixels move into a
+// TypedImage the first time an op runs there, and only come back, rounded,
+// when Narrow is called.
+class WorkingImage
+{
+public:
+    WorkingImage () : format(WORKING_RGBA8), wide(false) {}
+
+    int Format () const { return format; }
+
+    // Switches formats.  Wide pixels convert directly to the new format.
+    void SetFormat (Image &img, int format);
+
+    // Loads fname into img.  In a wide format, 16-bit PNGs keep all 16
+    // bits, and img gets a rounded copy.
+    void Load (Image &img, char *fname);
+
+    // Calls fn(image) on the image in the working format, moving img's
+    // pixels there first if they are the current ones.  img is out of date
+    // afterwards until Narrow.
+    template <class Fn>
+    void Apply (Image &img, Fn fn)
+    {
+        if (format == WORKING_RGBA8) {
+            fn(img);
+            return;
+        }
+        if (!wide) Widen(img);
+        if (format == WORKING_RGBA16)
+            fn(rgba16);
+        else
+            fn(rgba32f);
+    }
+
+    // Brings img up to date from the wide pixels, if they are current
+    void Narrow (Image &img);
+
+    // The size of the current image, which is img's unless the wide
+    // pixels are the current ones
+    int Width (const Image &img) const { return !wide ? img.Width() : (format == WORKING_RGBA16) ? rgba16.Width() : rgba32f.Width(); }
+    int Height (const Image &img) const { return !wide ? img.Height() : (format == WORKING_RGBA16) ? rgba16.Height() : rgba32f.Height(); }
+
+private:
+    int format;
+    bool wide;                      // the wide pixels are the current ones
+    TypedImage<PixelRGBA16> rgba16;
+    TypedImage<PixelRGBA32F> rgba32f;
+
+    void Widen (const Image &img);
+};
+
+#endif
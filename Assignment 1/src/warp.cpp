@@ -0,0 +1,207 @@
+#include "warp.h"
+#include "pyramid.h"
+#include "resample.h"
+#include "traverse.h"
+#include <math.h>
+#include <algorithm>
+
+/**
+ * Samplers
+ **/
+Pixel SamplePoint (const Image &src, double u, double v)
+{
+	return src.GetPixel((int) u, (int) v);
+}
+
+// The tent and Gaussian samplers each average a row of taps through (u, v)
+// with a column of them, so they share the loops and differ in weights
+static const int BILINEAR_RADIUS = 5;
+static const int GAUSSIAN_RADIUS = 6;
+
+// A tent of radius 5
+static const struct BilinearWeights {
+	double w[2*BILINEAR_RADIUS + 1];
+	BilinearWeights ()
+	{
+		const int radius = BILINEAR_RADIUS;
+		for (int x = -radius; x <= radius; x++) w[x + radius] = (1.0 - fabs((double) x / (double) radius)) / radius;
+	}
+} bilinearWeights;
+
+// A Gaussian of standard deviation 2, out to 3 deviations
+static const struct GaussianWeights {
+	double w[2*GAUSSIAN_RADIUS + 1];
+	GaussianWeights ()
+	{
+		const int radius = 2;
+		for (int x = -3*radius; x <= 3*radius; x++)
+			w[x + 3*radius] = 1.0/sqrt(2*M_PI*pow((double) radius, 2)) * pow(M_E, -pow(x, 2)/(2*pow(radius, 2)));
+	}
+} gaussianWeights;
+
+// Averages the taps along the row through (u, v) with those along the
+// column, mirroring at the far edges
+static Pixel SampleCross (const Image &src, double u, double v, int radius, const double *w)
+{
+	Pixel pX = Pixel(0, 0, 0);
+	Pixel pY = Pixel(0, 0, 0);
+	for (int x = -radius; x <= radius; x++) {
+		int tmpX = (int) fabs(u + x);
+		if (tmpX >= src.Width()) {
+			tmpX -= 2*(tmpX - src.Width()) + 1;
+		}
+		pX = pX + src.GetPixel(tmpX, (int) v) * w[x + radius];
+	}
+	for (int y = -radius; y <= radius; y++) {
+		int tmpY = (int) fabs(v + y);
+		if (tmpY >= src.Height()) {
+			tmpY -= 2*(tmpY - src.Height()) + 1;
+		}
+		pY = pY + src.GetPixel((int) u, tmpY) * w[y + radius];
+	}
+	return pX * 0.5 + pY * 0.5;
+}
+
+// The same for a point whose taps all lie inside the image, given the
+// pixel it truncates to
+static inline Pixel SampleCrossInside (const Pixel *p, ptrdiff_t stride, int radius, const double *w)
+{
+	Pixel pX = Pixel(0, 0, 0);
+	Pixel pY = Pixel(0, 0, 0);
+	for (int x = -radius; x <= radius; x++) pX = pX + p[x] * w[x + radius];
+	for (int y = -radius; y <= radius; y++) pY = pY + p[y * stride] * w[y + radius];
+	return pX * 0.5 + pY * 0.5;
+}
+
+Pixel SampleBilinear (const Image &src, double u, double v)
+{
+	return SampleCross(src, u, v, BILINEAR_RADIUS, bilinearWeights.w);
+}
+
+Pixel SampleGaussian (const Image &src, double u, double v)
+{
+	return SampleCross(src, u, v, GAUSSIAN_RADIUS, gaussianWeights.w);
+}
+
+
+/**
+ * Spans
+ **/
+// Narrows [*x0, *x1) to the x where lo < start + x*step < hi.  Those x form
+// one interval, so a floating-point estimate only needs settling by a
+// pixel or so to be exact.
+static void ClipSpan (int64_t start, int64_t step, int64_t lo, int64_t hi, int *x0, int *x1)
+{
+	auto inside = [&](int x) { int64_t c = start + x*step; return c > lo && c < hi; };
+	if (step == 0) {
+		if (!inside(0)) *x1 = *x0;
+		return;
+	}
+	double a = (double) (lo - start) / step;
+	double b = (double) (hi - start) / step;
+	if (a > b) std::swap(a, b);
+	int first = (int) std::min(std::max(floor(a), (double) *x0), (double) *x1);
+	int last = (int) std::min(std::max(ceil(b), (double) first), (double) *x1);
+	while (first < last && !inside(first)) first++;
+	while (first > *x0 && inside(first - 1)) first--;
+	while (last > first && !inside(last - 1)) last--;
+	while (last < *x1 && inside(last)) last++;
+	*x0 = first;
+	*x1 = last;
+}
+
+// The inner loops, one per sampling method, over n pixels starting at the
+// fixed-point source point (u, v)
+static void PointSpan (const Image &src, Pixel *out, int n, int64_t u, int64_t v, int64_t du, int64_t dv)
+{
+	// Truncation: the span only holds points past -1, which go to pixel 0
+	for (int i = 0; i < n; i++, u += du, v += dv) {
+		int x = (int) (std::max(u, (int64_t) 0) >> WARP_FRAC_BITS);
+		int y = (int) (std::max(v, (int64_t) 0) >> WARP_FRAC_BITS);
+		out[i] = src.Row(y)[x];
+	}
+}
+
+template <class Sampler>
+static void SampledSpan (Pixel *out, int n, int64_t u, int64_t v, int64_t du, int64_t dv, Sampler sample)
+{
+	const double scale = 1.0 / WARP_ONE;
+	for (int i = 0; i < n; i++, u += du, v += dv) out[i] = sample(u * scale, v * scale);
+}
+
+// Tent and Gaussian spans.  The points at least radius pixels inside the
+// source on both axes form one run, found as the span itself is, whose
+// taps are read straight from the rows; only the points on either side of
+// it go through the mirroring sampler.  Source points are exact in double,
+// so truncating them is the same as shifting the fixed-point values.
+static void CrossSpan (const Image &src, Pixel *out, int n, int64_t u, int64_t v, int64_t du, int64_t dv,
+                       int radius, const double *w)
+{
+	int64_t r = radius * WARP_ONE;
+	int x0 = 0, x1 = n;
+	ClipSpan(u, du, r - 1, src.Width() * WARP_ONE - r, &x0, &x1);
+	ClipSpan(v, dv, r - 1, src.Height() * WARP_ONE - r, &x0, &x1);
+
+	auto sample = [&](double su, double sv) { return SampleCross(src, su, sv, radius, w); };
+	SampledSpan(out, x0, u, v, du, dv, sample);
+	ptrdiff_t stride = src.Stride();
+	for (int i = x0; i < x1; i++) {
+		int64_t ui = u + i*du, vi = v + i*dv;
+		out[i] = SampleCrossInside(src.Row((int) (vi >> WARP_FRAC_BITS)) + (ui >> WARP_FRAC_BITS), stride, radius, w);
+	}
+	SampledSpan(out + x1, n - x1, u + x1*du, v + x1*dv, du, dv, sample);
+}
+
+
+/**
+ * Warp
+ **/
+void AffineWarp (const Image &src, Image &dst, const double m[6], int method)
+{
+	assert((method >= 0) && (method < IMAGE_N_SAMPLING_METHODS));
+	int width = dst.Width();
+	int64_t du = WarpFixed(m[0]);
+	int64_t dv = WarpFixed(m[3]);
+	int64_t uMax = src.Width() * WARP_ONE;
+	int64_t vMax = src.Height() * WARP_ONE;
+
+	// Trilinear sampling reads the levels around the size of an output
+	// pixel in the source, which is the same everywhere in an affine map
+	double lod = log2(std::max(hypot(m[0], m[3]), hypot(m[1], m[4])));
+	if (lod < 1e-9) lod = 0;   // rotations come out a rounding error above 0
+	int levels = (method == IMAGE_SAMPLING_TRILINEAR && lod > 0) ? (int) ceil(lod) + 1 : 1;
+	ImagePyramid pyramid(src, levels);
+
+	ForEachRow(dst, [&](Pixel *out, int y) {
+		int64_t u = WarpCoord(m, 0, y);
+		int64_t v = WarpCoord(m + 3, 0, y);
+		int x0 = 0, x1 = width;
+		ClipSpan(u, du, -WARP_ONE, uMax, &x0, &x1);
+		ClipSpan(v, dv, -WARP_ONE, vMax, &x0, &x1);
+
+		for (int x = 0; x < x0; x++) out[x] = Pixel(0, 0, 0, 0);
+		for (int x = x1; x < width; x++) out[x] = Pixel(0, 0, 0, 0);
+		out += x0;
+		u += x0 * du;
+		v += x0 * dv;
+		int n = x1 - x0;
+
+		switch (method) {
+			case IMAGE_SAMPLING_POINT:
+				PointSpan(src, out, n, u, v, du, dv);
+				break;
+			case IMAGE_SAMPLING_BILINEAR:
+				CrossSpan(src, out, n, u, v, du, dv, BILINEAR_RADIUS, bilinearWeights.w);
+				break;
+			case IMAGE_SAMPLING_GAUSSIAN:
+				CrossSpan(src, out, n, u, v, du, dv, GAUSSIAN_RADIUS, gaussianWeights.w);
+				break;
+			case IMAGE_SAMPLING_TRILINEAR:
+				SampledSpan(out, n, u, v, du, dv, [&](double su, double sv) { return pyramid.Sample(su, sv, lod); });
+				break;
+			default:
+				SampledSpan(out, n, u, v, du, dv, [&](double su, double sv) { return ResampleAt(src, su, sv, method); });
+				break;
+		}
+	});
+}
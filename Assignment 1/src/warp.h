@@ -0,0 +1,49 @@
+//warp.h
+//
+//Affine warps: every output pixel (x, y) is sampled from the source at
+//
+//    u = m[0]*x + m[1]*y + m[2]
+//    v = m[3]*x + m[4]*y + m[5]
+//
+//The source coordinates are 32.32 fixed point.  Each row's start is rounded
+//once from the map, the per-pixel step along the row is rounded once for
+//the whole image, and x steps are added exactly in integers, so the
+//coordinates do not drift however wide the image is.  A tiny bias (about
+//1.5e-5 pixel) keeps coordinates that should land exactly on a pixel from
+//rounding to just below it.
+//
+//As with Image::Sample, a point whose truncated coordinates fall outside
+//the source is transparent black.  The sampled part of each row is a single
+//span, found once per row, so the inner loop never checks bounds.
+
+#ifndef WARP_INCLUDED
+#define WARP_INCLUDED
+
+#include "image.h"
+#include <math.h>
+#include <stdint.h>
+
+#define WARP_FRAC_BITS 32
+#define WARP_ONE       ((int64_t) 1 << WARP_FRAC_BITS)
+#define WARP_BIAS      ((int64_t) 1 << 16)
+
+// Converts a map coefficient or row start to fixed point
+inline int64_t WarpFixed (double a) { return llround(a * (double) WARP_ONE); }
+
+// The fixed-point source coordinate of output pixel x in row y along one
+// axis, where row = {a, b, c} maps (x, y) to a*x + b*y + c
+inline int64_t WarpCoord (const double *row, int x, int y)
+{
+    return WarpFixed(row[1]*y + row[2]) + WARP_BIAS + x * WarpFixed(row[0]);
+}
+
+// Fills dst (of any size) from src through the map m, with the given
+// sampling method.
+void AffineWarp(const Image &src, Image &dst, const double m[6], int method);
+
+// The samplers behind Image::Sample, for a point already known to be in src
+Pixel SamplePoint(const Image &src, double u, double v);
+Pixel SampleBilinear(const Image &src, double u, double v);
+Pixel SampleGaussian(const Image &src, double u, double v);
+
+#endif
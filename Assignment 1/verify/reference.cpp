@@ -0,0 +1,875 @@
+#include "reference.h"
+#include "dither.h"
+#include "noise.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+
+// The pixel at (x, y) of the first noise stream of seed
+static Pixel ReferenceNoise (uint32_t seed, int x, int y)
+{
+	uint32_t h = NoiseValue(NoiseRowKey(NoiseStreamKey(seed, 0), y), x);
+	return Pixel(h & 255, (h >> 8) & 255, (h >> 16) & 255, h >> 24);
+}
+
+void ReferenceAddNoise (Image &img, double factor, uint32_t seed)
+{
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) {
+			Pixel p = img.GetPixel(x, y);
+			Pixel random = ReferenceNoise(seed, x, y) * factor;
+			img.GetPixel(x, y) = p + random;
+		}
+	}
+}
+
+void ReferenceBrighten (Image &img, double factor)
+{
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			img.GetPixel(x, y) = img.GetPixel(x, y) * factor;
+		}
+	}
+}
+
+void ReferenceChangeContrast (Image &img, double factor)
+{
+	factor = factor - 1;
+	double averageLuminance = 0;
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			averageLuminance += img.GetPixel(x, y).Luminance();
+		}
+	}
+	averageLuminance /= (img.Width() * img.Height());
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			Pixel p = img.GetPixel(x, y);
+			double r = p.r + (p.r - averageLuminance)*factor;
+			double g = p.g + (p.g - averageLuminance)*factor;
+			double b = p.b + (p.b - averageLuminance)*factor;
+			p.SetClamp(r, g, b);
+			img.GetPixel(x, y) = p;
+		}
+	}
+}
+
+void ReferenceChangeSaturation (Image &img, double factor)
+{
+	factor = factor - 1;
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			Pixel p = img.GetPixel(x, y);
+			Component luminance = p.Luminance();
+			double r = p.r + (p.r - luminance)*factor;
+			double g = p.g + (p.g - luminance)*factor;
+			double b = p.b + (p.b - luminance)*factor;
+			p.SetClamp(r, g, b);
+			img.GetPixel(x, y) = p;
+		}
+	}
+}
+
+Image ReferenceCrop (const Image &img, int x, int y, int w, int h)
+{
+	Image newImg(w, h);
+	for (int cx = x; cx < w + x; cx++) {
+		for (int cy = y; cy < h + y; cy++) {
+			newImg.SetPixel(cx - x, cy - y, img.GetPixel(cx, cy));
+		}
+	}
+	return newImg;
+}
+
+void ReferenceExtractChannel (Image &img, int channel)
+{
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			Pixel p = img.GetPixel(x, y);
+			switch (channel) {
+				case 0: p.g = 0; p.b = 0; break;
+				case 1: p.r = 0; p.b = 0; break;
+				case 2: p.r = 0; p.g = 0; break;
+				default: break;
+			}
+			img.GetPixel(x, y) = p;
+		}
+	}
+}
+
+void ReferenceQuantize (Image &img, int nbits)
+{
+	double step = 255.0/(pow(2, nbits)-1);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			Pixel p = img.GetPixel(x, y);
+			int r = (int) (step * (int) floor((double) p.r/step + 0.5));
+			int g = (int) (step * (int) floor((double) p.g/step + 0.5));
+			int b = (int) (step * (int) floor((double) p.b/step + 0.5));
+			p.SetClamp(r, g, b);
+			img.GetPixel(x, y) = p;
+		}
+	}
+}
+
+void ReferenceRandomDither (Image &img, int nbits, uint32_t seed)
+{
+	double step = 255.0/(pow(2, nbits)-1);
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) {
+			Pixel p = img.GetPixel(x, y);
+			Pixel q = ReferenceNoise(seed, x, y);
+			uint32_t h = q.r + 256u*q.g + 65536u*q.b + 16777216u*q.a;
+			double rnd = (h % (int) (step) - (step/2))/255.0;
+			int r = (int) (step * (int) floor((double) p.r/step + rnd + 0.5));
+			int g = (int) (step * (int) floor((double) p.g/step + rnd + 0.5));
+			int b = (int) (step * (int) floor((double) p.b/step + rnd + 0.5));
+			p.SetClamp(r, g, b);
+			img.GetPixel(x, y) = p;
+		}
+	}
+}
+
+void ReferenceOrderedDither (Image &img, int nbits, int matrix)
+{
+	int size;
+	const int *rank = DitherMatrix(matrix, &size);
+	int levels = (1 << nbits) - 1, n = size*size;
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) {
+			// Offset by (rank + 0.5) / n of a step, then round down
+			int k = rank[(y % size)*size + x % size];
+			int d = (2*k + 1) * 255 / (2*n*levels);
+			Pixel p = img.GetPixel(x, y);
+			Component *c[3] = { &p.r, &p.g, &p.b };
+			for (int i = 0; i < 3; i++) {
+				int level = std::min(*c[i] + d, 255) * levels / 255;
+				*c[i] = (Component) floor(level * 255.0 / levels + 0.5);
+			}
+			img.GetPixel(x, y) = p;
+		}
+	}
+}
+
+void ReferenceDiffusionDither (Image &img, int nbits, int kernel, int scan)
+{
+	// Offsets right and down, and weights, of each kernel
+	struct Tap { int dx, dy, weight; };
+	static const std::vector<Tap> taps[IMAGE_N_DIFFUSION_KERNELS] = {
+		{ {1,0,7}, {-1,1,3}, {0,1,5}, {1,1,1} },
+		{ {1,0,1}, {2,0,1}, {-1,1,1}, {0,1,1}, {1,1,1}, {0,2,1} },
+		{ {1,0,8}, {2,0,4}, {-2,1,2}, {-1,1,4}, {0,1,8}, {1,1,4}, {2,1,2},
+		  {-2,2,1}, {-1,2,2}, {0,2,4}, {1,2,2}, {2,2,1} },
+		{ {1,0,7}, {2,0,5}, {-2,1,3}, {-1,1,5}, {0,1,7}, {1,1,5}, {2,1,3},
+		  {-2,2,1}, {-1,2,3}, {0,2,5}, {1,2,3}, {2,2,1} },
+		{ {1,0,5}, {2,0,3}, {-2,1,2}, {-1,1,4}, {0,1,5}, {1,1,4}, {2,1,2},
+		  {-1,2,2}, {0,2,3}, {1,2,2} },
+	};
+	static const int divisors[IMAGE_N_DIFFUSION_KERNELS] = { 16, 8, 42, 48, 32 };
+	int divisor = divisors[kernel];
+
+	// Pending error per component, in units of 1/divisor
+	int w = img.Width(), h = img.Height();
+	std::vector<int> error((size_t) w * h * 3, 0);
+	for (int y = 0; y < h; y++) {
+		bool reverse = (scan == IMAGE_DITHER_SERPENTINE) && (y % 2 == 1);
+		int dir = reverse ? -1 : 1;
+		for (int i = 0; i < w; i++) {
+			int x = reverse ? w - 1 - i : i;
+			Pixel p = img.GetPixel(x, y);
+			int c[3] = { p.r, p.g, p.b }, e[3];
+			for (int k = 0; k < 3; k++) {
+				double pending = (double) error[((size_t) y * w + x) * 3 + k] / divisor;
+				int v = c[k] + (int) (pending < 0 ? -floor(-pending + 0.5) : floor(pending + 0.5));
+				v = std::min(std::max(v, 0), 255);
+				Pixel q = PixelQuant(Pixel(v, v, v), nbits);
+				c[k] = q.r;
+				e[k] = v - q.r;
+			}
+			p.r = c[0], p.g = c[1], p.b = c[2];
+			img.GetPixel(x, y) = p;
+			for (const Tap &t : taps[kernel]) {
+				int tx = x + t.dx * dir, ty = y + t.dy;
+				if (tx < 0 || tx >= w || ty >= h) continue;
+				for (int k = 0; k < 3; k++) error[((size_t) ty * w + tx) * 3 + k] += t.weight * e[k];
+			}
+		}
+	}
+}
+
+void ReferenceFloydSteinbergDither (Image &img, int nbits, int scan)
+{
+	ReferenceDiffusionDither(img, nbits, IMAGE_DIFFUSION_FLOYD_STEINBERG, scan);
+}
+
+
+/**
+ * Filters
+ **/
+// Reflect-101: -1 -> 1, n -> n-2, repeating for indices far outside
+static int Mirror (int i, int n)
+{
+	if (n == 1) return 0;
+	while (i < 0 || i >= n) {
+		if (i < 0) i = -i;
+		if (i >= n) i = 2*(n - 1) - i;
+	}
+	return i;
+}
+
+void ReferenceGaussian (Image &img, double sigma, int radius)
+{
+	std::vector<double> w(2*radius + 1);
+	double sum = 0;
+	for (int k = -radius; k <= radius; k++) {
+		w[k + radius] = exp(-(double) (k*k) / (2*sigma*sigma));
+		sum += w[k + radius];
+	}
+	for (int k = 0; k <= 2*radius; k++) w[k] /= sum;
+
+	Image src(img);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			double acc[4] = { 0, 0, 0, 0 };
+			for (int j = -radius; j <= radius; j++) {
+				for (int i = -radius; i <= radius; i++) {
+					const Pixel &p = src.GetPixel(Mirror(x + i, img.Width()), Mirror(y + j, img.Height()));
+					double wij = w[i + radius] * w[j + radius];
+					acc[0] += wij * p.r;
+					acc[1] += wij * p.g;
+					acc[2] += wij * p.b;
+					acc[3] += wij * p.a;
+				}
+			}
+			img.GetPixel(x, y) = Pixel(
+				ComponentClamp((int) floor(acc[0] + 0.5)),
+				ComponentClamp((int) floor(acc[1] + 0.5)),
+				ComponentClamp((int) floor(acc[2] + 0.5)),
+				ComponentClamp((int) floor(acc[3] + 0.5)));
+		}
+	}
+}
+
+void ReferenceBlur (Image &img, int n)
+{
+	if (n <= 0) return;
+	ReferenceGaussian(img, n, 3*n);
+}
+
+void ReferenceBoxBlur (Image &img, double sigma)
+{
+	if (sigma <= 0) return;
+
+	const int passes = 3;
+	int wl = (int) floor(sqrt(12*sigma*sigma/passes + 1));
+	if (wl % 2 == 0) wl--;
+	int wu = wl + 2;
+	int m = (int) floor((12*sigma*sigma - passes*wl*wl - 4*passes*wl - 3*passes) / (-4.0*wl - 4) + 0.5);
+
+	int w = img.Width(), h = img.Height();
+	std::vector<double> a(w*h*4), b(w*h*4);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			const Pixel &p = img.GetPixel(x, y);
+			double *d = &a[(y*w + x)*4];
+			d[0] = p.r; d[1] = p.g; d[2] = p.b; d[3] = p.a;
+		}
+	}
+	for (int pass = 0; pass < passes; pass++) {
+		int r = ((pass < m ? wl : wu) - 1) / 2;
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				for (int c = 0; c < 4; c++) {
+					double sum = 0;
+					for (int k = -r; k <= r; k++) sum += a[(y*w + Mirror(x + k, w))*4 + c];
+					b[(y*w + x)*4 + c] = sum / (2*r + 1);
+				}
+			}
+		}
+		for (int y = 0; y < h; y++) {
+			for (int x = 0; x < w; x++) {
+				for (int c = 0; c < 4; c++) {
+					double sum = 0;
+					for (int k = -r; k <= r; k++) sum += b[(Mirror(y + k, h)*w + x)*4 + c];
+					a[(y*w + x)*4 + c] = sum / (2*r + 1);
+				}
+			}
+		}
+	}
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			const double *s = &a[(y*w + x)*4];
+			img.GetPixel(x, y) = Pixel(
+				ComponentClamp((int) floor(s[0] + 0.5)),
+				ComponentClamp((int) floor(s[1] + 0.5)),
+				ComponentClamp((int) floor(s[2] + 0.5)),
+				ComponentClamp((int) floor(s[3] + 0.5)));
+		}
+	}
+}
+
+void ReferenceSharpen (Image &img, int n)
+{
+	Image blurred(img);
+	if (n >= 4)
+		ReferenceBoxBlur(blurred, n);
+	else
+		ReferenceBlur(blurred, n);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			img.GetPixel(x, y) = PixelLerp(img.GetPixel(x, y), blurred.GetPixel(x, y), -1);
+		}
+	}
+}
+
+void ReferenceEdgeDetect (Image &img)
+{
+	static const int EdgeM[3][3] = {
+		{-1, -1, -1},
+		{-1,  8, -1},
+		{-1, -1, -1}
+	};
+	Image oldPic(img);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			int r = 0, g = 0, b = 0;
+			for (int filterX = x - 1; filterX <= x + 1; filterX++) {
+				for (int filterY = y - 1; filterY <= y + 1; filterY++) {
+					int tmpX = abs(filterX);
+					int tmpY = abs(filterY);
+					if (tmpX >= img.Width()) tmpX -= 2 * (tmpX - img.Width()) + 1;
+					if (tmpY >= img.Height()) tmpY -= 2 * (tmpY - img.Height()) + 1;
+					Pixel p = oldPic.GetPixel(tmpX, tmpY);
+					int m = EdgeM[filterX - x + 1][filterY - y + 1];
+					r += p.r * m;
+					g += p.g * m;
+					b += p.b * m;
+				}
+			}
+			img.GetPixel(x, y).SetClamp(r, g, b);
+		}
+	}
+}
+
+
+// Coordinate i of a row or column of n under an IMAGE_BORDER_* policy
+static int ReferenceBorder (int i, int n, int border)
+{
+	switch (border) {
+		case IMAGE_BORDER_CLAMP:
+			return std::min(std::max(i, 0), n - 1);
+		case IMAGE_BORDER_WRAP:
+			while (i < 0) i += n;
+			return i % n;
+		case IMAGE_BORDER_EDGE_DETECT:
+			i = abs(i);
+			return (i >= n) ? 2*n - 1 - i : i;
+		default:
+			// Reflect until inside
+			if (n == 1) return 0;
+			while (i < 0 || i >= n) i = (i < 0) ? -i : 2*(n - 1) - i;
+			return i;
+	}
+}
+
+// The weighted sums of r, g and b of kernel k around (x, y)
+static void ReferenceSums (const Image &img, int x, int y, int kw, int kh, const int *k, int border, int sums[3])
+{
+	sums[0] = sums[1] = sums[2] = 0;
+	for (int j = 0; j < kh; j++) {
+		for (int i = 0; i < kw; i++) {
+			int sx = ReferenceBorder(x + i - kw/2, img.Width(), border);
+			int sy = ReferenceBorder(y + j - kh/2, img.Height(), border);
+			const Pixel &p = img.GetPixel(sx, sy);
+			sums[0] += k[j*kw + i] * p.r;
+			sums[1] += k[j*kw + i] * p.g;
+			sums[2] += k[j*kw + i] * p.b;
+		}
+	}
+}
+
+// sum / divisor rounded to nearest, ties to even, in integers
+static int RoundedQuotient (int sum, int divisor)
+{
+	if (divisor < 0) sum = -sum, divisor = -divisor;
+	int q = sum / divisor, r = abs(sum % divisor);
+	if (2*r > divisor || (2*r == divisor && (q & 1))) q += (sum < 0) ? -1 : 1;
+	return q;
+}
+
+void ReferenceConvolve (Image &img, int kw, int kh, const int *weights, int divisor, int bias, int border)
+{
+	Image old(img);
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) {
+			int sums[3];
+			ReferenceSums(old, x, y, kw, kh, weights, border, sums);
+			Component *c = &img.GetPixel(x, y).r;
+			for (int k = 0; k < 3; k++) {
+				int v = RoundedQuotient(sums[k], divisor);
+				c[k] = ComponentClamp(v + bias);
+			}
+		}
+	}
+}
+
+void ReferenceGradient (Image &img, const int *gx, const int *gy, int output, int border)
+{
+	Image old(img);
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) {
+			int sx[3], sy[3];
+			ReferenceSums(old, x, y, 3, 3, gx, border, sx);
+			ReferenceSums(old, x, y, 3, 3, gy, border, sy);
+			Component *c = &img.GetPixel(x, y).r;
+			for (int k = 0; k < 3; k++) {
+				if (output == IMAGE_GRADIENT_MAGNITUDE) {
+					float fx = (float) sx[k], fy = (float) sy[k];
+					c[k] = ComponentClamp((int) lrintf(sqrtf(fx*fx + fy*fy)));
+				}
+				else if (sx[k] == 0 && sy[k] == 0)
+					c[k] = 0;
+				else
+					c[k] = (Component) lrint((atan2((double) sy[k], (double) sx[k]) + M_PI) * (255 / (2 * M_PI)));
+			}
+		}
+	}
+}
+
+void ReferenceBoxFilter (Image &img, int radius)
+{
+	if (radius <= 0) return;
+	Image oldImg(img);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			int64_t sum[4] = { 0, 0, 0, 0 }, area = 0;
+			for (int wy = std::max(y - radius, 0); wy <= std::min(y + radius, img.Height() - 1); wy++) {
+				for (int wx = std::max(x - radius, 0); wx <= std::min(x + radius, img.Width() - 1); wx++) {
+					Pixel p = oldImg.GetPixel(wx, wy);
+					sum[0] += p.r;
+					sum[1] += p.g;
+					sum[2] += p.b;
+					sum[3] += p.a;
+					area++;
+				}
+			}
+			img.GetPixel(x, y) = Pixel((sum[0] + area/2) / area, (sum[1] + area/2) / area,
+			                           (sum[2] + area/2) / area, (sum[3] + area/2) / area);
+		}
+	}
+}
+
+void ReferenceLocalContrast (Image &img, int radius, double factor)
+{
+	radius = std::max(radius, 0);
+	Image oldImg(img);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			int64_t sum = 0, area = 0;
+			for (int wy = std::max(y - radius, 0); wy <= std::min(y + radius, img.Height() - 1); wy++) {
+				for (int wx = std::max(x - radius, 0); wx <= std::min(x + radius, img.Width() - 1); wx++) {
+					sum += oldImg.GetPixel(wx, wy).Luminance();
+					area++;
+				}
+			}
+			double gray = (double) sum / area;
+			Pixel &p = img.GetPixel(x, y);
+			p.r = ComponentContrast(p.r, gray, factor - 1);
+			p.g = ComponentContrast(p.g, gray, factor - 1);
+			p.b = ComponentContrast(p.b, gray, factor - 1);
+		}
+	}
+}
+
+
+void ReferenceAutoLevels (Image &img, double clipPercent)
+{
+	double clip = std::min(std::max(clipPercent, 0.0), 50.0) / 100;
+	int64_t n = img.NumPixels();
+	int lo[3], hi[3];
+	for (int c = 0; c < 3; c++) {
+		std::vector<int> values;
+		for (int y = 0; y < img.Height(); y++) {
+			for (int x = 0; x < img.Width(); x++) values.push_back((&img.GetPixel(x, y).r)[c]);
+		}
+		std::sort(values.begin(), values.end());
+		lo[c] = values[std::max((int64_t) ceil(clip * n) - 1, (int64_t) 0)];
+		hi[c] = values[std::max((int64_t) ceil((1 - clip) * n) - 1, (int64_t) 0)];
+	}
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) {
+			Component *p = &img.GetPixel(x, y).r;
+			for (int c = 0; c < 3; c++) {
+				if (hi[c] > lo[c]) p[c] = ComponentClamp((int) floor((p[c] - lo[c]) * 255.0 / (hi[c] - lo[c]) + 0.5));
+			}
+		}
+	}
+}
+
+void ReferenceEqualize (Image &img)
+{
+	std::vector<int> values;
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) values.push_back(img.GetPixel(x, y).Luminance());
+	}
+	std::sort(values.begin(), values.end());
+	int64_t n = values.size();
+	int64_t cdfMin = std::upper_bound(values.begin(), values.end(), values[0]) - values.begin();
+	for (int y = 0; y < img.Height(); y++) {
+		for (int x = 0; x < img.Width(); x++) {
+			Pixel &p = img.GetPixel(x, y);
+			Component *c = &p.r;
+			for (int k = 0; k < 3; k++) {
+				int64_t cdf = std::upper_bound(values.begin(), values.end(), c[k]) - values.begin();
+				if (n > cdfMin) c[k] = (Component) floor(std::max(cdf - cdfMin, (int64_t) 0) * 255.0 / (n - cdfMin) + 0.5);
+			}
+		}
+	}
+}
+
+/**
+ * Sampling
+ **/
+static double ReferenceSinc (double x)
+{
+	return (x == 0) ? 1 : sin(M_PI*x) / (M_PI*x);
+}
+
+// The resampling filters and their supports
+static double ReferenceFilter (int method, double x, double *support)
+{
+	const double B = 1.0/3, C = 1.0/3;
+	switch (method) {
+		case IMAGE_SAMPLING_BOX:
+			*support = 0.5;
+			return (x > -0.5 && x <= 0.5) ? 1 : 0;
+		case IMAGE_SAMPLING_TRIANGLE:
+			*support = 1;
+			return std::max(1 - fabs(x), 0.0);
+		case IMAGE_SAMPLING_MITCHELL:
+			*support = 2;
+			x = fabs(x);
+			if (x < 1) return ((12 - 9*B - 6*C)*pow(x, 3) + (-18 + 12*B + 6*C)*x*x + (6 - 2*B)) / 6;
+			if (x < 2) return ((-B - 6*C)*pow(x, 3) + (6*B + 30*C)*x*x + (-12*B - 48*C)*x + (8*B + 24*C)) / 6;
+			return 0;
+		default:
+			*support = 3;
+			x = fabs(x);
+			return (x < 3) ? ReferenceSinc(x) * ReferenceSinc(x/3) : 0;
+	}
+}
+
+// Filters img around the source point (u, v), with the filter stretched by
+// (fx, fy), repeating the edge pixels
+static Pixel ReferenceFilterAt (const Image &img, int method, double u, double v, double fx, double fy)
+{
+	double support;
+	ReferenceFilter(method, 0, &support);
+	double sum[4] = { 0, 0, 0, 0 }, total = 0;
+	for (int y = (int) floor(v - support*fy) - 1; y <= (int) ceil(v + support*fy); y++) {
+		for (int x = (int) floor(u - support*fx) - 1; x <= (int) ceil(u + support*fx); x++) {
+			double w = ReferenceFilter(method, (x + 0.5 - u) / fx, &support) *
+			           ReferenceFilter(method, (y + 0.5 - v) / fy, &support);
+			Pixel p = img.GetPixel(std::min(std::max(x, 0), img.Width() - 1), std::min(std::max(y, 0), img.Height() - 1));
+			sum[0] += w * p.r;
+			sum[1] += w * p.g;
+			sum[2] += w * p.b;
+			sum[3] += w * p.a;
+			total += w;
+		}
+	}
+	Pixel p;
+	p.SetClamp(floor(sum[0] / total + 0.5), floor(sum[1] / total + 0.5), floor(sum[2] / total + 0.5), floor(sum[3] / total + 0.5));
+	return p;
+}
+
+// Halves img with 2x2 boxes, repeating the last row and column
+static Image ReferenceHalve (const Image &img)
+{
+	int w = img.Width(), h = img.Height();
+	Image newImg((w + 1) / 2, (h + 1) / 2);
+	for (int x = 0; x < newImg.Width(); x++) {
+		for (int y = 0; y < newImg.Height(); y++) {
+			Pixel p = img.GetPixel(2*x, 2*y);
+			Pixel q = img.GetPixel(std::min(2*x + 1, w - 1), 2*y);
+			Pixel s = img.GetPixel(2*x, std::min(2*y + 1, h - 1));
+			Pixel t = img.GetPixel(std::min(2*x + 1, w - 1), std::min(2*y + 1, h - 1));
+			newImg.GetPixel(x, y) = Pixel((p.r + q.r + s.r + t.r + 2) / 4, (p.g + q.g + s.g + t.g + 2) / 4,
+			                              (p.b + q.b + s.b + t.b + 2) / 4, (p.a + q.a + s.a + t.a + 2) / 4);
+		}
+	}
+	return newImg;
+}
+
+// The pyramid levels of img, down to 8 pixels on the shorter side
+static std::vector<Image> ReferencePyramid (const Image &img)
+{
+	std::vector<Image> levels(1, img);
+	while ((levels.back().Width() + 1) / 2 >= 8 && (levels.back().Height() + 1) / 2 >= 8) {
+		levels.push_back(ReferenceHalve(levels.back()));
+	}
+	return levels;
+}
+
+// Bilinear interpolation at (u, v) in level l, whose pixels are 2^l level 0
+// pixels wide, with pixel centers at i + 0.5
+static void ReferenceBilinear (const Image &img, int l, double u, double v, double c[4])
+{
+	double x = u / pow(2, l) - 0.5, y = v / pow(2, l) - 0.5;
+	int x0 = (int) floor(x), y0 = (int) floor(y);
+	for (int k = 0; k < 4; k++) c[k] = 0;
+	for (int dy = 0; dy <= 1; dy++) {
+		for (int dx = 0; dx <= 1; dx++) {
+			double w = (dx ? x - x0 : 1 - (x - x0)) * (dy ? y - y0 : 1 - (y - y0));
+			Pixel p = img.GetPixel(std::min(std::max(x0 + dx, 0), img.Width() - 1), std::min(std::max(y0 + dy, 0), img.Height() - 1));
+			c[0] += w * p.r;
+			c[1] += w * p.g;
+			c[2] += w * p.b;
+			c[3] += w * p.a;
+		}
+	}
+}
+
+// Blends the bilinear lookups in the levels either side of lod
+static Pixel ReferenceTrilinear (const std::vector<Image> &levels, double u, double v, double lod)
+{
+	lod = std::min(std::max(lod, 0.0), (double) levels.size() - 1);
+	int l = (int) floor(lod);
+	double c[4], d[4];
+	ReferenceBilinear(levels[l], l, u, v, c);
+	if (lod > l) {
+		ReferenceBilinear(levels[l + 1], l + 1, u, v, d);
+		for (int k = 0; k < 4; k++) c[k] = c[k] * (1 - (lod - l)) + d[k] * (lod - l);
+	}
+	return Pixel((int) (c[0] + 0.5), (int) (c[1] + 0.5), (int) (c[2] + 0.5), (int) (c[3] + 0.5));
+}
+
+static Pixel ReferenceSample (const Image &img, double u, double v)
+{
+	if (!img.ValidCoord((int) u, (int) v)) return Pixel(0, 0, 0, 0);
+
+	Pixel p, pX, pY;
+	int radius;
+	switch (img.sampling_method) {
+		case IMAGE_SAMPLING_POINT:
+			p = img.GetPixel((int) u, (int) v);
+			break;
+		case IMAGE_SAMPLING_BILINEAR:
+			radius = 5;
+			for (int x = -radius; x <= radius; x++) {
+				int tmpX = (int) fabs(u + x);
+				if (tmpX >= img.Width()) tmpX -= 2*(tmpX - img.Width()) + 1;
+				pX = pX + img.GetPixel(tmpX, (int) v) * ((1.0 - fabs((double) x / (double) radius)) / radius);
+			}
+			for (int y = -radius; y <= radius; y++) {
+				int tmpY = (int) fabs(v + y);
+				if (tmpY >= img.Height()) tmpY -= 2*(tmpY - img.Height()) + 1;
+				pY = pY + img.GetPixel((int) u, tmpY) * ((1.0 - fabs((double) y / (double) radius)) / radius);
+			}
+			p = pX * 0.5 + pY * 0.5;
+			break;
+		case IMAGE_SAMPLING_GAUSSIAN:
+			radius = 2;
+			for (int x = -3*radius; x <= 3*radius; x++) {
+				int tmpX = (int) fabs(u + x);
+				if (tmpX >= img.Width()) tmpX -= 2*(tmpX - img.Width()) + 1;
+				pX = pX + img.GetPixel(tmpX, (int) v) * (
+						1.0/sqrt(2*M_PI*pow((double) radius, 2)) *
+						pow(M_E, -pow(x, 2)/(2*pow(radius, 2))));
+			}
+			for (int y = -3*radius; y <= 3*radius; y++) {
+				int tmpY = (int) fabs(v + y);
+				if (tmpY >= img.Height()) tmpY -= 2*(tmpY - img.Height()) + 1;
+				pY = pY + img.GetPixel((int) u, tmpY) * (
+						1.0/sqrt(2*M_PI*pow((double) radius, 2)) *
+						pow(M_E, -pow(y, 2)/(2*pow(radius, 2))));
+			}
+			p = pX * 0.5 + pY * 0.5;
+			break;
+		case IMAGE_SAMPLING_TRILINEAR:
+			p = ReferenceTrilinear(std::vector<Image>(1, img), u, v, 0);
+			break;
+		default:
+			p = ReferenceFilterAt(img, img.sampling_method, u, v, 1, 1);
+			break;
+	}
+	return p;
+}
+
+// The source point of output pixel (x, y) under the affine map m, in
+// double.  Like warp.h it is nudged up by 2^-16 pixel, so points that land
+// exactly on a pixel do not mirror to the one before it.
+static void ReferenceWarpPoint (const double m[6], int x, int y, double &u, double &v)
+{
+	const double nudge = 1.0 / 65536;
+	u = m[0]*x + m[1]*y + m[2] + nudge;
+	v = m[3]*x + m[4]*y + m[5] + nudge;
+}
+
+// Samples img at output pixel (x, y) of the affine map m
+static Pixel ReferenceWarpSample (const Image &img, const double m[6], int x, int y)
+{
+	double u, v;
+	ReferenceWarpPoint(m, x, y, u, v);
+	return ReferenceSample(img, u, v);
+}
+
+Image ReferenceScale (const Image &img, double sx, double sy)
+{
+	Image newImg((int) (sx*img.Width()), (int) (sy*img.Height()));
+	std::vector<Image> levels = ReferencePyramid(img);
+
+	if (img.sampling_method == IMAGE_SAMPLING_TRILINEAR) {
+		// Centered on the output pixels, from the levels around the
+		// reduction
+		const double m[6] = { 1 / sx, 0, 0.5 / sx, 0, 1 / sy, 0.5 / sy };
+		double lod = log2(std::max(1 / sx, 1 / sy));
+		for (int x = 0; x < newImg.Width(); x++) {
+			for (int y = 0; y < newImg.Height(); y++) {
+				double u, v;
+				ReferenceWarpPoint(m, x, y, u, v);
+				if (img.ValidCoord((int) u, (int) v)) newImg.GetPixel(x, y) = ReferenceTrilinear(levels, u, v, lod);
+				else newImg.GetPixel(x, y) = Pixel(0, 0, 0, 0);
+			}
+		}
+		return newImg;
+	}
+
+	// The other methods start from the smallest level that is no more
+	// reduced than the scale on either axis
+	int l = 0;
+	while (l + 1 < (int) levels.size() && sx * pow(2, l + 1) <= 1 && sy * pow(2, l + 1) <= 1) l++;
+	Image &src = levels[l];
+	src.sampling_method = img.sampling_method;
+	sx *= pow(2, l);
+	sy *= pow(2, l);
+
+	for (int x = 0; x < newImg.Width(); x++) {
+		for (int y = 0; y < newImg.Height(); y++) {
+			if (img.sampling_method >= IMAGE_SAMPLING_BOX) {
+				// Pixel centers line up, and the filter widens to cover the
+				// source when minifying
+				newImg.GetPixel(x, y) = ReferenceFilterAt(src, src.sampling_method, (x + 0.5) / sx, (y + 0.5) / sy,
+				                                          std::max(1/sx, 1.0), std::max(1/sy, 1.0));
+				continue;
+			}
+			const double m[6] = { 1 / sx, 0, 0, 0, 1 / sy, 0 };
+			newImg.GetPixel(x, y) = ReferenceWarpSample(src, m, x, y);
+		}
+	}
+	return newImg;
+}
+
+Image ReferenceRotate (const Image &img, double angle)
+{
+	int w = img.Width(), h = img.Height();
+	double turns = nearbyint(angle / (M_PI/2));
+	if (fabs(angle - turns * (M_PI/2)) * std::max(w, h) < 0.01) {
+		switch (((long) turns % 4 + 4) % 4) {
+			case 0: return img;
+			case 1: return ReferenceRotate90(img);
+			case 2: return ReferenceRotate180(img);
+			case 3: return ReferenceRotate270(img);
+		}
+	}
+	int p1x = (int) (cos(angle) * w);
+	int p1y = (int) (sin(angle) * w);
+	int p2x = (int) (cos(angle + atan2(h, w)) * sqrt(w * w + h * h));
+	int p2y = (int) (sin(angle + atan2(h, w)) * sqrt(w * w + h * h));
+	int p3x = (int) (cos(angle + M_PI/2) * h);
+	int p3y = (int) (sin(angle + M_PI/2) * h);
+	int maxX = (int) fmax(0, fmax(p1x, fmax(p2x, p3x)));
+	int maxY = (int) fmax(0, fmax(p1y, fmax(p2y, p3y)));
+	int minX = (int) fmin(0, fmin(p1x, fmin(p2x, p3x)));
+	int minY = (int) fmin(0, fmin(p1y, fmin(p2y, p3y)));
+	Image newImg(maxX - minX, maxY - minY);
+	double c = cos(-angle), s = sin(-angle);
+	const double m[6] = { c, -s, minX * c - minY * s,
+	                      s,  c, minX * s + minY * c };
+	for (int x = 0; x < newImg.Width(); x++) {
+		for (int y = 0; y < newImg.Height(); y++) {
+			newImg.GetPixel(x, y) = ReferenceWarpSample(img, m, x, y);
+		}
+	}
+	return newImg;
+}
+
+Image ReferenceRotate90 (const Image &img)
+{
+	int w = img.Width(), h = img.Height();
+	Image newImg(h, w);
+	for (int x = 0; x < h; x++) {
+		for (int y = 0; y < w; y++) {
+			newImg.GetPixel(x, y) = img.GetPixel(y, h - 1 - x);
+		}
+	}
+	return newImg;
+}
+
+Image ReferenceRotate180 (const Image &img)
+{
+	int w = img.Width(), h = img.Height();
+	Image newImg(w, h);
+	for (int x = 0; x < w; x++) {
+		for (int y = 0; y < h; y++) {
+			newImg.GetPixel(x, y) = img.GetPixel(w - 1 - x, h - 1 - y);
+		}
+	}
+	return newImg;
+}
+
+Image ReferenceRotate270 (const Image &img)
+{
+	int w = img.Width(), h = img.Height();
+	Image newImg(h, w);
+	for (int x = 0; x < h; x++) {
+		for (int y = 0; y < w; y++) {
+			newImg.GetPixel(x, y) = img.GetPixel(w - 1 - y, x);
+		}
+	}
+	return newImg;
+}
+
+Image ReferenceTranspose (const Image &img)
+{
+	Image newImg(img.Height(), img.Width());
+	for (int x = 0; x < img.Height(); x++) {
+		for (int y = 0; y < img.Width(); y++) {
+			newImg.GetPixel(x, y) = img.GetPixel(y, x);
+		}
+	}
+	return newImg;
+}
+
+void ReferenceFlipHorizontal (Image &img)
+{
+	Image oldImg(img);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			img.GetPixel(x, y) = oldImg.GetPixel(img.Width() - 1 - x, y);
+		}
+	}
+}
+
+void ReferenceFlipVertical (Image &img)
+{
+	Image oldImg(img);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			img.GetPixel(x, y) = oldImg.GetPixel(x, img.Height() - 1 - y);
+		}
+	}
+}
+
+void ReferenceFun (Image &img)
+{
+	Image oldImg(img);
+	for (int x = 0; x < img.Width(); x++) {
+		for (int y = 0; y < img.Height(); y++) {
+			double u = x + sin((double) x / img.Width() * 100) * 20;
+			double v = y + sin((double) y / img.Width() * 100) * 20;
+			img.GetPixel(x, y) = ReferenceSample(oldImg, u, v);
+		}
+	}
+}
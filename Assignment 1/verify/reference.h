@@ -0,0 +1,78 @@
+//reference.h
+//
+//Reference versions of the Image operations for hw1_verify.
+//
+//These are the plain per-pixel loops the operations were first written as:
+//one pixel at a time through GetPixel, double precision, no threads, no
+//SIMD, no lookup tables.  They define what the optimized code in src/ must
+//compute, so keep them simple and do not optimize them.
+//
+//Where an operation uses noise, the reference computes each pixel's value
+//straight from noise.h's hash, for the first stream of the given seed.
+
+#ifndef REFERENCE_INCLUDED
+#define REFERENCE_INCLUDED
+
+#include "image.h"
+
+void ReferenceAddNoise (Image &img, double factor, uint32_t seed);
+void ReferenceBrighten (Image &img, double factor);
+void ReferenceChangeContrast (Image &img, double factor);
+void ReferenceChangeSaturation (Image &img, double factor);
+Image ReferenceCrop (const Image &img, int x, int y, int w, int h);
+void ReferenceExtractChannel (Image &img, int channel);
+void ReferenceQuantize (Image &img, int nbits);
+void ReferenceRandomDither (Image &img, int nbits, uint32_t seed);
+
+// Uses the same threshold matrices as Image::OrderedDither.
+void ReferenceOrderedDither (Image &img, int nbits, int matrix);
+
+// Diffuses the error of each component at full precision, rounding it only
+// when it is added to a pixel.  Alpha is left unchanged.
+void ReferenceDiffusionDither (Image &img, int nbits, int kernel, int scan);
+void ReferenceFloydSteinbergDither (Image &img, int nbits, int scan);
+
+// Direct 2D convolution with a normalized Gaussian of standard deviation
+// sigma and the given radius, mirroring at the borders (reflect-101).
+void ReferenceGaussian (Image &img, double sigma, int radius);
+
+// Blur(n) is ReferenceGaussian(n, 3n).
+void ReferenceBlur (Image &img, int n);
+
+// BlurFast's three box filters (Kovesi's widths for sigma), each summed
+// directly over its window rather than as a running sum.
+void ReferenceBoxBlur (Image &img, double sigma);
+
+// Like Image::Sharpen, blurs with the box filters from n = 4 up.
+void ReferenceSharpen (Image &img, int n);
+void ReferenceEdgeDetect (Image &img);
+
+// Direct convolutions, mapping every tap past the edges on its own.
+// Results round as documented in convolve.h.
+void ReferenceConvolve (Image &img, int kw, int kh, const int *weights, int divisor, int bias, int border);
+void ReferenceGradient (Image &img, const int *gx, const int *gy, int output, int border);
+
+// Sum the box around each pixel directly, cut off at the edges.
+void ReferenceBoxFilter (Image &img, int radius);
+void ReferenceLocalContrast (Image &img, int radius, double factor);
+
+// Percentiles and cumulative counts from the sorted channel values.
+void ReferenceAutoLevels (Image &img, double clipPercent);
+void ReferenceEqualize (Image &img);
+
+// The sampling operations use the sampling method set on img.  Scale with
+// the resampling filters is a direct 2D convolution, in double.  Otherwise
+// Scale and Rotate sample at the fixed-point source points of warp.h.
+Image ReferenceScale (const Image &img, double sx, double sy);
+Image ReferenceRotate (const Image &img, double angle);
+
+// Reorientation, one pixel at a time.  Quarter turns are clockwise.
+Image ReferenceRotate90 (const Image &img);
+Image ReferenceRotate180 (const Image &img);
+Image ReferenceRotate270 (const Image &img);
+Image ReferenceTranspose (const Image &img);
+void ReferenceFlipHorizontal (Image &img);
+void ReferenceFlipVertical (Image &img);
+void ReferenceFun (Image &img);
+
+#endif
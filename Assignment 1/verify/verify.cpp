@@ -0,0 +1,950 @@
+//verify.cpp
+//
+//Differential check of the optimized Image operations against the
+//reference loops in reference.cpp:
+//
+//  hw1_verify [-cases n] [-seed s] [-filter name]
+//
+//Every case draws a random image (including 1 pixel, single row, single
+//column and odd sizes) and random parameters, runs the reference once,
+//then runs the optimized operation under every combination of thread
+//count and SIMD level, and for point operations also through the fused
+//PointOpPipeline.  The largest per-channel difference seen for each
+//operation is compared with that operation's tolerance.
+//
+//The pixelrow kernels are also run on their own at every SIMD level over
+//every byte input (every pair for the two-row kernels) and must match the
+//scalar kernels exactly.
+//
+//The exit status is 1 if any operation exceeds its tolerance.  A new
+//optimized path should pass this before it becomes the default.
+
+#include "convolve.h"
+#include "image.h"
+#include "noise.h"
+#include "parallel.h"
+#include "pixelrow.h"
+#include "planar.h"
+#include "pointops.h"
+#include "reference.h"
+#include "strip.h"
+#include "typedimage.h"
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace std;
+
+// Thread counts every optimized run is repeated with
+static const int VERIFY_THREADS[] = { 1, 2, 7 };
+
+
+/**
+ * Random numbers for the harness itself, so that the noise streams are
+ * left to the operations that use them
+ **/
+struct Rng {
+	uint64_t s;
+	explicit Rng (uint64_t seed) : s(seed * 0x9e3779b97f4a7c15ull + 1) {}
+	uint32_t Next () { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return (uint32_t) (s >> 16); }
+	int Int (int lo, int hi) { return lo + (int) (Next() % (uint32_t) (hi - lo + 1)); }
+	double Real (double lo, double hi) { return lo + (hi - lo) * (Next() / 4294967296.0); }
+};
+
+static Image RandomImage (Rng &rng, int min_size, int max_size)
+{
+	int w, h;
+	switch (rng.Int(0, 5)) {
+		case 0:  w = 1; h = 1; break;
+		case 1:  w = 1; h = rng.Int(2, max_size); break;
+		case 2:  w = rng.Int(2, max_size); h = 1; break;
+		case 3:  w = 2*rng.Int(1, 20) + 1; h = 2*rng.Int(1, 20) + 1; break;
+		default: w = rng.Int(2, max_size); h = rng.Int(2, max_size); break;
+	}
+	if (w < min_size) w = min_size;
+	if (h < min_size) h = min_size;
+
+	// Noise, flat areas and gradients, so both typical and extreme values occur
+	Image img(w, h);
+	int style = rng.Int(0, 2);
+	Pixel flat(rng.Int(0, 255), rng.Int(0, 255), rng.Int(0, 255), rng.Int(0, 255));
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			Pixel &p = img.GetPixel(x, y);
+			if (style == 0)
+				p = Pixel(rng.Int(0, 255), rng.Int(0, 255), rng.Int(0, 255), rng.Int(0, 255));
+			else if (style == 1)
+				p = flat;
+			else
+				p = Pixel(x * 255 / w, y * 255 / h, (x + y) * 255 / (w + h), 255 - x * 255 / w);
+		}
+	}
+	return img;
+}
+
+
+/**
+ * Operations under test
+ **/
+struct VerifyOp {
+	string name;
+	int tolerance;       // largest allowed per-channel difference
+	int min_size;        // smallest width and height the operation handles
+	int max_size;        // keeps the slow reference loops quick
+	bool point_op;       // also run through PointOpPipeline
+	function<void(Rng&, double*)> params;
+	function<void(Image&, const double*)> optimized;
+	function<void(Image&, const double*)> reference;
+	double outliers = 0; // fraction of pixels allowed past tolerance
+};
+
+// Queues point op number p[0] with argument p[1] on a pipeline
+static void QueuePointOp (PointOpPipeline &pipe, const double *p)
+{
+	switch ((int) p[0]) {
+		case 0: pipe.Brighten(p[1]); break;
+		case 1: pipe.ChangeContrast(p[1]); break;
+		case 2: pipe.ChangeSaturation(p[1]); break;
+		case 3: pipe.ExtractChannel((int) p[1]); break;
+		default: pipe.Quantize((int) p[1]); break;
+	}
+}
+
+static void ReferencePointOp (Image &img, const double *p)
+{
+	switch ((int) p[0]) {
+		case 0: ReferenceBrighten(img, p[1]); break;
+		case 1: ReferenceChangeContrast(img, p[1]); break;
+		case 2: ReferenceChangeSaturation(img, p[1]); break;
+		case 3: ReferenceExtractChannel(img, (int) p[1]); break;
+		default: ReferenceQuantize(img, (int) p[1]); break;
+	}
+}
+
+static void RandomPointOp (Rng &rng, double *p)
+{
+	p[0] = rng.Int(0, 4);
+	switch ((int) p[0]) {
+		case 0: p[1] = rng.Real(0, 2.5); break;
+		case 1: p[1] = rng.Real(-1, 2.5); break;
+		case 2: p[1] = rng.Real(-1, 2.5); break;
+		case 3: p[1] = rng.Int(0, 3); break;
+		default: p[1] = rng.Int(1, 8); break;
+	}
+}
+
+// Blur and BlurFast keep float intermediates; the references use double
+static const int BLUR_TOLERANCE = 1;
+
+// The resampler rounds its weights and its intermediate rows to integers
+static const int RESAMPLE_TOLERANCE = 1;
+
+// Scale and Rotate step through the source in fixed point, the references
+// map in double, so a rare sample landing within a rounding step of a pixel
+// edge may pick its neighbor.  One pixel in 10,000 may do so.
+static const double WARP_OUTLIERS = 1e-4;
+
+// The ops of a wide working format, widened to PixelT and rounded back
+// once.  They round where the 8-bit ops truncate, and contrast uses the
+// unrounded mean luminance, so they only agree with the 8-bit references
+// to within that.
+template <class PixelT>
+static void AddWideOps (vector<VerifyOp> &ops, const string &format)
+{
+	typedef TypedImage<PixelT> Wide;
+	auto widened = [](function<void(Wide&, const double*)> fn) {
+		return [fn](Image &img, const double *p) {
+			Wide wide(img);
+			fn(wide, p);
+			img = wide.ToImage();
+		};
+	};
+	ops.push_back({ format + "/brightness", 1, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 2.5); },
+		widened([](Wide &im, const double *p) { im.Brighten(p[0]); }),
+		[](Image &img, const double *p) { ReferenceBrighten(img, p[0]); } });
+	ops.push_back({ format + "/contrast", 2, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 2); },
+		widened([](Wide &im, const double *p) { im.ChangeContrast(p[0]); }),
+		[](Image &img, const double *p) { ReferenceChangeContrast(img, p[0]); } });
+	ops.push_back({ format + "/saturation", 2, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 2); },
+		widened([](Wide &im, const double *p) { im.ChangeSaturation(p[0]); }),
+		[](Image &img, const double *p) { ReferenceChangeSaturation(img, p[0]); } });
+	ops.push_back({ format + "/extractChannel", 0, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(0, 3); },
+		widened([](Wide &im, const double *p) { im.ExtractChannel((int) p[0]); }),
+		[](Image &img, const double *p) { ReferenceExtractChannel(img, (int) p[0]); } });
+	ops.push_back({ format + "/crop", 0, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 1); p[1] = rng.Real(0, 1); p[2] = rng.Real(0, 1); p[3] = rng.Real(0, 1); },
+		widened([](Wide &im, const double *p) {
+			int x = (int) (p[0] * im.Width()), y = (int) (p[1] * im.Height());
+			im = im.Crop(x, y, 1 + (int) (p[2] * (im.Width() - x - 1)), 1 + (int) (p[3] * (im.Height() - y - 1)));
+		}),
+		[](Image &img, const double *p) {
+			int x = (int) (p[0] * img.Width()), y = (int) (p[1] * img.Height());
+			img = ReferenceCrop(img, x, y, 1 + (int) (p[2] * (img.Width() - x - 1)), 1 + (int) (p[3] * (img.Height() - y - 1)));
+		} });
+	ops.push_back({ format + "/blur", BLUR_TOLERANCE, 1, 48, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 3); },
+		widened([](Wide &im, const double *p) { im.Blur((int) p[0]); }),
+		[](Image &img, const double *p) { ReferenceBlur(img, (int) p[0]); } });
+	ops.push_back({ format + "/blurFast", BLUR_TOLERANCE, 1, 48, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0.5, 6); },
+		widened([](Wide &im, const double *p) { im.BlurFast(p[0]); }),
+		[](Image &img, const double *p) { ReferenceBoxBlur(img, p[0]); } });
+	ops.push_back({ format + "/sharpen", 2*BLUR_TOLERANCE, 1, 48, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 6); },
+		widened([](Wide &im, const double *p) { im.Sharpen((int) p[0]); }),
+		[](Image &img, const double *p) { ReferenceSharpen(img, (int) p[0]); } });
+}
+
+// Ops on a sub-rectangle through Image::Wrap, which change the pixels in
+// place with a row stride wider than the rectangle.  The reference runs on
+// a cropped copy that is pasted back, so pixels outside the rectangle must
+// come through untouched.  p[0..3] place the rectangle; the op's own
+// parameters follow.
+static void ViewRect (const Image &img, const double *p, int *x, int *y, int *w, int *h)
+{
+	*x = (int) (p[0] * img.Width());
+	*y = (int) (p[1] * img.Height());
+	*w = 1 + (int) (p[2] * (img.Width() - *x - 1));
+	*h = 1 + (int) (p[3] * (img.Height() - *y - 1));
+}
+
+typedef function<void(Image&, const double*)> ViewFn;
+
+static void AddViewOp (vector<VerifyOp> &ops, const string &name, int tolerance, int max_size,
+                       function<void(Rng&, double*)> params, ViewFn optimized, ViewFn reference)
+{
+	ops.push_back({ "view/" + name, tolerance, 1, max_size, false,
+		[params](Rng &rng, double *p) {
+			for (int i = 0; i < 4; i++) p[i] = rng.Real(0, 1);
+			params(rng, p + 4);
+		},
+		[optimized](Image &img, const double *p) {
+			int x, y, w, h;
+			ViewRect(img, p, &x, &y, &w, &h);
+			Image region = Image::Wrap(img.View(x, y, w, h));
+			optimized(region, p + 4);
+			assert(region.Row(0) == &img.GetPixel(x, y));
+		},
+		[reference](Image &img, const double *p) {
+			int x, y, w, h;
+			ViewRect(img, p, &x, &y, &w, &h);
+			Image region = ReferenceCrop(img, x, y, w, h);
+			reference(region, p + 4);
+			for (int j = 0; j < h; j++)
+				for (int i = 0; i < w; i++) img.SetPixel(x + i, y + j, region.GetPixel(i, j));
+		} });
+}
+
+static void AddViewOps (vector<VerifyOp> &ops)
+{
+	auto none = [](Rng &, double *) {};
+	AddViewOp(ops, "contrast", 0, 64,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 2); },
+		[](Image &img, const double *p) { img.ChangeContrast(p[0]); },
+		[](Image &img, const double *p) { ReferenceChangeContrast(img, p[0]); });
+	AddViewOp(ops, "pointChain", 0, 64,
+		[](Rng &rng, double *p) {
+			p[0] = rng.Int(2, 4);
+			for (int i = 0; i < (int) p[0]; i++) RandomPointOp(rng, p + 1 + 2*i);
+		},
+		[](Image &img, const double *p) {
+			PointOpPipeline pipe;
+			for (int i = 0; i < (int) p[0]; i++) QueuePointOp(pipe, p + 1 + 2*i);
+			pipe.Apply(&img);
+		},
+		[](Image &img, const double *p) {
+			for (int i = 0; i < (int) p[0]; i++) ReferencePointOp(img, p + 1 + 2*i);
+		});
+	AddViewOp(ops, "FloydSteinbergDither", 0, 100,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 7); p[1] = rng.Int(0, IMAGE_N_DITHER_SCANS - 1); },
+		[](Image &img, const double *p) { img.FloydSteinbergDither((int) p[0], (int) p[1]); },
+		[](Image &img, const double *p) { ReferenceFloydSteinbergDither(img, (int) p[0], (int) p[1]); });
+	AddViewOp(ops, "blur", BLUR_TOLERANCE, 48,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 3); },
+		[](Image &img, const double *p) { img.Blur((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceBlur(img, (int) p[0]); });
+	AddViewOp(ops, "blurFast", BLUR_TOLERANCE, 48,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0.5, 6); },
+		[](Image &img, const double *p) { img.BlurFast(p[0]); },
+		[](Image &img, const double *p) { ReferenceBoxBlur(img, p[0]); });
+	AddViewOp(ops, "sharpen", 2*BLUR_TOLERANCE, 48,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 6); },
+		[](Image &img, const double *p) { img.Sharpen((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceSharpen(img, (int) p[0]); });
+	AddViewOp(ops, "edgeDetect", 0, 64, none,
+		[](Image &img, const double *) { img.EdgeDetect(); },
+		[](Image &img, const double *) { ReferenceEdgeDetect(img); });
+	AddViewOp(ops, "sobel", 0, 64, none,
+		[](Image &img, const double *) { img.Sobel(); },
+		[](Image &img, const double *) {
+			static const int gx[9] = { -1, 0, 1, -2, 0, 2, -1, 0, 1 }, gy[9] = { -1, -2, -1, 0, 0, 0, 1, 2, 1 };
+			ReferenceGradient(img, gx, gy, IMAGE_GRADIENT_MAGNITUDE, IMAGE_BORDER_MIRROR);
+		});
+	AddViewOp(ops, "localContrast", 0, 100,
+		[](Rng &rng, double *p) { p[0] = rng.Int(0, 20); p[1] = rng.Real(-1, 3); },
+		[](Image &img, const double *p) { img.LocalContrast((int) p[0], p[1]); },
+		[](Image &img, const double *p) { ReferenceLocalContrast(img, (int) p[0], p[1]); });
+	AddViewOp(ops, "equalize", 0, 100, none,
+		[](Image &img, const double *) { img.Equalize(); },
+		[](Image &img, const double *) { ReferenceEqualize(img); });
+	AddViewOp(ops, "flipH", 0, 200, none,
+		[](Image &img, const double *) { img.FlipHorizontal(); },
+		[](Image &img, const double *) { ReferenceFlipHorizontal(img); });
+
+	// Ops that return a new image read the rectangle and own their result
+	ops.push_back({ "view/rotate90", 0, 1, 200, false,
+		[](Rng &rng, double *p) { for (int i = 0; i < 4; i++) p[i] = rng.Real(0, 1); },
+		[](Image &img, const double *p) {
+			int x, y, w, h;
+			ViewRect(img, p, &x, &y, &w, &h);
+			img = Image::Wrap(img.View(x, y, w, h)).Rotate90();
+		},
+		[](Image &img, const double *p) {
+			int x, y, w, h;
+			ViewRect(img, p, &x, &y, &w, &h);
+			img = ReferenceRotate90(ReferenceCrop(img, x, y, w, h));
+		} });
+	ops.push_back({ "view/copy", 0, 1, 64, false,
+		[](Rng &rng, double *p) { for (int i = 0; i < 8; i++) p[i] = rng.Real(0, 1); },
+		[](Image &img, const double *p) {
+			// A view of a view, copied into an image of its own
+			int x, y, w, h, x2, y2, w2, h2;
+			ViewRect(img, p, &x, &y, &w, &h);
+			ImageView view = img.View(x, y, w, h);
+			Image outer = Image::Wrap(view);
+			ViewRect(outer, p + 4, &x2, &y2, &w2, &h2);
+			img = Image(view.Sub(x2, y2, w2, h2));
+		},
+		[](Image &img, const double *p) {
+			int x, y, w, h;
+			ViewRect(img, p, &x, &y, &w, &h);
+			img = ReferenceCrop(img, x, y, w, h);
+			ViewRect(img, p + 4, &x, &y, &w, &h);
+			img = ReferenceCrop(img, x, y, w, h);
+		} });
+}
+
+// Runs op on img as -stream does: written to a PAM file, streamed through
+// a StripPipeline strip_rows rows at a time, and read back
+static void Streamed (Image &img, int halo, function<void(Image *)> op, int strip_rows)
+{
+	const char *dir = getenv("TMPDIR");
+	string base = string(dir ? dir : "/tmp") + "/hw1_verify_" + to_string(getpid());
+	string in = base + "_in.pam", out = base + "_out.pam";
+	img.Write(&in[0]);
+
+	StripPipeline pipe;
+	pipe.Add(halo, op);
+	img = pipe.Run(in.c_str(), out.c_str(), strip_rows) ? Image(&out[0]) : Image();
+	remove(in.c_str());
+	remove(out.c_str());
+}
+
+static vector<VerifyOp> MakeOps ()
+{
+	static const char *sampling[IMAGE_N_SAMPLING_METHODS] = {
+		"point", "bilinear", "gaussian", "box", "triangle", "mitchell", "lanczos3", "trilinear"
+	};
+	vector<VerifyOp> ops;
+
+	ops.push_back({ "noise", 0, 1, 320, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 1); p[1] = rng.Next(); },
+		[](Image &img, const double *p) { SetNoiseSeed((uint32_t) p[1]); img.AddNoise(p[0]); },
+		[](Image &img, const double *p) { ReferenceAddNoise(img, p[0], (uint32_t) p[1]); } });
+	ops.push_back({ "brightness", 0, 1, 64, true,
+		[](Rng &rng, double *p) { p[0] = 0; p[1] = rng.Real(0, 2.5); },
+		[](Image &img, const double *p) { img.Brighten(p[1]); },
+		[](Image &img, const double *p) { ReferenceBrighten(img, p[1]); } });
+	ops.push_back({ "contrast", 0, 1, 64, true,
+		[](Rng &rng, double *p) { p[0] = 1; p[1] = rng.Real(-1, 2.5); },
+		[](Image &img, const double *p) { img.ChangeContrast(p[1]); },
+		[](Image &img, const double *p) { ReferenceChangeContrast(img, p[1]); } });
+	ops.push_back({ "saturation", 0, 1, 64, true,
+		[](Rng &rng, double *p) { p[0] = 2; p[1] = rng.Real(-1, 2.5); },
+		[](Image &img, const double *p) { img.ChangeSaturation(p[1]); },
+		[](Image &img, const double *p) { ReferenceChangeSaturation(img, p[1]); } });
+	ops.push_back({ "extractChannel", 0, 1, 64, true,
+		[](Rng &rng, double *p) { p[0] = 3; p[1] = rng.Int(0, 3); },
+		[](Image &img, const double *p) { img.ExtractChannel((int) p[1]); },
+		[](Image &img, const double *p) { ReferenceExtractChannel(img, (int) p[1]); } });
+	ops.push_back({ "quantize", 0, 1, 64, true,
+		[](Rng &rng, double *p) { p[0] = 4; p[1] = rng.Int(1, 8); },
+		[](Image &img, const double *p) { img.Quantize((int) p[1]); },
+		[](Image &img, const double *p) { ReferenceQuantize(img, (int) p[1]); } });
+	// Chains of up to four point ops, which the CLI fuses into one pass
+	ops.push_back({ "pointChain", 0, 1, 64, false,
+		[](Rng &rng, double *p) {
+			p[0] = rng.Int(2, 4);
+			for (int i = 0; i < (int) p[0]; i++) RandomPointOp(rng, p + 1 + 2*i);
+		},
+		[](Image &img, const double *p) {
+			PointOpPipeline pipe;
+			for (int i = 0; i < (int) p[0]; i++) QueuePointOp(pipe, p + 1 + 2*i);
+			pipe.Apply(&img);
+		},
+		[](Image &img, const double *p) {
+			for (int i = 0; i < (int) p[0]; i++) ReferencePointOp(img, p + 1 + 2*i);
+		} });
+	ops.push_back({ "crop", 0, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 1); p[1] = rng.Real(0, 1); p[2] = rng.Real(0, 1); p[3] = rng.Real(0, 1); },
+		[](Image &img, const double *p) {
+			int x = (int) (p[0] * img.Width()), y = (int) (p[1] * img.Height());
+			img = img.Crop(x, y, 1 + (int) (p[2] * (img.Width() - x - 1)), 1 + (int) (p[3] * (img.Height() - y - 1)));
+		},
+		[](Image &img, const double *p) {
+			int x = (int) (p[0] * img.Width()), y = (int) (p[1] * img.Height());
+			img = ReferenceCrop(img, x, y, 1 + (int) (p[2] * (img.Width() - x - 1)), 1 + (int) (p[3] * (img.Height() - y - 1)));
+		} });
+	ops.push_back({ "randomDither", 0, 1, 320, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 7); p[1] = rng.Next(); },
+		[](Image &img, const double *p) { SetNoiseSeed((uint32_t) p[1]); img.RandomDither((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceRandomDither(img, (int) p[0], (uint32_t) p[1]); } });
+	ops.push_back({ "orderedDither", 0, 1, 320, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 8); p[1] = rng.Int(0, IMAGE_N_DITHER_MATRICES - 1); },
+		[](Image &img, const double *p) { img.OrderedDither((int) p[0], (int) p[1]); },
+		[](Image &img, const double *p) { ReferenceOrderedDither(img, (int) p[0], (int) p[1]); } });
+	ops.push_back({ "FloydSteinbergDither", 0, 1, 160, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 7); p[1] = rng.Int(0, IMAGE_N_DITHER_SCANS - 1); },
+		[](Image &img, const double *p) { img.FloydSteinbergDither((int) p[0], (int) p[1]); },
+		[](Image &img, const double *p) { ReferenceFloydSteinbergDither(img, (int) p[0], (int) p[1]); } });
+	ops.push_back({ "diffusionDither", 0, 1, 160, false,
+		[](Rng &rng, double *p) {
+			p[0] = rng.Int(1, 7);
+			p[1] = rng.Int(0, IMAGE_N_DIFFUSION_KERNELS - 1);
+			p[2] = rng.Int(0, IMAGE_N_DITHER_SCANS - 1);
+		},
+		[](Image &img, const double *p) { img.DiffusionDither((int) p[0], (int) p[1], (int) p[2]); },
+		[](Image &img, const double *p) { ReferenceDiffusionDither(img, (int) p[0], (int) p[1], (int) p[2]); } });
+	ops.push_back({ "blur", BLUR_TOLERANCE, 1, 48, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 3); },
+		[](Image &img, const double *p) { img.Blur((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceBlur(img, (int) p[0]); } });
+	ops.push_back({ "blurFast", BLUR_TOLERANCE, 1, 48, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0.5, 6); },
+		[](Image &img, const double *p) { img.BlurFast(p[0]); },
+		[](Image &img, const double *p) { ReferenceBoxBlur(img, p[0]); } });
+	// Sharpen extrapolates away from the blur, doubling its error
+	ops.push_back({ "sharpen", 2*BLUR_TOLERANCE, 1, 48, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 6); },
+		[](Image &img, const double *p) { img.Sharpen((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceSharpen(img, (int) p[0]); } });
+	ops.push_back({ "edgeDetect", 0, 1, 64, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img.EdgeDetect(); },
+		[](Image &img, const double *) { ReferenceEdgeDetect(img); } });
+	// Random kernels up to 7x7, some weights zero, under each border.  Some
+	// have weights up to the limit, whose sums float cannot hold exactly,
+	// and even divisors, where the quotient can be a tie.
+	static const char *borders[3] = { "mirror", "clamp", "wrap" };
+	for (int b = 0; b < 3; b++) {
+		ops.push_back({ string("convolve/") + borders[b], 0, 1, 48, false,
+			[b](Rng &rng, double *p) {
+				int kw = 2*rng.Int(0, 3) + 1, kh = 2*rng.Int(0, 3) + 1, sum = 0;
+				int weight = rng.Int(0, 3) ? 40 : CONVOLUTION_MAX_WEIGHT;
+				p[0] = b; p[1] = kw; p[2] = kh;
+				for (int i = 0; i < kw*kh; i++) {
+					p[5 + i] = rng.Int(0, 2) ? rng.Int(-weight, weight) : 0;
+					sum += (int) p[5 + i];
+				}
+				switch (rng.Int(0, 3)) {
+					case 0:  p[3] = 1; break;
+					case 1:  p[3] = sum > 0 ? sum : 1; break;
+					case 2:  p[3] = rng.Int(-300, 300) | 1; break;
+					default: p[3] = 2 * rng.Int(1, weight == 40 ? 150 : 1 << 20) * (rng.Int(0, 1) ? 1 : -1); break;
+				}
+				p[4] = rng.Int(-64, 64);
+			},
+			[](Image &img, const double *p) {
+				ConvolutionKernel k;
+				k.width = (int) p[1]; k.height = (int) p[2]; k.divisor = (int) p[3]; k.bias = (int) p[4];
+				for (int i = 0; i < k.width * k.height; i++) k.weights.push_back((int) p[5 + i]);
+				Convolve(img, k, (int) p[0]);
+			},
+			[](Image &img, const double *p) {
+				int w[49];
+				for (int i = 0; i < (int) (p[1] * p[2]); i++) w[i] = (int) p[5 + i];
+				ReferenceConvolve(img, (int) p[1], (int) p[2], w, (int) p[3], (int) p[4], (int) p[0]);
+			} });
+	}
+	// The named 3x3 kernels, under a random border
+	static const int laplacian[9] = { 0, -1, 0, -1, 4, -1, 0, -1, 0 };
+	static const int emboss[9] = { -2, -1, 0, -1, 1, 1, 0, 1, 2 };
+	static const int sobelX[9] = { -1, 0, 1, -2, 0, 2, -1, 0, 1 }, sobelY[9] = { -1, -2, -1, 0, 0, 0, 1, 2, 1 };
+	static const int prewittX[9] = { -1, 0, 1, -1, 0, 1, -1, 0, 1 }, prewittY[9] = { -1, -1, -1, 0, 0, 0, 1, 1, 1 };
+	auto border = [](Rng &rng, double *p) { p[0] = rng.Int(0, 2); };
+	ops.push_back({ "laplacian", 0, 1, 64, false, border,
+		[](Image &img, const double *p) { img.Laplacian((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceConvolve(img, 3, 3, laplacian, 1, 0, (int) p[0]); } });
+	ops.push_back({ "emboss", 0, 1, 64, false, border,
+		[](Image &img, const double *p) { img.Emboss((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceConvolve(img, 3, 3, emboss, 1, 0, (int) p[0]); } });
+	for (int g = 0; g < IMAGE_N_GRADIENT_OUTPUTS; g++) {
+		const char *output = (g == IMAGE_GRADIENT_MAGNITUDE) ? "magnitude" : "direction";
+		ops.push_back({ string("sobel/") + output, 0, 1, 64, false, border,
+			[g](Image &img, const double *p) { img.Sobel(g, (int) p[0]); },
+			[g](Image &img, const double *p) { ReferenceGradient(img, sobelX, sobelY, g, (int) p[0]); } });
+		ops.push_back({ string("prewitt/") + output, 0, 1, 64, false, border,
+			[g](Image &img, const double *p) { img.Prewitt(g, (int) p[0]); },
+			[g](Image &img, const double *p) { ReferenceGradient(img, prewittX, prewittY, g, (int) p[0]); } });
+	}
+	ops.push_back({ "boxFilter", 0, 1, 100, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(0, 20); },
+		[](Image &img, const double *p) { img.BoxFilter((int) p[0]); },
+		[](Image &img, const double *p) { ReferenceBoxFilter(img, (int) p[0]); } });
+	ops.push_back({ "localContrast", 0, 1, 100, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(0, 20); p[1] = rng.Real(-1, 3); },
+		[](Image &img, const double *p) { img.LocalContrast((int) p[0], p[1]); },
+		[](Image &img, const double *p) { ReferenceLocalContrast(img, (int) p[0], p[1]); } });
+	ops.push_back({ "autoLevels", 0, 1, 100, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0, 10); },
+		[](Image &img, const double *p) { img.AutoLevels(p[0]); },
+		[](Image &img, const double *p) { ReferenceAutoLevels(img, p[0]); } });
+	ops.push_back({ "equalize", 0, 1, 100, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img.Equalize(); },
+		[](Image &img, const double *) { ReferenceEqualize(img); } });
+
+	// Big enough for the transpose to split into cache blocks
+	ops.push_back({ "rotate90", 0, 1, 200, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img = img.Rotate90(); },
+		[](Image &img, const double *) { img = ReferenceRotate90(img); } });
+	ops.push_back({ "rotate180", 0, 1, 200, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img = img.Rotate180(); },
+		[](Image &img, const double *) { img = ReferenceRotate180(img); } });
+	ops.push_back({ "rotate270", 0, 1, 200, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img = img.Rotate270(); },
+		[](Image &img, const double *) { img = ReferenceRotate270(img); } });
+	ops.push_back({ "transpose", 0, 1, 200, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img = img.Transpose(); },
+		[](Image &img, const double *) { img = ReferenceTranspose(img); } });
+	ops.push_back({ "flipH", 0, 1, 200, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img.FlipHorizontal(); },
+		[](Image &img, const double *) { ReferenceFlipHorizontal(img); } });
+	ops.push_back({ "flipV", 0, 1, 200, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img.FlipVertical(); },
+		[](Image &img, const double *) { ReferenceFlipVertical(img); } });
+	ops.push_back({ "rotate/quarterTurns", 0, 1, 200, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(-4, 4) * (M_PI/2); },
+		[](Image &img, const double *p) { img = img.Rotate(p[0]); },
+		[](Image &img, const double *p) { img = ReferenceRotate(img, p[0]); } });
+
+	// The legacy samplers read up to 6 pixels past the sample position and
+	// only mirror once, so they need images at least that big.  Rotating
+	// tiny images can also produce an empty result.  The resampling filters
+	// round in fixed point, in two passes, and trilinear blends in another
+	// order than the reference.
+	for (int m = 0; m < IMAGE_N_SAMPLING_METHODS; m++) {
+		int min_size = (m == IMAGE_SAMPLING_POINT || m >= IMAGE_SAMPLING_BOX) ? 1 : 8;
+		int tolerance = (m >= IMAGE_SAMPLING_BOX) ? RESAMPLE_TOLERANCE : 0;
+		ops.push_back({ string("scale/") + sampling[m], tolerance, min_size, 48, false,
+			[m](Rng &rng, double *p) { p[0] = m; p[1] = rng.Real(0.1, 2.5); p[2] = rng.Real(0.1, 2.5); },
+			[](Image &img, const double *p) {
+				img.SetSamplingMethod((int) p[0]);
+				if ((int) (p[1]*img.Width()) > 0 && (int) (p[2]*img.Height()) > 0) img = img.Scale(p[1], p[2]);
+			},
+			[](Image &img, const double *p) {
+				img.SetSamplingMethod((int) p[0]);
+				if ((int) (p[1]*img.Width()) > 0 && (int) (p[2]*img.Height()) > 0) img = ReferenceScale(img, p[1], p[2]);
+			}, WARP_OUTLIERS });
+		ops.push_back({ string("rotate/") + sampling[m], tolerance, 8, 48, false,
+			[m](Rng &rng, double *p) { p[0] = m; p[1] = rng.Real(-M_PI, M_PI); },
+			[](Image &img, const double *p) { img.SetSamplingMethod((int) p[0]); img = img.Rotate(p[1]); },
+			[](Image &img, const double *p) { img.SetSamplingMethod((int) p[0]); img = ReferenceRotate(img, p[1]); }, WARP_OUTLIERS });
+		ops.push_back({ string("fun/") + sampling[m], tolerance, min_size, 48, false,
+			[m](Rng &, double *p) { p[0] = m; },
+			[](Image &img, const double *p) { img.SetSamplingMethod((int) p[0]); img.Fun(); },
+			[](Image &img, const double *p) { img.SetSamplingMethod((int) p[0]); ReferenceFun(img); } });
+	}
+
+	// The planar layout: a round trip through the planes, both kinds of
+	// channel view, and the ops with a planar version
+	ops.push_back({ "planar/convert", 0, 1, 100, false,
+		[](Rng &, double *) {},
+		[](Image &img, const double *) { img = PlanarImage(img).ToImage(); },
+		[](Image &, const double *) {} });
+	ops.push_back({ "planar/channelView", 0, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(0, 1); },
+		[](Image &img, const double *p) {
+			// Rebuilds the image a channel at a time from planar or
+			// interleaved views
+			PlanarImage planar(img);
+			Image copy(img.Width(), img.Height());
+			for (int c = 0; c < IMAGE_N_CHANNELS; c++) {
+				ChannelView from = p[0] ? planar.Channel(c) : ImageChannel(img, c);
+				ChannelView to = ImageChannel(copy, c);
+				for (int y = 0; y < img.Height(); y++)
+					for (int x = 0; x < img.Width(); x++) to(x, y) = from(x, y);
+			}
+			img = copy;
+		},
+		[](Image &, const double *) {} });
+	ops.push_back({ "planar/extractChannel", 0, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(0, 3); },
+		[](Image &img, const double *p) { PlanarImage planar(img); planar.ExtractChannel((int) p[0]); planar.Interleave(img); },
+		[](Image &img, const double *p) { ReferenceExtractChannel(img, (int) p[0]); } });
+	ops.push_back({ "planar/quantize", 0, 1, 64, false,
+		[](Rng &rng, double *p) { p[0] = rng.Int(1, 8); },
+		[](Image &img, const double *p) { PlanarImage planar(img); planar.Quantize((int) p[0]); planar.Interleave(img); },
+		[](Image &img, const double *p) { ReferenceQuantize(img, (int) p[0]); } });
+
+	// Streaming in strips must give the same bytes as the whole image.  The
+	// halo is the one main.cpp queues -blurFast with.
+	ops.push_back({ "stream/blurFast", 0, 1, 128, false,
+		[](Rng &rng, double *p) { p[0] = rng.Real(0.5, 6); p[1] = rng.Int(1, 16); },
+		[](Image &img, const double *p) {
+			double sigma = p[0];
+			Streamed(img, (int) ceil(3*sigma) + 3, [=](Image *strip) { strip->BlurFast(sigma); }, (int) p[1]);
+		},
+		[](Image &img, const double *p) { img.BlurFast(p[0]); } });
+
+	AddWideOps<PixelRGBA16>(ops, "u16");
+	AddWideOps<PixelRGBA32F>(ops, "f32");
+	AddViewOps(ops);
+	return ops;
+}
+
+
+/**
+ * Comparison
+ **/
+struct Difference {
+	int max[4];         // per channel
+	int x, y;           // where the largest one is
+	bool size_mismatch;
+	long over, pixels;  // pixels past the tolerance, of all compared
+};
+
+static Difference Compare (const Image &a, const Image &b, int tolerance = 0)
+{
+	Difference d = { { 0, 0, 0, 0 }, -1, -1, false, 0, 0 };
+	if (a.Width() != b.Width() || a.Height() != b.Height()) {
+		d.size_mismatch = true;
+		return d;
+	}
+	int worst = 0;
+	for (int y = 0; y < a.Height(); y++) {
+		for (int x = 0; x < a.Width(); x++) {
+			const Pixel &p = a.GetPixel(x, y), &q = b.GetPixel(x, y);
+			int diff[4] = { abs(p.r - q.r), abs(p.g - q.g), abs(p.b - q.b), abs(p.a - q.a) };
+			bool over = false;
+			for (int c = 0; c < 4; c++) {
+				if (diff[c] > d.max[c]) d.max[c] = diff[c];
+				if (diff[c] > worst) { worst = diff[c]; d.x = x; d.y = y; }
+				over |= diff[c] > tolerance;
+			}
+			d.over += over;
+		}
+	}
+	d.pixels = (long) a.Width() * a.Height();
+	return d;
+}
+
+static int Worst (const Difference &d)
+{
+	if (d.size_mismatch) return 256;
+	int w = 0;
+	for (int c = 0; c < 4; c++) if (d.max[c] > w) w = d.max[c];
+	return w;
+}
+
+// Whether d is within tolerance, but for the allowed fraction of outliers
+static bool Within (const Difference &d, int tolerance, double outliers)
+{
+	if (d.size_mismatch) return false;
+	if (outliers > 0) return d.over <= outliers * d.pixels;
+	return Worst(d) <= tolerance;
+}
+
+
+/**
+ * Row kernels at every SIMD level against the scalar ones, over every
+ * byte input rather than random images
+ **/
+struct RowKernelCheck {
+	string name;
+	int slabs;           // 256 to also run every value of b under each (r, g) pair;
+	                     // each case takes every ROW_KERNEL_SLAB_STEP'th slab, so
+	                     // that many cases in a row cover them all
+	function<void(Rng&, int, double*)> params;   // case number, so the first cases can be edge values
+	function<void(Pixel*, const Pixel*, int, int, const double*)> kernel;   // row, q, n, x0, p
+};
+
+// Row kernels get inputs the tables cover completely: pixel i of slab s is
+// (i & 255, i >> 8, s or i & 255, i >> 8), so r and g each take all 65536
+// pairs with their partner, and q has r and g (and b and a) swapped, so
+// every (row, q) byte pair occurs for every channel
+static const int ROW_KERNEL_PIXELS = 65536;
+static const int ROW_KERNEL_SLAB_STEP = 8;
+
+static void RowKernelInput (Image &img, Image &q, int slab, int slabs)
+{
+	for (int i = 0; i < ROW_KERNEL_PIXELS; i++) {
+		Pixel p(i & 255, i >> 8, slabs > 1 ? slab : (i & 255), i >> 8);
+		img.Row(0)[i] = p;
+		q.Row(0)[i] = Pixel(p.g, p.r, p.a, p.b);
+	}
+}
+
+// Runs the kernel over the row in pieces of 1 to 37 pixels, so every
+// vector tail length and start alignment occurs
+static void RowKernelApply (const RowKernelCheck &check, Image &img, const Image &q, const double *p)
+{
+	int n;
+	for (int x = 0, k = 0; x < ROW_KERNEL_PIXELS; x += n, k++) {
+		n = k % 37 + 1;
+		if (n > ROW_KERNEL_PIXELS - x) n = ROW_KERNEL_PIXELS - x;
+		check.kernel(img.Row(0) + x, q.Row(0) + x, n, x, p);
+	}
+}
+
+static vector<RowKernelCheck> MakeRowKernelChecks ()
+{
+	vector<RowKernelCheck> checks;
+
+	// Zero, identity and saturating factors first, then random ones
+	static const double factors[] = { 0, 1, 0.5, 2, -1 };
+	const int nfactors = sizeof(factors) / sizeof(factors[0]);
+
+	checks.push_back({ "pixelrow/scale", 1,
+		[](Rng &rng, int c, double *p) { p[0] = c < nfactors ? factors[c] : rng.Real(0, 3); },
+		[](Pixel *row, const Pixel *, int n, int, const double *p) { PixelRowScale(row, n, p[0]); } });
+	checks.push_back({ "pixelrow/lerp", 1,
+		[](Rng &rng, int c, double *p) { p[0] = c < nfactors ? factors[c] : rng.Real(-1, 2); },
+		[](Pixel *row, const Pixel *q, int n, int, const double *p) { PixelRowLerp(row, q, n, p[0]); } });
+	checks.push_back({ "pixelrow/add", 1,
+		[](Rng &, int, double *) {},
+		[](Pixel *row, const Pixel *q, int n, int, const double *) { PixelRowAdd(row, q, n); } });
+	checks.push_back({ "pixelrow/contrast", 1,
+		[](Rng &rng, int c, double *p) {
+			p[0] = c < 3 ? 127.5 * c : rng.Real(0, 255);
+			p[1] = c < nfactors ? factors[c] : rng.Real(-1, 3);
+		},
+		[](Pixel *row, const Pixel *, int n, int, const double *p) { PixelRowContrast(row, n, p[0], p[1]); } });
+	checks.push_back({ "pixelrow/saturate", 256,
+		[](Rng &rng, int c, double *p) { p[0] = c < nfactors ? factors[c] : rng.Real(-1, 3); },
+		[](Pixel *row, const Pixel *, int n, int, const double *p) { PixelRowSaturate(row, n, p[0]); } });
+	checks.push_back({ "pixelrow/random", 1,
+		[](Rng &rng, int c, double *p) {
+			p[0] = c == 0 ? 0 : rng.Int(-(1 << 30), 1 << 30);
+			p[1] = rng.Next();
+		},
+		[](Pixel *row, const Pixel *, int n, int x0, const double *p) {
+			PixelRowRandom(row, n, (int) p[0] + x0, (uint32_t) p[1]);
+		} });
+	return checks;
+}
+
+// Prints one table line per kernel; returns the number that differ
+static int CheckRowKernels (int bestSimd, int cases, uint64_t seed, const char *filter)
+{
+	vector<RowKernelCheck> checks = MakeRowKernelChecks();
+	int failed = 0;
+	for (size_t k = 0; k < checks.size(); k++) {
+		const RowKernelCheck &check = checks[k];
+		if (filter && !strstr(check.name.c_str(), filter)) continue;
+
+		Rng rng(seed + 104729 * k);
+		Difference total = { { 0, 0, 0, 0 }, -1, -1, false, 0, 0 };
+		int runs = 0;
+		bool reported = false;
+		Image src(ROW_KERNEL_PIXELS, 1), q(ROW_KERNEL_PIXELS, 1);
+		for (int c = 0; c < cases; c++) {
+			double p[4] = { 0 };
+			check.params(rng, c, p);
+			for (int s = c % ROW_KERNEL_SLAB_STEP % check.slabs; s < check.slabs; s += ROW_KERNEL_SLAB_STEP) {
+				RowKernelInput(src, q, s, check.slabs);
+				SetSimdLevel(SIMD_SCALAR);
+				Image ref(src);
+				RowKernelApply(check, ref, q, p);
+
+				for (int simd = SIMD_SCALAR + 1; simd <= bestSimd; simd++) {
+					SetSimdLevel(simd);
+					Image out(src);
+					RowKernelApply(check, out, q, p);
+					runs++;
+
+					Difference d = Compare(out, ref);
+					for (int ch = 0; ch < 4; ch++)
+						if (d.max[ch] > total.max[ch]) total.max[ch] = d.max[ch];
+					if (Worst(d) > 0 && !reported) {
+						reported = true;
+						const Pixel &in = src.GetPixel(d.x, 0), &qin = q.GetPixel(d.x, 0);
+						printf("  %s differs: case %d, simd %d, max difference %d for (%d, %d, %d, %d) q (%d, %d, %d, %d)\n",
+							check.name.c_str(), c, simd, Worst(d),
+							in.r, in.g, in.b, in.a, qin.r, qin.g, qin.b, qin.a);
+					}
+				}
+			}
+		}
+		SetSimdLevel(bestSimd);
+
+		bool ok = Worst(total) == 0;
+		failed += !ok;
+		char maxText[32];
+		snprintf(maxText, sizeof(maxText), "%d/%d/%d/%d", total.max[0], total.max[1], total.max[2], total.max[3]);
+		printf("%-22s %6d %6d %15s %5d  %s\n", check.name.c_str(), cases, runs, maxText, 0, ok ? "ok" : "FAIL");
+		fflush(stdout);
+	}
+	return failed;
+}
+
+
+/**
+ * BlurFast's box passes on strips of rows against the whole image, as
+ * -stream runs them.  The floats before rounding to bytes must match bit
+ * for bit, which catches sums that depend on where they started long
+ * before a byte comes out different.
+ **/
+static int CheckStripBoxBlur (int cases, uint64_t seed, const char *filter)
+{
+	const char *name = "strip/boxBlurPasses";
+	if (filter && !strstr(name, filter)) return 0;
+
+	Rng rng(seed + 15485863);
+	int runs = 0, differ = 0;
+	for (int c = 0; c < cases; c++) {
+		Image img = RandomImage(rng, 1, 200);
+		double sigma = rng.Real(0.5, 6);
+		int strip_rows = rng.Int(1, 16);
+		int halo = (int) ceil(3*sigma) + 3;   // as main.cpp queues -blurFast
+		int w = img.Width(), h = img.Height();
+		size_t len = (size_t) w * 4;
+
+		vector<float> input(len * h);
+		for (int y = 0; y < h; y++)
+			for (size_t i = 0; i < len; i++) input[y*len + i] = (&img.Row(y)->r)[i];
+		vector<float> full(input);
+		BoxBlurPasses(full.data(), w, h, sigma);
+
+		for (int y0 = 0; y0 < h; y0 += strip_rows) {
+			int y1 = min(y0 + strip_rows, h), top = max(y0 - halo, 0), bottom = min(y1 + halo, h);
+			vector<float> strip(input.begin() + top*len, input.begin() + bottom*len);
+			BoxBlurPasses(strip.data(), w, bottom - top, sigma);
+			runs++;
+			for (int y = y0; y < y1; y++)
+				for (size_t i = 0; i < len; i++)
+					differ += memcmp(&strip[(y - top)*len + i], &full[y*len + i], sizeof(float)) != 0;
+		}
+	}
+
+	char differText[32];
+	snprintf(differText, sizeof(differText), "%d floats", differ);
+	printf("%-22s %6d %6d %15s %5d  %s\n", name, cases, runs, differText, 0, differ ? "FAIL" : "ok");
+	fflush(stdout);
+	return differ != 0;
+}
+
+/**
+ * main
+ **/
+int main (int argc, char *argv[])
+{
+	int cases = 25;
+	uint64_t seed = 1;
+	const char *filter = NULL;
+	for (int i = 1; i < argc; i++) {
+		bool hasArg = i + 1 < argc;
+		if (!strcmp(argv[i], "-cases") && hasArg) cases = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && hasArg) seed = strtoull(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-filter") && hasArg) filter = argv[++i];
+		else {
+			fprintf(stderr, "Usage: hw1_verify [-cases n] [-seed s] [-filter name]\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	int bestSimd = SetSimdLevel(SIMD_N_LEVELS);
+	int nthreads = sizeof(VERIFY_THREADS) / sizeof(VERIFY_THREADS[0]);
+	vector<VerifyOp> ops = MakeOps();
+	int failed = 0;
+
+	printf("%-22s %6s %6s %15s %5s\n", "op", "cases", "runs", "max r/g/b/a", "tol");
+	for (size_t o = 0; o < ops.size(); o++) {
+		const VerifyOp &op = ops[o];
+		if (filter && !strstr(op.name.c_str(), filter)) continue;
+
+		Rng rng(seed + 7919 * o);
+		Difference total = { { 0, 0, 0, 0 }, -1, -1, false, 0, 0 };
+		int runs = 0;
+		bool reported = false;
+		for (int c = 0; c < cases; c++) {
+			double p[64] = { 0 };   // room for a 7x7 kernel
+			Image src = RandomImage(rng, op.min_size, op.max_size);
+			op.params(rng, p);
+
+			Image ref(src);
+			op.reference(ref, p);
+
+			// Every thread count and SIMD level, plus the fused path for point ops
+			int variants = nthreads * (bestSimd + 1) * (op.point_op ? 2 : 1);
+			for (int v = 0; v < variants; v++) {
+				int threads = VERIFY_THREADS[v % nthreads];
+				int simd = (v / nthreads) % (bestSimd + 1);
+				bool fused = v >= nthreads * (bestSimd + 1);
+				SetThreadCount(threads);
+				SetSimdLevel(simd);
+
+				Image out(src);
+				if (fused) {
+					PointOpPipeline pipe;
+					QueuePointOp(pipe, p);
+					pipe.Apply(&out);
+				}
+				else {
+					op.optimized(out, p);
+				}
+				runs++;
+
+				Difference d = Compare(out, ref, op.tolerance);
+				for (int ch = 0; ch < 4; ch++)
+					if (d.max[ch] > total.max[ch]) total.max[ch] = d.max[ch];
+				total.size_mismatch |= d.size_mismatch;
+				total.over += d.over;
+				total.pixels += d.pixels;
+				if (!Within(d, op.tolerance, op.outliers) && !reported) {
+					reported = true;
+					printf("  %s differs: case %d, %dx%d image, threads %d, simd %d%s, ",
+						op.name.c_str(), c, src.Width(), src.Height(), threads, simd, fused ? ", fused" : "");
+					if (d.size_mismatch)
+						printf("output %dx%d, reference %dx%d\n", out.Width(), out.Height(), ref.Width(), ref.Height());
+					else
+						printf("max difference %d at (%d, %d), %ld of %ld pixels past %d\n",
+							Worst(d), d.x, d.y, d.over, d.pixels, op.tolerance);
+				}
+			}
+		}
+		SetThreadCount(0);
+		SetSimdLevel(bestSimd);
+
+		bool ok = Within(total, op.tolerance, op.outliers);
+		failed += !ok;
+		char maxText[32];
+		snprintf(maxText, sizeof(maxText), "%d/%d/%d/%d", total.max[0], total.max[1], total.max[2], total.max[3]);
+		printf("%-22s %6d %6d %15s %5d  %s", op.name.c_str(), cases, runs,
+			total.size_mismatch ? "size" : maxText, op.tolerance, ok ? "ok" : "FAIL");
+		if (op.outliers > 0 && !total.size_mismatch)
+			printf(" (%ld of %ld pixels past tol)", total.over, total.pixels);
+		printf("\n");
+		fflush(stdout);
+	}
+	failed += CheckRowKernels(bestSimd, cases, seed, filter);
+	failed += CheckStripBoxBlur(cases, seed, filter);
+
+	printf("%s\n", failed ? "FAILED" : "all operations within tolerance");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}